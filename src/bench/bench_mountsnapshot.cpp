@@ -0,0 +1,156 @@
+/*
+    encFSGui - bench/bench_mountsnapshot.cpp
+    standalone driver that shows how MountSnapshot scales with
+    the number of mounted volumes, compared to scanning the whole
+    mount table for every volume (the way the mount output used to be parsed)
+
+    build & run with 'make bench'
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/init.h>
+#include <chrono>
+#include <stdio.h>
+
+#include "../encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// stubs, the bench only links encfsgui_mount.cpp
+// ----------------------------------------------------------------------------
+
+wxString getMountBinPath()
+{
+    return "/sbin/mount";
+}
+
+wxArrayString ArrRunCMDSync(wxString&)
+{
+    return wxArrayString();
+}
+
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+static double elapsedMicroseconds(const std::chrono::steady_clock::time_point & start)
+{
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+
+// half of the entries are encfs volumes, the other half is noise
+static void fillMountTable(MountTable & mounttable, int nrvolumes, wxArrayString & volumepaths)
+{
+    for (int i = 0; i < nrvolumes * 2; i++)
+    {
+        MountEntry entry;
+        entry.mountpoint = wxString::Format("/Volumes/bench%d/", i);
+        if (i % 2 == 0)
+        {
+            entry.source = "encfs";
+            entry.fstype = "fuse.encfs";
+            volumepaths.Add(wxString::Format("/Volumes/bench%d", i));
+        }
+        else
+        {
+            entry.source = wxString::Format("/dev/disk%d", i);
+            entry.fstype = "apfs";
+        }
+        entry.options = "rw,nosuid";
+        mounttable[entry.mountpoint] = entry;
+    }
+}
+
+
+// what the per-volume check did before the snapshot existed
+static bool scanMountTable(MountTable & mounttable, const wxString & volumepath)
+{
+    wxString normalizedpath = MountSnapshot::NormalizePath(volumepath);
+    for (MountTable::iterator it = mounttable.begin(); it != mounttable.end(); it++)
+    {
+        if (MountSnapshot::NormalizePath(it->first) == normalizedpath && it->second.isEncFS())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// ----------------------------------------------------------------------------
+// main
+// ----------------------------------------------------------------------------
+
+int main(int, char **)
+{
+    wxInitializer initializer;
+    if (!initializer.IsOk())
+    {
+        fprintf(stderr, "Unable to initialize wxWidgets\n");
+        return 1;
+    }
+
+    const int rounds = 20;
+    const int sizes[] = { 10, 50, 100, 250, 500, 1000 };
+
+    printf("%8s %14s %14s %14s\n", "volumes", "index (us)", "snapshot (us)", "scan (us)");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        MountTable mounttable;
+        wxArrayString volumepaths;
+        fillMountTable(mounttable, sizes[s], volumepaths);
+
+        double indextime = 0;
+        double snapshottime = 0;
+        double scantime = 0;
+        size_t found = 0;
+        for (int r = 0; r < rounds; r++)
+        {
+            MountSnapshot snapshot;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            snapshot.CaptureFrom(mounttable);
+            indextime += elapsedMicroseconds(start);
+
+            start = std::chrono::steady_clock::now();
+            for (size_t v = 0; v < volumepaths.GetCount(); v++)
+            {
+                found += snapshot.IsEncFSMounted(volumepaths[v]) ? 1 : 0;
+            }
+            snapshottime += elapsedMicroseconds(start);
+
+            start = std::chrono::steady_clock::now();
+            for (size_t v = 0; v < volumepaths.GetCount(); v++)
+            {
+                found += scanMountTable(mounttable, volumepaths[v]) ? 1 : 0;
+            }
+            scantime += elapsedMicroseconds(start);
+        }
+
+        if (found != volumepaths.GetCount() * 2 * rounds)
+        {
+            fprintf(stderr, "Lookup mismatch for %d volumes\n", sizes[s]);
+            return 1;
+        }
+        printf("%8d %14.1f %14.1f %14.1f\n", sizes[s],
+               indextime / rounds, snapshottime / rounds, scantime / rounds);
+    }
+
+    // and the real thing, for reference
+    MountSnapshot snapshot;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool native = snapshot.CaptureNative();
+    printf("\nCaptureNative() of this system: %.1f us%s\n", elapsedMicroseconds(start),
+           native ? "" : " (no native backend)");
+    return 0;
+}
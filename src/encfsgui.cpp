@@ -19,8 +19,10 @@
 #include <wx/stdpaths.h>
 #include <wx/log.h>
 #include <wx/utils.h>
+#include <wx/filename.h>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include "wx/taskbar.h"
 
 #include "encfsgui.h"
@@ -99,6 +101,7 @@ enum
     ID_TOOLBAR,
     // list control
     ID_List_Ctrl                   = 1000,
+    ID_Search_Ctrl,
     // taskbar icon
     // use higher range to avoid issues
     ID_Taskbar_ShowGUI             = 2000,
@@ -106,6 +109,7 @@ enum
     ID_Taskbar_Settings,
     ID_Taskbar_Exit,
     ID_Taskbar_Update,
+    ID_Taskbar_QuickMount,
     ID_List_Menu_Create         = 2500,
     ID_List_Menu_Open,
     ID_List_Menu_Mount,
@@ -113,26 +117,23 @@ enum
     ID_List_Menu_Edit,
     ID_List_Menu_Info,
     ID_List_Menu_Browse,
-    ID_List_Menu_ForceUnmountAll
+    ID_List_Menu_ForceUnmountAll,
+    // background threads
+    ID_MountWatcher             = 3000,
+    ID_Metrics_Timer,
+    ID_IdleWatcher,
+    // taskbar volume items, 2 per volume, see TrayMenuVolume
+    // open ended, so start above the wx stock ids (wxID_LOWEST..wxID_HIGHEST)
+    ID_Taskbar_Volumes          = wxID_HIGHEST + 1
 };
 
-// enum for return codes related with mount success
-enum
-{
-    ID_MNT_OK,
-    ID_MNT_PWDFAIL,
-    ID_MNT_OTHER
-};
-
-
-
 
 // -----------------------------------------------
 // global stuff to manage volumes
 // vector of all volumes, fast lookup
 std::vector<wxString> v_AllVolumes;
 // map of all volumes, using volume name as key
-std::map<wxString, DBEntry*> m_VolumeData;
+VolumeMap m_VolumeData;
 //
 // -----------------------------------------------
 
@@ -153,6 +154,11 @@ wxBEGIN_EVENT_TABLE(frmMain, wxFrame)
     EVT_MENU(ID_Menu_Existing, frmMain::OnAddExistingFolder)
     EVT_MENU(ID_Menu_Settings, frmMain::OnSettings)
     EVT_MENU(wxID_ANY, frmMain::OnToolLeftClick)
+    EVT_THREAD(ID_MountWatcher, frmMain::OnMountStateChanged)
+    EVT_TIMER(ID_Metrics_Timer, frmMain::OnMetricsTimer)
+    EVT_THREAD(ID_IdleWatcher, frmMain::OnVolumeIdle)
+    EVT_TEXT(ID_Search_Ctrl, frmMain::OnSearchText)
+    EVT_SEARCHCTRL_CANCEL_BTN(ID_Search_Ctrl, frmMain::OnSearchCancel)
 wxEND_EVENT_TABLE()
 
 
@@ -173,6 +179,7 @@ wxBEGIN_EVENT_TABLE(TaskBarIcon, wxTaskBarIcon)
     EVT_MENU(ID_Taskbar_HideGUI, TaskBarIcon::OnMenuHide)
     EVT_MENU(ID_Taskbar_Settings, TaskBarIcon::OnMenuSettings)
     EVT_MENU(ID_Taskbar_Update, TaskBarIcon::OnMenuUpdate)
+    EVT_MENU(ID_Taskbar_QuickMount, TaskBarIcon::OnMenuQuickMount)
     EVT_MENU(wxID_ANY, TaskBarIcon::OnOtherMenuClick)
 wxEND_EVENT_TABLE()
 
@@ -181,7 +188,18 @@ wxEND_EVENT_TABLE()
 // IMPLEMENTATION
 // ----------------------------------------------------------------------------
 
-wxIMPLEMENT_APP(encFSGuiApp);
+// no wxIMPLEMENT_APP(), the command line mode has to start before the GUI does
+wxIMPLEMENT_APP_NO_MAIN(encFSGuiApp);
+
+int main(int argc, char **argv)
+{
+    if (isCLICommand(argc, argv))
+    {
+        return runCLI(argc, argv);
+    }
+    wxDISABLE_DEBUG_SUPPORT();
+    return wxEntry(argc, argv);
+}
 
 
 // ----------------------------------------------------------------------------
@@ -243,18 +261,71 @@ bool encFSGuiApp::OnInit()
 
 // taskbaricon constructors
 
+static bool compareNoCase(const wxString& a, const wxString& b)
+{
+    return (a.CmpNoCase(b) < 0);
+}
+
 
 TaskBarIcon::TaskBarIcon(wxTaskBarIconType iconType) : wxTaskBarIcon(iconType)
 {
+    m_taskBarMenu = NULL;
+    m_menuDirty = true;
+    m_menuPageSize = 0;
+    // keep the menu in sync with mount state changes
+    getVolumeRegistry().AddListener(this);
+}
 
+TaskBarIcon::~TaskBarIcon()
+{
+    getVolumeRegistry().RemoveListener(this);
+    delete m_taskBarMenu;
 }
 
 // Overridables
 // this function gets called each time user clicks the taskbar icon
-// in other words, menu gets populated dynamically every time
+// the menu itself only gets rebuilt when the list of volumes changed,
+// mount state changes update the existing items (see OnVolumeChanged)
 
+#if wxCHECK_VERSION(3, 1, 5)
+wxMenu *TaskBarIcon::GetPopupMenu()
+{
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    long pagesize = pConfig->Read(wxT("traymenupagesize"), 20l);
+    if (m_menuDirty || !m_taskBarMenu || pagesize != m_menuPageSize)
+    {
+        delete m_taskBarMenu;
+        m_taskBarMenu = NULL;
+        m_taskBarMenu = BuildPopupMenu();
+    }
+    UpdateVisibleItems();
+    return m_taskBarMenu;
+}
+#else
 wxMenu *TaskBarIcon::CreatePopupMenu()
 {
+    // wx owns this one, so don't keep pointers into it
+    wxMenu *menu = BuildPopupMenu();
+    m_taskBarMenu = menu;
+    UpdateVisibleItems();
+    m_taskBarMenu = NULL;
+    for (size_t i = 0; i < m_trayVolumes.size(); i++)
+    {
+        m_trayVolumes[i].mountitem = NULL;
+        m_trayVolumes[i].unmountitem = NULL;
+    }
+    return menu;
+}
+#endif
+
+
+wxMenu *TaskBarIcon::BuildPopupMenu()
+{
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    m_menuPageSize = pConfig->Read(wxT("traymenupagesize"), 20l);
+
     wxMenu *menu = new wxMenu;
     menu->Append(ID_Taskbar_ShowGUI, wxT("&Show EncFSGui"));
     menu->Append(ID_Taskbar_HideGUI, wxT("&Hide EncFSGui"));
@@ -262,54 +333,38 @@ wxMenu *TaskBarIcon::CreatePopupMenu()
     menu->Append(ID_Taskbar_Settings, wxT("S&ettings"));
     menu->AppendSeparator();
 
+    m_trayVolumes.clear();
+    m_trayVolumeIndex.clear();
 
-    if (g_frmMain->GetVisibleState())
+    wxMenu *volumesmenu = new wxMenu;
+    if (m_menuPageSize < 1 || (long)v_AllVolumes.size() <= m_menuPageSize)
     {
-        menu->Enable(ID_Taskbar_ShowGUI, false);
-        menu->Enable(ID_Taskbar_HideGUI, true);
+        for (size_t i = 0; i < v_AllVolumes.size(); i++)
+        {
+            AppendVolumeItems(volumesmenu, v_AllVolumes[i]);
+        }
     }
     else
     {
-        menu->Enable(ID_Taskbar_ShowGUI, true);
-        menu->Enable(ID_Taskbar_HideGUI, false);
-    }
-    
-
-    wxMenu *volumesmenu = new wxMenu;
-    int submenuid = 5555;
-    for (std::vector<wxString>::iterator it = v_AllVolumes.begin(); it != v_AllVolumes.end(); ++it)
-    {
-        wxString voltitle;
-        wxString volname;
-        bool isMounted;
-        volname.Printf(wxT("%s"), *it);
-        DBEntry * thisvol = m_VolumeData[volname];
-        isMounted = thisvol->getMountState();
-        voltitle.Printf(wxT("Mount '%s'"), volname);
-        volumesmenu->Append(submenuid, voltitle);
-        if (isMounted)
-        {
-            volumesmenu->Enable(submenuid, false);
-        }
-        else
-        {
-            volumesmenu->Enable(submenuid, true);
-        }
-        ++submenuid;
-        voltitle.Printf(wxT("Unmount '%s'"), volname);
-        volumesmenu->Append(submenuid, voltitle);
-        if (isMounted)
-        {
-            volumesmenu->Enable(submenuid, true);
-        }
-        else
+        // too many for one menu, split in alphabetical pages
+        std::vector<wxString> sortedvolumes = v_AllVolumes;
+        std::sort(sortedvolumes.begin(), sortedvolumes.end(), compareNoCase);
+        for (size_t first = 0; first < sortedvolumes.size(); first += m_menuPageSize)
         {
-            volumesmenu->Enable(submenuid, false);
+            size_t last = std::min(first + m_menuPageSize, sortedvolumes.size()) - 1;
+            wxMenu *pagemenu = new wxMenu;
+            for (size_t i = first; i <= last; i++)
+            {
+                AppendVolumeItems(pagemenu, sortedvolumes[i]);
+            }
+            wxString pagetitle;
+            pagetitle.Printf(wxT("%s - %s"), sortedvolumes[first], sortedvolumes[last]);
+            pagetitle.Replace("&", "&&");
+            volumesmenu->AppendSubMenu(pagemenu, pagetitle);
         }
-        volumesmenu->AppendSeparator();
-        ++submenuid;
     }
     menu->AppendSubMenu(volumesmenu, "&Volumes");
+    menu->Append(ID_Taskbar_QuickMount, wxT("&Quick mount..."));
     menu->AppendSeparator();
     menu->Append(ID_Taskbar_Update, wxT("&Check for updates"));
 
@@ -323,17 +378,85 @@ wxMenu *TaskBarIcon::CreatePopupMenu()
         menu->Append(ID_Taskbar_Exit, wxT("E&xit"));
     }
 
-    m_taskBarMenu = menu;
-    m_taskBarVolumesMenu = volumesmenu;
-
+    m_menuDirty = false;
     return menu;
 }
 
 
+// adds the Mount/Unmount pair for a volume, and registers their menu ids
+void TaskBarIcon::AppendVolumeItems(wxMenu *menu, const wxString& volname)
+{
+    size_t index = m_trayVolumes.size();
+    int mountid = ID_Taskbar_Volumes + (int)(2 * index);
+
+    // '&' would be taken as a mnemonic
+    wxString menuname = volname;
+    menuname.Replace("&", "&&");
+    wxString voltitle;
+
+    TrayMenuVolume trayvolume;
+    trayvolume.volname = volname;
+    voltitle.Printf(wxT("Mount '%s'"), menuname);
+    trayvolume.mountitem = menu->Append(mountid, voltitle);
+    voltitle.Printf(wxT("Unmount '%s'"), menuname);
+    trayvolume.unmountitem = menu->Append(mountid + 1, voltitle);
+    menu->AppendSeparator();
+
+    m_trayVolumes.push_back(trayvolume);
+    m_trayVolumeIndex[volname] = index;
+    UpdateVolumeItems(trayvolume);
+}
+
+void TaskBarIcon::UpdateVolumeItems(const TrayMenuVolume& trayvolume)
+{
+    if (!trayvolume.mountitem || !trayvolume.unmountitem)
+    {
+        return;
+    }
+    VolumeMap::iterator it = m_VolumeData.find(trayvolume.volname);
+    bool isMounted = (it != m_VolumeData.end() && it->second && it->second->getMountState());
+    trayvolume.mountitem->Enable(!isMounted);
+    trayvolume.unmountitem->Enable(isMounted);
+}
+
+void TaskBarIcon::UpdateVisibleItems()
+{
+    bool visible = g_frmMain->GetVisibleState();
+    m_taskBarMenu->Enable(ID_Taskbar_ShowGUI, !visible);
+    m_taskBarMenu->Enable(ID_Taskbar_HideGUI, visible);
+}
+
+
+// mount state changed, flip the items of that volume only
+void TaskBarIcon::OnVolumeChanged(const wxString& volumename)
+{
+    if (!m_taskBarMenu)
+    {
+        return;
+    }
+    std::map<wxString, size_t>::iterator it = m_trayVolumeIndex.find(volumename);
+    if (it != m_trayVolumeIndex.end())
+    {
+        UpdateVolumeItems(m_trayVolumes[it->second]);
+    }
+}
+
+// volumes added or removed, rebuild the next time the menu is shown
+void TaskBarIcon::OnVolumeListChanged()
+{
+    m_menuDirty = true;
+}
+
+
 
 // taskbaricon member functions
 void TaskBarIcon::OnMenuExit(wxCommandEvent& event)
 {
+    // the taskbar menu stays usable while we wait for a command to finish
+    if (IsCMDWaitActive())
+    {
+        return;
+    }
     g_frmMain->OnQuit(event);
 }
 
@@ -356,6 +479,10 @@ void TaskBarIcon::OnMenuHide(wxCommandEvent& WXUNUSED(event))
 
 void TaskBarIcon::OnMenuSettings(wxCommandEvent& event)
 {
+    if (IsCMDWaitActive())
+    {
+        return;
+    }
     if (!g_frmMain->GetVisibleState())
     {
         g_frmMain->SetVisibleState(true);        
@@ -365,46 +492,60 @@ void TaskBarIcon::OnMenuSettings(wxCommandEvent& event)
 
 void TaskBarIcon::OnOtherMenuClick(wxCommandEvent& event)
 {
-    int clickedid = event.GetId();
-    wxString clickedtext = m_taskBarVolumesMenu->GetLabel(clickedid);
-
-    bool domount = false;
-    wxString reststr = "";
-    wxString volname = "";
-    if (clickedtext.StartsWith("Mount '", &reststr))
+    if (IsCMDWaitActive())
     {
-        domount = true;
-        volname = reststr;
-        volname.Replace("'","");
+        return;
     }
-    else if (clickedtext.StartsWith("Unmount '", &reststr))
+    // menu id -> volume, see AppendVolumeItems()
+    int slot = event.GetId() - ID_Taskbar_Volumes;
+    if (slot < 0 || slot >= (int)(2 * m_trayVolumes.size()))
     {
-        domount = false;
-        volname = reststr;
-        volname.Replace("'","");
+        return;
     }
-
-    if (!volname.IsEmpty())
+    bool domount = ((slot % 2) == 0);
+    wxString volname = m_trayVolumes[slot / 2].volname;
+    if (m_VolumeData.find(volname) == m_VolumeData.end())
     {
-        wxString prevselectedvol = g_selectedVolume;
-        int prevselectedindex = g_selectedIndex;
-        g_selectedVolume = volname;
-        g_selectedIndex = g_frmMain->GetListCtrlIndex(volname);
+        // removed since the menu was built
+        return;
+    }
 
-        if (domount)
-        {
-            g_frmMain->OnMount(event);
-        }
-        else
-        {
-            g_frmMain->OnUnMount(event);
+    RunVolumeAction(volname, domount, event);
+}
 
-        }
-        g_selectedVolume = prevselectedvol;
-        g_selectedIndex = prevselectedindex;
+// type-ahead search over all unmounted volumes
+void TaskBarIcon::OnMenuQuickMount(wxCommandEvent& event)
+{
+    if (IsCMDWaitActive())
+    {
+        return;
+    }
+    wxString volname = selectQuickMountVolume(g_frmMain, m_VolumeData);
+    if (!volname.IsEmpty() && m_VolumeData.find(volname) != m_VolumeData.end())
+    {
+        RunVolumeAction(volname, true, event);
+    }
+}
 
+// mount/unmount a volume that isn't necessarily selected in the list
+void TaskBarIcon::RunVolumeAction(const wxString& volname, bool domount, wxCommandEvent& event)
+{
+    wxString prevselectedvol = g_selectedVolume;
+    int prevselectedindex = g_selectedIndex;
+    g_selectedVolume = volname;
+    g_selectedIndex = g_frmMain->GetListCtrlIndex(g_selectedVolume);
+
+    if (domount)
+    {
+        g_frmMain->OnMount(event);
     }
+    else
+    {
+        g_frmMain->OnUnMount(event);
 
+    }
+    g_selectedVolume = prevselectedvol;
+    g_selectedIndex = prevselectedindex;
 }
 
 
@@ -419,8 +560,27 @@ frmMain::frmMain(const wxString& title,
     m_visible = true;
     wxStandardPathsBase& stdp = wxStandardPaths::Get();
     m_listCtrl = NULL;
+    m_searchCtrl = NULL;
     m_datadir = stdp.GetUserDataDir();
 
+    // start watching the mount table, PopulateVolumes() tells it what to look for
+    m_mountWatcher = new MountWatcherThread(this, ID_MountWatcher);
+    if (m_mountWatcher->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete m_mountWatcher;
+        m_mountWatcher = NULL;
+    }
+
+    // unmounts volumes after their idle timeout, PopulateVolumes() tells it which ones
+    m_idleWatcher = new IdleWatcherThread(this, ID_IdleWatcher);
+    if (m_idleWatcher->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete m_idleWatcher;
+        m_idleWatcher = NULL;
+    }
+    // volumes we mount ourselves never show up as a mount watcher event
+    getVolumeRegistry().AddListener(this);
+
     m_statusBar = CreateStatusBar(2, wxSB_SUNKEN);
 
     // set the frame icon
@@ -455,6 +615,10 @@ frmMain::frmMain(const wxString& title,
     // Populate vector & map with volume information
     PopulateVolumes();
 
+    // find out what encfs supports in the background,
+    // so the "Create" dialog doesn't have to wait for it
+    StartEncFSCapsProbe();
+
     m_rows = 1;
     // Create the toolbar
     CreateToolbar();
@@ -465,18 +629,25 @@ frmMain::frmMain(const wxString& title,
     wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
     m_panel->SetSizer(sizer);
 
+    // search box above the list, filters as you type
+    m_searchCtrl = new wxSearchCtrl(m_panel, ID_Search_Ctrl, "", wxDefaultPosition, wxDefaultSize);
+    m_searchCtrl->ShowCancelButton(true);
+    m_searchCtrl->SetDescriptiveText("Filter on name or path");
+    sizer->Add(m_searchCtrl, wxSizerFlags().Expand().Border(wxALL, 5));
+
     // check if we need to mount volumes at startup
     AutoMountVolumes();
 
     // next, create the actual list control and populate it
     //long flags = wxLC_REPORT | wxLC_SINGLE_SEL | wxLC_ALIGN_LEFT | wxLC_SMALL_ICON | wxLC_HRULES;
-    long flags = wxLC_REPORT | wxLC_SINGLE_SEL | wxLC_HRULES | wxLC_ALIGN_LEFT;
+    long flags = wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL | wxLC_HRULES | wxLC_ALIGN_LEFT;
     m_listCtrl = new mainListCtrl(m_panel, 
                                   ID_List_Ctrl, 
                                   wxDefaultPosition, 
                                   wxDefaultSize, 
                                   flags, 
                                   m_statusBar);
+    sizer->Add(m_listCtrl, wxSizerFlags(1).Expand());
     
     RecreateList();
 
@@ -496,6 +667,14 @@ frmMain::frmMain(const wxString& title,
         SetVisibleState(true);
     }
 
+    // write the metrics files every metricsinterval seconds (0 = never)
+    long metricsinterval = pConfig->Read(wxT("metricsinterval"), 60l);
+    m_metricsTimer.SetOwner(this, ID_Metrics_Timer);
+    if (metricsinterval > 0)
+    {
+        m_metricsTimer.Start(metricsinterval * 1000);
+    }
+
     // finally, add the app icon
     m_taskBarIcon = new TaskBarIcon(wxTBI_DEFAULT_TYPE);
     m_taskBarIcon->SetIcon(wxICON(encfsgui_ico),
@@ -518,6 +697,23 @@ mainListCtrl::mainListCtrl(wxWindow *parent,
                            wxStatusBar * statusbar) : wxListCtrl(parent, id, pos, size, style)
 {
     m_statusBar = statusbar;
+    m_toolBar = NULL;
+
+    // mount state changes only redraw the row of that volume
+    getVolumeRegistry().AddListener(this);
+
+    // smaller font, red = mounted, blue = not mounted
+    wxFont font = GetFont();
+    font.MakeSmaller();
+    m_attrMounted.SetFont(font);
+    m_attrMounted.SetTextColour(*wxRED);
+    m_attrUnmounted.SetFont(font);
+    m_attrUnmounted.SetTextColour(*wxBLUE);
+}
+
+mainListCtrl::~mainListCtrl()
+{
+    getVolumeRegistry().RemoveListener(this);
 }
 
 
@@ -548,76 +744,33 @@ void frmMain::SetVisibleState(bool newstate)
 
 int frmMain::GetListCtrlIndex(wxString& volname)
 {
-    int returnval = -1;
-    int itemcount = m_listCtrl->GetItemCount();
-    for (int i = 0; i < itemcount; ++i)
+    if (!m_listCtrl)
     {
-        if (m_listCtrl->GetItemText(i, 1) == volname)
-        {
-            returnval = i;
-            break;
-        }
+        return -1;
     }
-    return returnval;
+    return (int)m_listCtrl->GetVolumeRow(volname);
 }
 
 void frmMain::PopulateVolumes()
 {
-    wxConfigBase *pConfig = wxConfigBase::Get();
-    pConfig->SetPath(wxT("/Config"));
-    wxString mountbin = pConfig->Read(wxT("mountbin_path"), "/sbin/mount");
-
-    // get info about already mounted volumes
-    wxArrayString mount_output;
-    mount_output = ArrRunCMDSync(mountbin);
-
-    v_AllVolumes.clear();
-    pConfig->SetPath(wxT("/Volumes"));
-    wxString volumename;
-    wxString allNames;
-    long dummy;
-    bool bCont = pConfig->GetFirstGroup(volumename, dummy);
-    while ( bCont ) { 
-        v_AllVolumes.push_back(volumename); 
-        bCont = pConfig->GetNextGroup(volumename, dummy);
-    }
-
-    for (unsigned int i = 0; i < v_AllVolumes.size(); i++)
-    {
-        wxString currentPath;
-        wxString enc_path;
-        wxString mount_path;
-        bool automount;
-        bool alreadymounted;
-        bool preventautounmount;
-        bool pwsaved;
-        bool allowother;
-        bool mountaslocal;
-        wxString volumename = v_AllVolumes.at(i);
-        currentPath.Printf(wxT("/Volumes/%s"), volumename);
-        pConfig->SetPath(currentPath);
-        enc_path = pConfig->Read(wxT("enc_path"), "");
-        mount_path = pConfig->Read(wxT("mount_path"), "");
-        automount = pConfig->Read(wxT("automount"), 0l);
-        preventautounmount = pConfig->Read(wxT("preventautounmount"), 0l);
-        alreadymounted = IsVolumeSystemMounted(mount_path, mount_output);
-        pwsaved = pConfig->Read(wxT("passwordsaved"), 0l);
-        allowother = pConfig->Read(wxT("allowother"), 0l);
-        mountaslocal = pConfig->Read(wxT("mountaslocal"), 0l);
-        if (not enc_path.IsEmpty() && not mount_path.IsEmpty())
+    // same code path as the command line mode
+    loadVolumes(m_VolumeData, v_AllVolumes);
+
+    // let the mount watcher know about the current set of volumes
+    if (m_mountWatcher)
+    {
+        std::map<wxString, wxString> watchedpaths;
+        std::map<wxString, bool> knownstates;
+        for (VolumeMap::iterator it = m_VolumeData.begin(); it != m_VolumeData.end(); it++)
         {
-            DBEntry* thisvolume = new DBEntry(volumename, 
-                                              enc_path, 
-                                              mount_path, 
-                                              automount, 
-                                              preventautounmount, 
-                                              pwsaved,
-                                              allowother,
-                                              mountaslocal);
-            thisvolume->setMountState(alreadymounted);
-            // add to map
-            m_VolumeData[volumename] = thisvolume;       
+            watchedpaths[it->first] = it->second->getMountPath();
+            knownstates[it->first] = it->second->getMountState();
         }
+        m_mountWatcher->SetWatchedVolumes(watchedpaths, knownstates);
+    }
+    if (m_idleWatcher)
+    {
+        m_idleWatcher->SetWatchedVolumes(m_VolumeData);
     }
 
     // %u = unsigned int
@@ -674,51 +827,6 @@ void frmMain::CheckUpdates(bool showIfNoUpdate)
 }
 
 
-bool unmountVolume(wxString& volumename)
-{
-    DBEntry *thisvol = m_VolumeData[volumename];
-    wxString mountvol = thisvol->getMountPath();
-    wxString umountbin;
-    wxString mountbin;
-    bool beenmounted;
-    mountbin = getMountBinPath();
-    umountbin = getUMountBinPath();
-    wxString cmd;
-    cmd.Printf(wxT("'%s' '%s'"), umountbin, mountvol);
-    wxString cmdoutput;
-    cmdoutput = StrRunCMDSync(cmd);
-    // get info about already mounted volumes
-    wxArrayString mount_output;
-    mount_output = ArrRunCMDSync(mountbin);
-    wxString mountstr;
-    mountstr = arrStrTowxStr(mount_output);
-    
-    beenmounted = IsVolumeSystemMounted(mountvol, mount_output);
-    if (not beenmounted)
-    {
-        // it's gone - reset stuff
-        thisvol->setMountState(false);
-        return true;    // unmount success
-    }
-    return false;
-}
-
-
-
-void AutoUnmountVolumes(bool forced)
-{
-    for (std::map<wxString, DBEntry*>::iterator it= m_VolumeData.begin(); it != m_VolumeData.end(); it++)
-    {
-        wxString volumename = it->first;
-        DBEntry * thisvol = it->second;
-        if (thisvol->getMountState() && (!thisvol->getPreventAutoUnmount() || forced)) 
-        {
-            unmountVolume(volumename);
-        }
-    }
-}
-
-
 //
 // event handlers
 //
@@ -764,15 +872,22 @@ bool QuitApp(wxWindow * parent)
     
     if (res == wxYES)
     {
-        delete wxConfigBase::Set((wxConfigBase *) NULL);
-        // true is to force the frame to close
-
         // if autounmount, dismount volumes first
         if (autounmount)
         {
             // do not force
-            AutoUnmountVolumes(false);
+            std::vector<UnmountResult> results = AutoUnmountVolumes(m_VolumeData, false);
+            wxString summary = getUnmountSummary(results);
+            if (!summary.IsEmpty())
+            {
+                wxString failmsg;
+                failmsg.Printf(wxT("The following volumes could not be unmounted:\n\n%s"), summary);
+                wxMessageBox(failmsg, wxT("Unmount failed"), wxOK | wxICON_WARNING, parent);
+            }
         }
+
+        delete wxConfigBase::Set((wxConfigBase *) NULL);
+        // true is to force the frame to close
         return true;
     }
     return false;
@@ -801,6 +916,22 @@ int frmMain::OnExit(wxCommandEvent& WXUNUSED(event))
 // destructor
 frmMain::~frmMain()
 {
+    m_metricsTimer.Stop();
+    getVolumeRegistry().RemoveListener(this);
+    if (m_mountWatcher)
+    {
+        m_mountWatcher->RequestStop();
+        m_mountWatcher->Wait();
+        delete m_mountWatcher;
+        m_mountWatcher = NULL;
+    }
+    if (m_idleWatcher)
+    {
+        m_idleWatcher->RequestStop();
+        m_idleWatcher->Wait();
+        delete m_idleWatcher;
+        m_idleWatcher = NULL;
+    }
     delete m_taskBarIcon;
     this->Destroy();
     Close(true);
@@ -873,7 +1004,7 @@ void frmMain::OnBrowseFolder(wxCommandEvent& WXUNUSED(event))
 {
     if (not g_selectedVolume.IsEmpty())
     {
-        DBEntry * thisvol = m_VolumeData[g_selectedVolume];
+        DBEntry * thisvol = m_VolumeData[g_selectedVolume].get();
         wxString mountpath = thisvol->getMountPath();
         BrowseFolder(mountpath);
     }
@@ -881,78 +1012,6 @@ void frmMain::OnBrowseFolder(wxCommandEvent& WXUNUSED(event))
 
 
 
-// mount folder - generic routine
-int frmMain::mountFolder(wxString& volumename, wxString& pw)
-{
-    wxString mountvol;
-    wxString encvol;
-    bool allowother;
-    bool mountaslocal;
-    wxString buf;
-    
-    bool beenmounted;
-    DBEntry *thisvol = m_VolumeData[volumename];
-    mountvol = thisvol->getMountPath();
-    encvol = thisvol->getEncPath();
-    allowother = thisvol->getAllowOther();
-    mountaslocal = thisvol->getMountAsLocal();
-
-    // run encfs command
-    wxString cmd;
-    wxString cmdoutput;
-    wxString encfsbin = getEncFSBinPath();
-    wxString extra_osxfuse_opts = "";
-    if (allowother)
-    {
-        extra_osxfuse_opts << "-o allow_other ";
-    }
-    if (mountaslocal)
-    {
-        extra_osxfuse_opts << "-o local ";
-    }
-
-    // first, create mount point if necessary
-    cmd.Printf(wxT("mkdir -p '%s'"), mountvol);
-    cmdoutput = StrRunCMDSync(cmd);
-
-    // mount
-    cmd.Printf(wxT("sh -c \"echo '%s' | %s -v -S %s -o volname='%s' '%s' '%s'\""), pw, encfsbin, extra_osxfuse_opts, volumename, encvol, mountvol);
-
-    cmdoutput = StrRunCMDSync(cmd);
-
-    // check if mount was successful
-    wxString errmsg;
-    errmsg = "Error decoding volume key, password incorrect";
-
-    //wxLogDebug(wxT("----------------------------"));
-    //wxLogDebug(cmdoutput);
-    //wxLogDebug(wxT("----------------------------"));
-    if (cmdoutput.Find(errmsg) > -1)
-    {
-        return ID_MNT_PWDFAIL;
-    }
-
-    // check mount list, to be sure
-    wxString mountbin = getMountBinPath();
-
-    // get info about already mounted volumes
-    wxArrayString mount_output;
-    mount_output = ArrRunCMDSync(mountbin);
-    wxString mountstr;
-    mountstr = arrStrTowxStr(mount_output);
-    
-    beenmounted = IsVolumeSystemMounted(mountvol, mount_output);
-    if (beenmounted)
-    {
-        thisvol->setMountState(true);
-        return ID_MNT_OK;
-    }
-    return ID_MNT_OTHER;
-}
-
-
-
-
 // unmount folder, generic routine
 bool frmMain::unmountVolumeAsk(wxString& volumename)
 {
@@ -962,7 +1021,7 @@ bool frmMain::unmountVolumeAsk(wxString& volumename)
     bool unmountok;
     unmountok = false;
 
-    DBEntry *thisvol = m_VolumeData[volumename];
+    DBEntry *thisvol = m_VolumeData[volumename].get();
     mountvol = thisvol->getMountPath();
 
     wxConfigBase *pConfig = wxConfigBase::Get();
@@ -971,7 +1030,7 @@ bool frmMain::unmountVolumeAsk(wxString& volumename)
 
     if (skippromptunmount)
     {
-        unmountok = unmountVolume(volumename);
+        unmountok = unmountVolume(m_VolumeData, volumename);
     }
     else
     {
@@ -984,7 +1043,7 @@ bool frmMain::unmountVolumeAsk(wxString& volumename)
                                                     wxYES_NO|wxCENTRE|wxNO_DEFAULT|wxICON_QUESTION);
         if (dlg->ShowModal() == wxID_YES)
         {
-            unmountok = unmountVolume(volumename);
+            unmountok = unmountVolume(m_VolumeData, volumename);
         }
         dlg->Destroy();
     }
@@ -996,39 +1055,17 @@ bool frmMain::unmountVolumeAsk(wxString& volumename)
 
 int frmMain::mountSelectedFolder(wxString& pw)
 {
-    wxString buf;   
     // update statustext
     wxString msg;
     msg.Printf(wxT("Mounting '%s'"), g_selectedVolume);
     PushStatusText(msg,0);
 
-    buf.Printf(wxT("%s"), ".....");
-    m_listCtrl->SetItem(g_selectedIndex, 0, buf);
+    m_listCtrl->SetBusyVolume(g_selectedVolume);
 
-    int mountstatus = mountFolder(g_selectedVolume, pw);
+    int mountstatus = mountVolume(m_VolumeData, g_selectedVolume, pw);
 
-    if (mountstatus == ID_MNT_OK)
-    {
-        buf.Printf(wxT("%s"), "YES");
-        wxColour itemColour = wxColour(*wxRED);
-        m_listCtrl->SetItemTextColour(g_selectedIndex, itemColour);
-        m_listCtrl->SetItem(g_selectedIndex, 0, buf);
-        SetToolBarButtonState(ID_Toolbar_Mount, false);
-        SetToolBarButtonState(ID_Toolbar_Unmount, true);
-        SetToolBarButtonState(ID_Toolbar_Browse, true);
-        SetToolBarButtonState(ID_Toolbar_Edit, true);   // limited edits allowed
-    }
-    else
-    {
-        buf.Printf(wxT("%s"), "NO");
-        wxColour itemColour = wxColour(*wxBLUE);
-        m_listCtrl->SetItemTextColour(g_selectedIndex, itemColour);
-        m_listCtrl->SetItem(g_selectedIndex, 0, buf);
-        SetToolBarButtonState(ID_Toolbar_Unmount, false);
-        SetToolBarButtonState(ID_Toolbar_Mount, true);
-        SetToolBarButtonState(ID_Toolbar_Browse, false);
-        SetToolBarButtonState(ID_Toolbar_Edit, true);
-    }
+    // row and toolbar follow through OnVolumeChanged()
+    m_listCtrl->SetBusyVolume("");
     PopStatusText(0);
     return mountstatus;
 }
@@ -1036,76 +1073,34 @@ int frmMain::mountSelectedFolder(wxString& pw)
 
 void frmMain::AutoMountVolumes()
 {
-    // iterate over volumes
-    for (std::map<wxString, DBEntry*>::iterator it= m_VolumeData.begin(); it != m_VolumeData.end(); it++)
+    wxArrayString failedvolumes = autoMountVolumes(m_VolumeData, [this](const AutoMountJob& job)
     {
-        wxString volumename = it->first;
-        DBEntry * thisvol = it->second;
-        wxString mountvol = thisvol->getMountPath();
-        wxString encvol = thisvol->getEncPath();
         wxString title;
-        title.Printf(wxT("Automount '%s'"), volumename);
-        if ((not thisvol->getMountState()) && (thisvol->getAutoMount()) )
+        wxString msg;
+        title.Printf(wxT("Automount '%s'"), job.volumename);
+        if (job.nrtries > 1)
         {
-            bool trymount = true;
-            int nrtries = 0;
-            wxString extratxt = "";
-            while (trymount && nrtries < 5)
-            {
-                wxString msg;
-                msg.Printf(wxT("%sPlease enter password to auto-mount\n'%s'\nas\n'%s'"), extratxt, encvol, mountvol);
-                wxString pw;
-                if (thisvol->getPwSavedState())
-                {
-                    pw = getKeychainPassword(volumename);
-                }
-                else
-                {
-                    pw = getPassWord(title, msg);
-                }
-                 
-                
-                if (!pw.IsEmpty())
-                {
-                     // try mount
-                    int mountstatus = mountFolder(volumename, pw);
-                    // to do : instead of setting pw to a new value, clear out memory location directly 
-                    pw = "GoodLuckWithThat";
-
-                    if (mountstatus == ID_MNT_PWDFAIL)
-                    {
-                        extratxt.Printf(wxT("** You have entered an invalid password **\n\n"));
-                    }
-                    else if (mountstatus == ID_MNT_OK)
-                    {
-                        trymount = false;
-                    }
-                    else if (mountstatus == ID_MNT_OTHER)
-                    {
-                        // show message and then break
-                        wxString errormsg;
-                        wxString errortitle;
-                        errormsg.Printf(wxT("Unable to mount volume '%s'\nEncfs folder: %s\nMount path: %s"), volumename, encvol, mountvol);
-                        errortitle.Printf(wxT("Error found while mounting '%s'"), volumename);
-                        wxMessageDialog * dlg = new wxMessageDialog(this, 
-                                                                    errormsg, 
-                                                                    errortitle, 
-                                                                    wxOK|wxCENTRE|wxICON_ERROR);
-                        dlg->ShowModal();
-                        dlg->Destroy();
-                        trymount = false;
-                    }   
-                }
-                else
-                {
-                    // bail out
-                    trymount = false;
-                }
-                nrtries++;
-            }            
+            msg.Printf(wxT("** You have entered an invalid password **\n\nPlease enter password to auto-mount\n'%s'\nas\n'%s'"), job.encvol, job.mountvol);
         }
+        else
+        {
+            msg.Printf(wxT("Please enter password to auto-mount\n'%s'\nas\n'%s'"), job.encvol, job.mountvol);
+        }
+        return getPassWord(title, msg);
+    });
+
+    // one report for everything that didn't work out
+    if (!failedvolumes.IsEmpty())
+    {
+        wxString errormsg;
+        errormsg.Printf(wxT("Unable to auto-mount the following volume(s):\n\n%s"), arrStrTowxStr(failedvolumes));
+        wxMessageDialog * dlg = new wxMessageDialog(this, 
+                                                    errormsg, 
+                                                    "Error found while auto-mounting", 
+                                                    wxOK|wxCENTRE|wxICON_ERROR);
+        dlg->ShowModal();
+        dlg->Destroy();
     }
-    // mount when needed
 }
 
 void frmMain::OnForceUnMountAll(wxCommandEvent& WXUNUSED(event))
@@ -1115,6 +1110,7 @@ void frmMain::OnForceUnMountAll(wxCommandEvent& WXUNUSED(event))
     bool unmountok;
     int nrmounted = 0;
     unmountok = false;
+    std::vector<UnmountResult> results;
 
     wxConfigBase *pConfig = wxConfigBase::Get();
     pConfig->SetPath(wxT("/Config"));
@@ -1122,10 +1118,10 @@ void frmMain::OnForceUnMountAll(wxCommandEvent& WXUNUSED(event))
 
 
     // count how many volumes are mounted
-    for (std::map<wxString, DBEntry*>::iterator it= m_VolumeData.begin(); it != m_VolumeData.end(); it++)
+    for (VolumeMap::iterator it= m_VolumeData.begin(); it != m_VolumeData.end(); it++)
     {
         wxString volumename = it->first;
-        DBEntry * thisvol = it->second;
+        DBEntry * thisvol = it->second.get();
         if (thisvol->getMountState()) 
         {
             ++nrmounted;
@@ -1137,8 +1133,7 @@ void frmMain::OnForceUnMountAll(wxCommandEvent& WXUNUSED(event))
         if (skippromptunmount)
         {
             // force unmount
-            AutoUnmountVolumes(true);
-            RefreshAll();
+            results = AutoUnmountVolumes(m_VolumeData, true);
         }
         else
         {
@@ -1151,49 +1146,44 @@ void frmMain::OnForceUnMountAll(wxCommandEvent& WXUNUSED(event))
             if (dlg->ShowModal() == wxID_YES)
             {
                 // force unmount on all mounted volumes
-                AutoUnmountVolumes(true);
-                RefreshAll();
+                results = AutoUnmountVolumes(m_VolumeData, true);
             }
             dlg->Destroy();
         }   
     }
+
+    wxString summary = getUnmountSummary(results);
+    if (!summary.IsEmpty())
+    {
+        msg.Printf(wxT("The following volumes could not be unmounted:\n\n%s"), summary);
+        wxMessageBox(msg, wxT("Unmount failed"), wxOK | wxICON_WARNING, this);
+    }
 } 
 
 
 
 void frmMain::OnUnMount(wxCommandEvent& WXUNUSED(event))
 {
-    bool beenunmounted;
-    beenunmounted = unmountVolumeAsk(g_selectedVolume);
-    if (beenunmounted)
-    {
-        // it's gone - reset stuff
-        wxString buf;
-        buf.Printf(wxT("%s"), "NO");
-        wxColour itemColour = wxColour(*wxBLUE);
-        m_listCtrl->SetItemTextColour(g_selectedIndex, itemColour);
-        m_listCtrl->SetItem(g_selectedIndex, 0, buf);
-        SetToolBarButtonState(ID_Toolbar_Mount, true);
-        SetToolBarButtonState(ID_Toolbar_Unmount, false);
-        SetToolBarButtonState(ID_Toolbar_Browse, false);
-        SetToolBarButtonState(ID_Toolbar_Edit, true);
-    }
-    else
-    {
-        // still mounted
-        SetToolBarButtonState(ID_Toolbar_Mount, false);
-        SetToolBarButtonState(ID_Toolbar_Unmount, true);
-        SetToolBarButtonState(ID_Toolbar_Browse, true);
-        SetToolBarButtonState(ID_Toolbar_Edit, true); // limited edits allowed
-    }
+    // row and toolbar follow through OnVolumeChanged()
+    unmountVolumeAsk(g_selectedVolume);
 }
 
 void frmMain::OnInfo(wxCommandEvent& WXUNUSED(event))
 {
     // get full encfpath for this volume
-    DBEntry * thisvol = m_VolumeData[g_selectedVolume];
+    DBEntry * thisvol = m_VolumeData[g_selectedVolume].get();
     wxString encvol = thisvol->getEncPath();
-    wxArrayString volinfo = getEncFSVolumeInfo(encvol);
+    // read .encfs6.xml ourselves, only ask encfsctl if we don't know the format
+    wxArrayString volinfo;
+    EncFSVolumeConfig volconfig;
+    if (getEncFSVolumeConfig(encvol, volconfig))
+    {
+        volinfo = volconfig.GetInfoLines();
+    }
+    else
+    {
+        volinfo = getEncFSVolumeInfo(encvol);
+    }
     wxString msg = arrStrTowxStr(volinfo);
     wxString title;
     title.Printf(wxT("EncFS information for '%s'"), g_selectedVolume);
@@ -1207,6 +1197,76 @@ void frmMain::OnInfo(wxCommandEvent& WXUNUSED(event))
 }
 
 
+// a running daemon does the (un)mounts, and writes the metrics itself
+void frmMain::OnMetricsTimer(wxTimerEvent& WXUNUSED(event))
+{
+    if (!isDaemonRunning())
+    {
+        writeMetrics(m_VolumeData);
+    }
+}
+
+
+// posted by the mount watcher when a volume got mounted or unmounted,
+// possibly outside of this app (fusermount/umount, crash, sleep)
+void frmMain::OnMountStateChanged(wxThreadEvent& event)
+{
+    wxString volumename = event.GetString();
+    bool ismounted = (event.GetInt() == 1);
+
+    VolumeMap::iterator it = m_VolumeData.find(volumename);
+    if (it == m_VolumeData.end())
+    {
+        return;
+    }
+    DBEntry *thisvol = it->second.get();
+    if (thisvol->getMountState() == ismounted)
+    {
+        // we already knew
+        return;
+    }
+    // redraws the row, see mainListCtrl::OnVolumeChanged(),
+    // and updates the idle watcher, see frmMain::OnVolumeChanged()
+    thisvol->setMountState(ismounted);
+}
+
+
+// a volume got mounted or unmounted, by us or by someone else
+// only volumes with an idle timeout matter to the idle watcher
+void frmMain::OnVolumeChanged(const wxString& volumename)
+{
+    VolumeMap::iterator it = m_VolumeData.find(volumename);
+    if (!m_idleWatcher || it == m_VolumeData.end() || !it->second || it->second->getIdleTimeout() <= 0)
+    {
+        return;
+    }
+    m_idleWatcher->SetWatchedVolumes(m_VolumeData);
+}
+
+
+// posted by the idle watcher, nobody used the volume for its idle timeout
+void frmMain::OnVolumeIdle(wxThreadEvent& event)
+{
+    if (IsCMDWaitActive())
+    {
+        // a mount or create is in progress, don't pull the rug from under it
+        // the watcher comes back after another idle period
+        return;
+    }
+    wxString volumename = event.GetString();
+    VolumeMap::iterator it = m_VolumeData.find(volumename);
+    if (it == m_VolumeData.end() || !it->second->getMountState())
+    {
+        return;
+    }
+    // quietly, if it's still busy the watcher tries again later
+    if (unmountVolume(m_VolumeData, volumename))
+    {
+        RefreshAll();
+    }
+}
+
+
 void frmMain::OnMount(wxCommandEvent& WXUNUSED(event))
 {
     wxString msg;
@@ -1215,7 +1275,7 @@ void frmMain::OnMount(wxCommandEvent& WXUNUSED(event))
     wxString encvol;
     wxString title;
     title.Printf(wxT("Enter password for '%s'"), g_selectedVolume);
-    DBEntry * thisvol = m_VolumeData[g_selectedVolume];
+    DBEntry * thisvol = m_VolumeData[g_selectedVolume].get();
     mountvol = thisvol->getMountPath();
     encvol = thisvol->getEncPath();
     bool trymount = true;
@@ -1226,7 +1286,7 @@ void frmMain::OnMount(wxCommandEvent& WXUNUSED(event))
         wxString pw;
         if (thisvol->getPwSavedState())
         {
-            pw = getKeychainPassword(g_selectedVolume);
+            pw = getSavedPassword(g_selectedVolume);
         }
         else
         {
@@ -1317,6 +1377,7 @@ void frmMain::OnRemoveFolder(wxCommandEvent& WXUNUSED(event))
         wxString configgroup;
         configgroup.Printf(wxT("/Volumes/%s"), g_selectedVolume);
         pConfig->DeleteGroup(configgroup);
+        pConfig->Flush();
         deleted = true;
     }
     dlg->Destroy();
@@ -1545,56 +1606,36 @@ void frmMain::PopulateToolbar(wxToolBarBase* toolBar)
 }
 
 
+// only touch a tool if its state actually changes
+static void setToolEnabled(wxToolBarBase *toolbar, int toolid, bool enabled)
+{
+    if (toolbar->GetToolEnabled(toolid) != enabled)
+    {
+        toolbar->EnableTool(toolid, enabled);
+    }
+}
+
 void mainListCtrl::UpdateToolBarButtons()
 {
     // keep certain buttons disabled when encfs is not found/installed
     bool encfsbininstalled = isEncFSBinInstalled();
-    m_toolBar->EnableTool(ID_Toolbar_Create, encfsbininstalled);
-    m_toolBar->EnableTool(ID_Toolbar_Existing, encfsbininstalled);
-    m_toolBar->EnableTool(ID_Toolbar_Browse, encfsbininstalled);
-    m_toolBar->EnableTool(ID_Toolbar_Remove, encfsbininstalled);
-    m_toolBar->EnableTool(ID_Toolbar_Edit, encfsbininstalled);
-    m_toolBar->EnableTool(ID_Toolbar_Info, encfsbininstalled);
-    m_toolBar->EnableTool(ID_Toolbar_Mount, encfsbininstalled);
-    m_toolBar->EnableTool(ID_Toolbar_Unmount, encfsbininstalled);
-
-    if (encfsbininstalled)
-    {
-        if (g_selectedIndex > -1)  // a line was selected
-        {
-            m_toolBar->EnableTool(ID_Toolbar_Remove, true);
-            m_toolBar->EnableTool(ID_Toolbar_Edit, true);
-            m_toolBar->EnableTool(ID_Toolbar_Browse, true);
-            m_toolBar->EnableTool(ID_Toolbar_Info, true);
-
-            // to do - add logic to check if selected volume is mounted
-            DBEntry *thisvolume = m_VolumeData[g_selectedVolume];
-            if (thisvolume->getMountState())
-            {
-                m_toolBar->EnableTool(ID_Toolbar_Mount, false);
-                m_toolBar->EnableTool(ID_Toolbar_Unmount, true);
-                m_toolBar->EnableTool(ID_Toolbar_Browse, true);   
-                m_toolBar->EnableTool(ID_Toolbar_Edit, true);   
-            }
-            else
-            {
-                m_toolBar->EnableTool(ID_Toolbar_Mount, true);
-                m_toolBar->EnableTool(ID_Toolbar_Unmount, false); 
-                m_toolBar->EnableTool(ID_Toolbar_Browse, false);
-                m_toolBar->EnableTool(ID_Toolbar_Edit, true); 
-            }    
-        }
-        else   // no selection in ListCtrl
-        {
-            m_toolBar->EnableTool(ID_Toolbar_Remove, false);
-            m_toolBar->EnableTool(ID_Toolbar_Edit, false);
-            m_toolBar->EnableTool(ID_Toolbar_Browse, false);
-            m_toolBar->EnableTool(ID_Toolbar_Mount, false);
-            m_toolBar->EnableTool(ID_Toolbar_Unmount, false);
-            m_toolBar->EnableTool(ID_Toolbar_Info, false);    
-        }    
+    bool selected = (encfsbininstalled && g_selectedIndex > -1);  // a line was selected
+    bool mounted = false;
+    if (selected)
+    {
+        DBEntry *thisvolume = m_VolumeData[g_selectedVolume].get();
+        mounted = (thisvolume && thisvolume->getMountState());
     }
 
+    // work out the final state first, so no button flips back and forth
+    setToolEnabled(m_toolBar, ID_Toolbar_Create, encfsbininstalled);
+    setToolEnabled(m_toolBar, ID_Toolbar_Existing, encfsbininstalled);
+    setToolEnabled(m_toolBar, ID_Toolbar_Remove, selected);
+    setToolEnabled(m_toolBar, ID_Toolbar_Edit, selected);   // limited edits allowed when mounted
+    setToolEnabled(m_toolBar, ID_Toolbar_Info, selected);
+    setToolEnabled(m_toolBar, ID_Toolbar_Mount, selected && !mounted);
+    setToolEnabled(m_toolBar, ID_Toolbar_Unmount, selected && mounted);
+    setToolEnabled(m_toolBar, ID_Toolbar_Browse, selected && mounted);
 }
 
 
@@ -1613,124 +1654,130 @@ void frmMain::SetToolBarButtonState(int ButtonID, bool newstate)
 
 void frmMain::DoSize()
 {
-    wxSize size = GetClientSize();
-    wxCoord y = (2*size.y);
-    m_listCtrl->SetSize(0, 0, size.x, y);
+    // search box + list, laid out by the panel sizer
+    m_panel->Layout();
 }
 
 void frmMain::RecreateList()
 {
-    {        
-        m_listCtrl->ClearAll();
-
-        FillListWithVolumes();
-
-        DoSize();
-    }   
+    FillListWithVolumes();
+    DoSize();
 }
 
 void frmMain::FillListWithVolumes()
 {
-    // global font settings
-    wxFont font = this->GetFont();
-    font.MakeSmaller();
-
     wxString columnHeader;
 
-    // create columns
-    
-    columnHeader = "Mounted";
-    m_listCtrl->AppendColumn(columnHeader);
-
-    columnHeader = "Volume name";
-    m_listCtrl->AppendColumn(columnHeader);
-
-    columnHeader = "Encrypted folder";
-    m_listCtrl->AppendColumn(columnHeader);
-
-    columnHeader = "Mounted at";
-    m_listCtrl->AppendColumn(columnHeader);
+    // create columns, once
+    if (m_listCtrl->GetColumnCount() == 0)
+    {
+        columnHeader = "Mounted";
+        m_listCtrl->AppendColumn(columnHeader);
 
-    columnHeader = "Automount";
-    m_listCtrl->AppendColumn(columnHeader);
+        columnHeader = "Volume name";
+        m_listCtrl->AppendColumn(columnHeader);
 
+        columnHeader = "Encrypted folder";
+        m_listCtrl->AppendColumn(columnHeader);
 
-    // change Column width
-    // Mounted
-    m_listCtrl->SetColumnWidth(0,65);
-    // Volume Name
-    m_listCtrl->SetColumnWidth(1,120);
-    // EncryptedFolder
-    m_listCtrl->SetColumnWidth(2,320);
-    // Mounted At
-    m_listCtrl->SetColumnWidth(3,300);
-    // Automount
-    m_listCtrl->SetColumnWidth(4,70);
+        columnHeader = "Mounted at";
+        m_listCtrl->AppendColumn(columnHeader);
 
+        columnHeader = "Automount";
+        m_listCtrl->AppendColumn(columnHeader);
 
-    
-    // to speed up inserting we hide the control temporarily
-    m_listCtrl->Hide();
+        columnHeader = "Cipher";
+        m_listCtrl->AppendColumn(columnHeader);
 
-    for (unsigned int rowindex = 0; rowindex < v_AllVolumes.size(); rowindex++)
-    {
-        wxString buf;
-        wxString volumename;
+        columnHeader = "Blocksize";
+        m_listCtrl->AppendColumn(columnHeader);
 
-        volumename = v_AllVolumes.at(rowindex);
-        DBEntry * thisvol;
-        thisvol = m_VolumeData[volumename];
+        columnHeader = "Filenames";
+        m_listCtrl->AppendColumn(columnHeader);
 
-        bool isMounted;
-        isMounted = thisvol->getMountState();
+        // change Column width
+        // Mounted
+        m_listCtrl->SetColumnWidth(0,65);
+        // Volume Name
+        m_listCtrl->SetColumnWidth(1,120);
+        // EncryptedFolder
+        m_listCtrl->SetColumnWidth(2,320);
+        // Mounted At
+        m_listCtrl->SetColumnWidth(3,300);
+        // Automount
+        m_listCtrl->SetColumnWidth(4,70);
+        // Cipher
+        m_listCtrl->SetColumnWidth(5,80);
+        // Blocksize
+        m_listCtrl->SetColumnWidth(6,70);
+        // Filenames
+        m_listCtrl->SetColumnWidth(7,70);
+    }
 
-        wxColour itemColour;
-        // column[0]
+    // the rows themselves are served by OnGetItemText()
+    // keep the selected volume selected, even if its row moved
+    long previousindex = m_listCtrl->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+    m_listCtrl->SetRows(GetFilteredVolumes());
 
-        if (isMounted)
+    int newindex = -1;
+    if (!g_selectedVolume.IsEmpty())
+    {
+        newindex = GetListCtrlIndex(g_selectedVolume);
+    }
+    if (newindex != previousindex)
+    {
+        if (previousindex > -1 && previousindex < m_listCtrl->GetItemCount())
         {
-            buf.Printf(wxT("%s"), "YES");
-            itemColour = wxColour(*wxRED);
+            m_listCtrl->SetItemState(previousindex, 0, wxLIST_STATE_SELECTED);
         }
-        else
-        {  
-            buf.Printf(wxT("%s"), "NO"); 
-            itemColour = wxColour(*wxBLUE);
+        if (newindex > -1)
+        {
+            m_listCtrl->SetItemState(newindex, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
         }
+        m_listCtrl->SetSelectedIndex(newindex);
+    }
+    m_listCtrl->Refresh();
+}
 
-        long rid = m_listCtrl->InsertItem(rowindex, buf, 0);
-        m_listCtrl->SetItemData(rid, rowindex);
-        m_listCtrl->SetItemFont(rid, font);
-        m_listCtrl->SetItemTextColour(rid, itemColour);
-
-
-        // column[1]
-        buf.Printf(wxT("%s"), volumename);
-        m_listCtrl->SetItem(rid, 1, buf);
-
-        // column[2]
-        buf.Printf(wxT("%s"), thisvol->getEncPath());
-        m_listCtrl->SetItem(rid, 2, buf);
-
-        // column[3]
-        buf.Printf(wxT("%s"), thisvol->getMountPath());
-        m_listCtrl->SetItem(rid, 3, buf);
 
-        // column[4]
-        if (thisvol->getAutoMount())
-        {
-            buf.Printf(wxT("YES"));
-        }
-        else
+// volumes matching the search box, in the same order as v_AllVolumes
+std::vector<wxString> frmMain::GetFilteredVolumes()
+{
+    if (m_filter.IsEmpty())
+    {
+        return v_AllVolumes;
+    }
+    std::vector<wxString> matches = getVolumeRegistry().Search(m_filter);
+    std::vector<wxString> filtered;
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        // the registry also knows about incomplete volumes, the list doesn't
+        if (m_VolumeData.find(matches[i]) != m_VolumeData.end())
         {
-            buf.Printf(wxT("NO"));
+            filtered.push_back(matches[i]);
         }
-        m_listCtrl->SetItem(rid, 4, buf);
     }
+    return filtered;
+}
 
-    m_listCtrl->Show();
+void frmMain::OnSearchText(wxCommandEvent& WXUNUSED(event))
+{
+    if (!m_searchCtrl || !m_listCtrl)
+    {
+        return;
+    }
+    wxString filter = m_searchCtrl->GetValue();
+    if (filter != m_filter)
+    {
+        m_filter = filter;
+        FillListWithVolumes();
+    }
 }
 
+void frmMain::OnSearchCancel(wxCommandEvent& WXUNUSED(event))
+{
+    m_searchCtrl->SetValue("");
+}
 
 void frmMain::RefreshAll()
 {
@@ -1743,89 +1790,157 @@ void frmMain::RefreshAll()
 
 
 // ----------------------------------------------------------------------------
-// CDBEntry member functions
+// mainListCtrl member functions
 // ----------------------------------------------------------------------------
 
-// DBENtry constructor
-DBEntry::DBEntry(wxString volname, 
-                 wxString enc_path, 
-                 wxString mount_path, 
-                 bool automount, 
-                 bool preventautounmount, 
-                 bool pwsaved,
-                 bool allowother,
-                 bool mountaslocal)
+
+void mainListCtrl::LinkToolbar(wxToolBarBase * toolbar)
 {
-    m_automount = automount;
-    m_volname = volname;
-    m_enc_path = enc_path;
-    m_mount_path = mount_path;
-    m_preventautounmount = preventautounmount;
-    m_pwsaved = pwsaved;
-    m_allowother = allowother;
-    m_mountaslocal = mountaslocal;
+    m_toolBar = toolbar;
 }
 
 
-void DBEntry::setMountState(bool newstate)
+wxString mainListCtrl::OnGetItemText(long item, long column) const
 {
-    m_mountstate = newstate;
-}
+    if (item < 0 || item >= (long)m_rowVolumes.size())
+    {
+        return "";
+    }
+    const wxString& volumename = m_rowVolumes[item];
+    VolumeMap::const_iterator it = m_VolumeData.find(volumename);
+    if (it == m_VolumeData.end() || !it->second)
+    {
+        return "";
+    }
+    DBEntry * thisvol = it->second.get();
 
-bool DBEntry::getMountState()
-{
-    return m_mountstate;
+    wxString buf;
+    EncFSVolumeConfig volconfig;
+    switch (column)
+    {
+        case 0:
+            if (volumename == m_busyVolume)
+            {
+                buf = ".....";
+            }
+            else
+            {
+                buf = thisvol->getMountState() ? "YES" : "NO";
+            }
+            break;
+        case 1:
+            buf = volumename;
+            break;
+        case 2:
+            buf = thisvol->getEncPath();
+            break;
+        case 3:
+            buf = thisvol->getMountPath();
+            break;
+        case 4:
+            buf = thisvol->getAutoMount() ? "YES" : "NO";
+            break;
+        // 5-7, from the cached .encfs6.xml
+        case 5:
+            if (getEncFSVolumeConfig(thisvol->getEncPath(), volconfig))
+            {
+                buf.Printf(wxT("%s-%ld"), volconfig.GetCipherName(), volconfig.keysize);
+            }
+            break;
+        case 6:
+            if (getEncFSVolumeConfig(thisvol->getEncPath(), volconfig))
+            {
+                buf.Printf(wxT("%ld"), volconfig.blocksize);
+            }
+            break;
+        case 7:
+            if (getEncFSVolumeConfig(thisvol->getEncPath(), volconfig))
+            {
+                buf = volconfig.GetNameEncodingName();
+            }
+            break;
+    }
+    return buf;
 }
 
-bool DBEntry::getPreventAutoUnmount()
+wxListItemAttr *mainListCtrl::OnGetItemAttr(long item) const
 {
-    return m_preventautounmount;
+    if (item >= 0 && item < (long)m_rowVolumes.size())
+    {
+        VolumeMap::const_iterator it = m_VolumeData.find(m_rowVolumes[item]);
+        if (it != m_VolumeData.end() && it->second && it->second->getMountState())
+        {
+            return &m_attrMounted;
+        }
+    }
+    return &m_attrUnmounted;
 }
 
-bool DBEntry::getPwSavedState()
+void mainListCtrl::SetBusyVolume(const wxString& volumename)
 {
-    return m_pwsaved;
+    wxString previous = m_busyVolume;
+    m_busyVolume = volumename;
+    RefreshVolumeRow(previous);
+    RefreshVolumeRow(volumename);
+    // make sure it shows up before a blocking mount starts
+    Update();
 }
 
-wxString DBEntry::getEncPath()
+void mainListCtrl::RefreshVolumeRow(const wxString& volumename)
 {
-    return m_enc_path;
+    // new volumes only get a row in the next FillListWithVolumes()
+    long index = GetVolumeRow(volumename);
+    if (index > -1)
+    {
+        RefreshItem(index);
+    }
 }
 
-bool DBEntry::getAutoMount()
-{
-    return m_automount;
-}
 
-wxString DBEntry::getMountPath()
+// row <-> volume index, rebuilt whenever the rows change
+// so lookups in either direction don't have to walk the list
+void mainListCtrl::SetRows(const std::vector<wxString>& volumes)
 {
-    return m_mount_path;
+    m_rowVolumes = volumes;
+    m_volumeRows.clear();
+    for (size_t i = 0; i < m_rowVolumes.size(); i++)
+    {
+        m_volumeRows[m_rowVolumes[i]] = (long)i;
+    }
+    SetItemCount(m_rowVolumes.size());
 }
 
-wxString DBEntry::getVolName()
+long mainListCtrl::GetVolumeRow(const wxString& volumename) const
 {
-    return m_volname;
+    std::unordered_map<wxString, long, wxStringHash, wxStringEqual>::const_iterator it = m_volumeRows.find(volumename);
+    if (it == m_volumeRows.end())
+    {
+        return -1;
+    }
+    return it->second;
 }
 
-bool DBEntry::getAllowOther()
+wxString mainListCtrl::GetRowVolume(long row) const
 {
-    return m_allowother;
+    if (row < 0 || row >= (long)m_rowVolumes.size())
+    {
+        return "";
+    }
+    return m_rowVolumes[row];
 }
 
-bool DBEntry::getMountAsLocal()
+// one volume changed, redraw its row only
+// selection and scroll position stay as they are
+void mainListCtrl::OnVolumeChanged(const wxString& volumename)
 {
-    return m_mountaslocal;
-}
+    RefreshVolumeRow(volumename);
 
-
-// ----------------------------------------------------------------------------
-// mainListCtrl member functions
-// ----------------------------------------------------------------------------
-
-
-void mainListCtrl::LinkToolbar(wxToolBarBase * toolbar)
-{
-    m_toolBar = toolbar;
+    // the toolbar only depends on the selected row
+    long selectedindex = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+    if (m_toolBar && selectedindex > -1 && GetRowVolume(selectedindex) == volumename)
+    {
+        UpdateToolBarButtons();
+    }
 }
 
 
@@ -1836,9 +1951,9 @@ void mainListCtrl::SetSelectedIndex(int index)
     nr_vols = v_AllVolumes.size();
     wxString selvol;
 
-    if (index >= 0)
+    if (index >= 0 && index < (long)m_rowVolumes.size())
     {
-        g_selectedVolume = GetItemText(index,1);
+        g_selectedVolume = m_rowVolumes[index];
         selvol.Printf(wxT("// Selected volume: %s"),g_selectedVolume);
     }
     else
@@ -1904,7 +2019,7 @@ void mainListCtrl::OnRightClick(wxListEvent& event)
     wxMenu *menu = new wxMenu();
     if (g_selectedIndex > -1)
     {
-        DBEntry * thisvol = m_VolumeData[g_selectedVolume];
+        DBEntry * thisvol = m_VolumeData[g_selectedVolume].get();
         bool isMounted = thisvol->getMountState();
         wxString msg;
         if (isMounted)
@@ -1960,7 +2075,7 @@ void mainListCtrl::OnItemActivated(wxListEvent& WXUNUSED(event))
     if (g_selectedIndex > -1)
     {
         // if volume was mounted, browse the folder
-        DBEntry * thisvol = m_VolumeData[g_selectedVolume];
+        DBEntry * thisvol = m_VolumeData[g_selectedVolume].get();
         if (thisvol->getMountState())
         {
             // open
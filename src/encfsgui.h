@@ -18,9 +18,26 @@
 
 #include <wx/listctrl.h>
 
+#include <wx/srchctrl.h>
+
+#include <wx/spinctrl.h>
+
 #include <wx/taskbar.h>
 
+#include <wx/hashmap.h>
+
+#include <wx/thread.h>
+
+#include <wx/timer.h>
+
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <sys/types.h>
 
 
 
@@ -30,32 +47,72 @@
 // ----------------------------------------------------------------------------
 
 
+// VolumeListener - gets told when a single volume changed
+// (mount state or settings), so only that volume needs to be redrawn
+
+class VolumeListener
+{
+public:
+    virtual ~VolumeListener() {}
+    virtual void OnVolumeChanged(const wxString& volumename) = 0;
+    virtual void OnVolumeListChanged() {}     // volumes added, removed or renamed
+};
+
+
 // TaskBar Icon
 
+// one volume in the tray menu, menu id ID_Taskbar_Volumes + 2*index (+1 = unmount)
+struct TrayMenuVolume
+{
+    wxString volname;
+    wxMenuItem *mountitem;
+    wxMenuItem *unmountitem;
+};
 
-class TaskBarIcon : public wxTaskBarIcon
+class TaskBarIcon : public wxTaskBarIcon, public VolumeListener
 {
 public:
     //ctor
     TaskBarIcon(wxTaskBarIconType iconType);
+    ~TaskBarIcon();
 
     void OnMenuExit(wxCommandEvent& event);
     void OnMenuShow(wxCommandEvent& event);
     void OnMenuHide(wxCommandEvent& event);
     void OnMenuSettings(wxCommandEvent& event);
     void OnMenuUpdate(wxCommandEvent& event);
+    void OnMenuQuickMount(wxCommandEvent& event);
     void OnOtherMenuClick(wxCommandEvent& event);
+    virtual void OnVolumeChanged(const wxString&);
+    virtual void OnVolumeListChanged();
+#if wxCHECK_VERSION(3, 1, 5)
+    // menu is kept around and updated in place
+    virtual wxMenu *GetPopupMenu() wxOVERRIDE;
+#else
+    // wx deletes the menu after showing it
     virtual wxMenu *CreatePopupMenu() wxOVERRIDE;
+#endif
     wxDECLARE_EVENT_TABLE();
 
 private:
-     wxMenu *m_taskBarMenu;
-     wxMenu *m_taskBarVolumesMenu;
+    wxMenu *BuildPopupMenu();
+    void RunVolumeAction(const wxString&, bool, wxCommandEvent&);
+    void AppendVolumeItems(wxMenu*, const wxString&);
+    void UpdateVolumeItems(const TrayMenuVolume&);
+    void UpdateVisibleItems();
+
+    wxMenu *m_taskBarMenu;                          // cached menu, NULL if not cached
+    bool m_menuDirty;
+    long m_menuPageSize;                            // page size the menu was built with
+    std::vector<TrayMenuVolume> m_trayVolumes;      // dense, indexed by menu id
+    std::map<wxString, size_t> m_trayVolumeIndex;   // volume name -> m_trayVolumes index
 };
 
 
 // DBEntry - Class for volume entry from DB
 
+class VolumeRecord;
+
 class DBEntry
 {
 public:
@@ -67,7 +124,8 @@ public:
             bool preventautounmount, 
             bool pwsaved,
             bool allowother,
-            bool mountaslocal);
+            bool mountaslocal,
+            long idletimeout);
 
     void setMountState(bool);
     bool getMountState();
@@ -79,6 +137,13 @@ public:
     bool getPreventAutoUnmount();
     bool getAllowOther();
     bool getMountAsLocal();
+    long getIdleTimeout();
+    bool Update(const VolumeRecord&);   // in place, true if anything changed
+
+    // counted, so we can tell if a refresh allocated anything
+    static void* operator new(size_t);
+    static void operator delete(void*);
+    static unsigned long GetAllocationCount();
 
 private:
     bool m_mountstate;
@@ -87,15 +152,418 @@ private:
     bool m_pwsaved;
     bool m_allowother;
     bool m_mountaslocal;
+    long m_idletimeout;
     wxString m_volname;
     wxString m_enc_path;
     wxString m_mount_path;
 };
 
+// volume name -> entry, owns the entries
+typedef std::map<wxString, std::unique_ptr<DBEntry> > VolumeMap;
+
+
+// VolumeRecord - settings of one volume, as stored in the config
+
+class VolumeRecord
+{
+public:
+    // ctor
+    VolumeRecord();
+
+    bool IsComplete() const;    // has both an encrypted and a mount path
+
+    wxString volname;
+    wxString enc_path;
+    wxString mount_path;
+    bool automount;
+    bool preventautounmount;
+    bool passwordsaved;
+    bool allowother;
+    bool mountaslocal;
+    long idletimeout;           // minutes without access before unmounting, 0 = never
+};
+
+
+// VolumeRegistry - in-memory copy of all /Volumes config groups,
+// only reloaded when the config file changed
+
+class VolumeRegistry
+{
+public:
+    // ctor
+    VolumeRegistry();
+
+    bool Refresh();                                 // true if reloaded
+    void Invalidate();
+    bool HasConfigFileChanged();
+    const std::vector<VolumeRecord>& GetVolumes() const;   // config order
+    const VolumeRecord* Find(const wxString&) const;
+    bool Exists(const wxString&) const;
+    void AddListener(VolumeListener*);
+    void RemoveListener(VolumeListener*);
+    void NotifyVolumeChanged(const wxString&);
+    void NotifyVolumeListChanged();
+    std::vector<wxString> Search(const wxString&) const;    // names matching all words, config order
+
+private:
+    void Load();
+    void BuildSearchIndex();
+    void RememberConfigFile();
+
+    std::vector<VolumeRecord> m_volumes;
+    std::map<wxString, size_t> m_index;     // volume name -> m_volumes index
+    std::vector<VolumeListener*> m_listeners;
+    std::vector<wxString> m_searchtext;     // lowercase name/paths, per m_volumes index
+    std::unordered_map<wxString, std::vector<size_t>, wxStringHash, wxStringEqual> m_trigrams;   // trigram -> m_volumes indexes, ascending
+    bool m_loaded;
+    wxString m_configfile;
+    bool m_filefound;
+    dev_t m_dev;
+    ino_t m_ino;
+    time_t m_mtime;
+    off_t m_size;
+};
+
+
+// MountEntry - one record from the system mount table
+
+struct MountEntry
+{
+    wxString source;
+    wxString mountpoint;
+    wxString fstype;
+    wxString options;
+
+    bool isEncFS() const;
+};
+
+// mount table, keyed by exact mount path
+typedef std::unordered_map<wxString, MountEntry, wxStringHash, wxStringEqual> MountTable;
+
+
+// UnmountResult - outcome of one volume in a batch unmount
+
+struct UnmountResult
+{
+    wxString volumename;
+    wxString mountpath;
+    bool unmounted;
+    int nrtries;
+    wxString error;     // umount output of the last failed attempt
+};
+
+
+// return codes related with mount success
+
+enum
+{
+    ID_MNT_OK,
+    ID_MNT_PWDFAIL,
+    ID_MNT_OTHER
+};
+
+
+// AutoMountJob - one volume to auto-mount, see autoMountVolumes()
+
+struct AutoMountJob
+{
+    wxString volumename;
+    wxString encvol;
+    wxString mountvol;
+    bool allowother;
+    bool mountaslocal;
+    long idleminutes;           // for encfs --idle, 0 = off
+    wxString encfsbin;          // resolved on the GUI thread, workers can't read the config
+    wxString pw;
+    int nrtries;
+    int mountstatus;
+};
+
+// asks for the password of a job, empty string = skip this volume
+// nrtries > 1 means the previous password was wrong
+typedef std::function<wxString(const AutoMountJob&)> PasswordPrompt;
+
+
+// MountSnapshot - indexed copy of the mount table at one point in time
+// capture it once per refresh and pass it around by const reference
+
+class MountSnapshot
+{
+public:
+    // ctor
+    MountSnapshot();
+
+    void Capture();         // native, falls back to running the mount binary
+    bool CaptureNative();   // native only, safe to use from a background thread
+    void CaptureFrom(MountTable&);  // index a table that was read elsewhere
+
+    const MountEntry * FindMount(const wxString&) const;
+    bool IsEncFSMounted(const wxString&) const;
+    const std::vector<wxString> & GetMountPointsByType(const wxString&) const;
+
+    static wxString NormalizePath(const wxString&);
+
+private:
+    void BuildIndex(MountTable&);
+
+    MountTable m_byPath;    // keyed by normalized mount path
+    std::unordered_map<wxString, std::vector<wxString>, wxStringHash, wxStringEqual> m_byType;
+};
+
+
+// MountWatcherThread - waits for mount table changes
+// and posts mount state transitions of our volumes to the GUI thread
+// (or hands them to a callback, on the watcher thread, if there is no GUI)
+
+typedef std::function<void(const wxString&, bool)> MountStateCallback;
+
+class MountWatcherThread : public wxThread
+{
+public:
+    // ctor
+    MountWatcherThread(wxEvtHandler *handler, int eventid);
+    MountWatcherThread(const MountStateCallback& callback);
+    // dtor
+    virtual ~MountWatcherThread();
+
+    void SetWatchedVolumes(std::map<wxString, wxString>&, std::map<wxString, bool>&);
+    void RequestStop();
+
+protected:
+    virtual ExitCode Entry() wxOVERRIDE;
+
+private:
+    void CheckMountStates();
+
+    wxEvtHandler *m_handler;
+    int m_eventid;
+    MountStateCallback m_callback;
+    int m_wakeupPipe[2];
+    wxCriticalSection m_watchedCS;
+    std::map<wxString, wxString> m_watchedPaths;   // volume name -> mount path
+    std::map<wxString, bool> m_knownStates;        // volume name -> last known state
+};
+
+
+// IdleWatcherThread - unmounts volumes nobody used for their idle timeout,
+// when encfs can't do it by itself (no --idle)
+// mount points are watched with inotify, deadlines live in a timer wheel,
+// so idle volumes cost nothing until their slot comes around
+
+typedef std::function<void(const wxString&)> VolumeIdleCallback;
+
+class IdleWatcherThread : public wxThread
+{
+public:
+    // ctor
+    IdleWatcherThread(wxEvtHandler *handler, int eventid);
+    IdleWatcherThread(const VolumeIdleCallback& callback);
+    // dtor
+    virtual ~IdleWatcherThread();
+
+    void SetWatchedVolumes(const VolumeMap&);
+    void RequestStop();
+
+protected:
+    virtual ExitCode Entry() wxOVERRIDE;
+
+private:
+    struct IdleVolume
+    {
+        wxString mountpath;
+        long timeoutticks;
+        long lastaccess;    // tick of the last access
+        long due;           // tick the volume is scheduled for
+        int wd;             // inotify watch on the mount point
+        std::set<int> subwatches;   // on subfolders, added as they get used
+    };
+
+    struct IdleWatch
+    {
+        wxString volumename;
+        wxString path;
+    };
+
+    void ApplyWatchedVolumes();
+    void AddSubWatch(const wxString&, IdleVolume&, const wxString&);
+    void RemoveWatches(IdleVolume&);
+    void Schedule(const wxString&, IdleVolume&, long);
+    void Tick();
+    void ReadAccessEvents();
+    void VolumeIdle(const wxString&);
+
+    wxEvtHandler *m_handler;
+    int m_eventid;
+    VolumeIdleCallback m_callback;
+    int m_wakeupPipe[2];
+    bool m_stop;
+
+    wxCriticalSection m_watchedCS;                  // protects the 2 below
+    std::map<wxString, std::pair<wxString, long> > m_watched;  // volume name -> mount path, timeout in minutes
+    bool m_watchedChanged;
+
+    // watcher thread only
+    int m_inotifyfd;
+    long m_tick;
+    std::map<wxString, IdleVolume> m_volumes;
+    std::map<int, IdleWatch> m_watches;             // inotify watch -> volume, folder
+    std::vector<std::vector<wxString> > m_wheel;    // volume names, per slot
+};
+
+
+// CmdResult - outcome of an external command
+
+class CmdResult
+{
+public:
+    // ctor
+    CmdResult();
+
+    bool Succeeded() const;
+    wxString GetOutput() const;     // stdout + stderr
+
+    int exitcode;           // -1 if the command did not exit normally
+    wxString out;
+    wxString err;
+    bool timedout;
+    bool cancelled;
+    bool spawnfailed;
+    bool settled;           // outcome decided early, command may still run
+    wxString settledline;   // output line that made CmdRequest::online settle
+    bool filefound;         // CmdRequest::waitforfile showed up
+    bool prompttimedout;    // a dialogue prompt didn't show up in time
+    size_t stepsdone;       // dialogue steps answered
+    long durationms;
+};
+
+typedef std::function<void(const CmdResult&)> CmdCallback;
+// gets each output line, on the worker thread; return true once the outcome is known
+typedef std::function<bool(const wxString&, bool)> CmdLineCallback;
+
+
+// PtyStep - wait for a prompt, then answer it (followed by a newline)
+
+class PtyStep
+{
+public:
+    // ctor
+    PtyStep(const wxString& prompttext, const wxString& responsetext, bool isoptional = false);
+
+    wxString prompt;
+    wxString response;
+    bool optional;          // may not show up at all, if the next prompt comes first
+};
+
+
+// CmdRequest - external command to run, argv[0] is looked up in PATH
+
+class CmdRequest
+{
+public:
+    // ctor
+    CmdRequest();
+
+    wxArrayString argv;
+    wxString stdindata;     // written to stdin, stdin gets closed afterwards
+    long timeoutms;         // 0 = no timeout
+    CmdCallback oncomplete; // optional, called on the GUI thread
+    CmdLineCallback online; // optional, lets WaitCMD() return early
+    wxString waitforfile;   // optional, WaitCMD() returns as soon as this file is written
+    wxString waitforfileend;    // optional, on OSX waitforfile counts as written once it ends with this
+    std::vector<PtyStep> dialogue;  // optional, runs the command on a pty and answers these prompts in order
+    long prompttimeoutms;   // max wait per prompt, 0 = no timeout
+    bool stopafterdialogue; // stop the command once all prompts were answered
+};
+
+class CmdState;
+typedef std::shared_ptr<CmdState> CmdHandle;
+
+
+// EncFSCaps - what the installed encfs binary supports
+// cached in the config, keyed on a fingerprint of the binary
+
+class EncFSCaps
+{
+public:
+    // ctor
+    EncFSCaps();
+
+    bool IsValid() const;
+    wxArrayString GetCiphers() const;                   // in encfs menu order
+    wxArrayString GetKeySizes(const wxString&) const;   // for a cipher, in bits
+    wxArrayString GetBlockSizes(const wxString&) const; // for a cipher, in bytes
+
+    wxString fingerprint;                               // path, size, mtime & version of encfs
+    std::map<wxString, wxString> filenameencodings;     // name -> encfs menu number
+    std::map<wxString, wxString> ciphers;               // name -> encfs menu number
+    std::map<wxString, wxString> keysizes;              // cipher -> "min:max:step"
+    std::map<wxString, wxString> blocksizes;            // cipher -> "min:max:step"
+    bool idle;                                          // encfs knows --idle
+};
+
+
+// EncFSVolumeConfig - crypto settings of a volume, from its .encfs6.xml
+
+class EncFSVolumeConfig
+{
+public:
+    // ctor
+    EncFSVolumeConfig();
+
+    bool IsValid() const;
+    wxString GetCipherName() const;         // "AES"
+    wxString GetNameEncodingName() const;   // "Block"
+    wxArrayString GetInfoLines() const;     // similar to encfsctl output
+
+    bool valid;
+    long subversion;
+    wxString creator;
+    wxString cipheralg;                     // "ssl/aes"
+    long ciphermajor;
+    long cipherminor;
+    wxString namealg;                       // "nameio/block"
+    long namemajor;
+    long nameminor;
+    long keysize;                           // bits
+    long blocksize;                         // bytes
+    bool uniqueiv;
+    bool chainednameiv;
+    bool externalivchaining;
+    bool allowholes;
+    long blockmacbytes;
+    long blockmacrandbytes;
+    long saltlen;                           // bytes
+    long kdfiterations;
+    long desiredkdfduration;                // ms
+};
+
+
+// SecretStore - where saved volume passwords are kept
+// (macOS keychain, Secret Service, or a local file), see encfsgui_secrets.cpp
+
+class SecretStore
+{
+public:
+    virtual ~SecretStore() {}
+
+    virtual wxString GetName() const = 0;
+    virtual bool Get(const wxString& volumename, wxString& secret) = 0;
+    virtual bool Set(const wxString& volumename, const wxString& secret) = 0;
+    virtual bool Remove(const wxString& volumename) = 0;
+    // several at once, in as few lookups as the backend allows
+    virtual void GetMany(const wxArrayString& volumenames, std::map<wxString, wxString>& secrets);
+    // Get() doesn't read the config, so it can run on a worker thread
+    virtual bool IsThreadSafe() const { return true; }
+};
+
+// saved password lookup prepared on the main thread, to finish on a worker
+// returns an empty string if there is no saved password
+typedef std::function<wxString()> SavedPasswordLookup;
+
 
 // mainListCtrl - Class for the list control inside the main window
 
-class mainListCtrl: public wxListCtrl
+class mainListCtrl: public wxListCtrl, public VolumeListener
 {
 public:
     // ctor
@@ -105,6 +573,7 @@ public:
                  const wxSize& size, 
                  long style, 
                  wxStatusBar * statusbar);
+    ~mainListCtrl();
     // event handlers
     //void OnMouseEvent(wxMouseEvent& event);
     void OnItemSelected(wxListEvent& event);
@@ -115,11 +584,27 @@ public:
     void SetSelectedIndex(int);
     void LinkToolbar(wxToolBarBase*);
     void UpdateToolBarButtons();
+    void SetBusyVolume(const wxString&);    // shows "....." instead of the mount state
+    void RefreshVolumeRow(const wxString&);
+    void SetRows(const std::vector<wxString>&);  // volumes to show, in row order
+    long GetVolumeRow(const wxString&) const;   // -1 if not shown
+    wxString GetRowVolume(long) const;          // "" if out of range
+    virtual void OnVolumeChanged(const wxString&);
+
+protected:
+    // virtual list, rows come from v_AllVolumes/m_VolumeData
+    virtual wxString OnGetItemText(long item, long column) const;
+    virtual wxListItemAttr *OnGetItemAttr(long item) const;
 
 private:
     wxDECLARE_EVENT_TABLE();
     wxToolBarBase *m_toolBar;
     wxStatusBar *m_statusBar;
+    wxString m_busyVolume;
+    mutable wxListItemAttr m_attrMounted;
+    mutable wxListItemAttr m_attrUnmounted;
+    std::vector<wxString> m_rowVolumes;     // row -> volume name
+    std::unordered_map<wxString, long, wxStringHash, wxStringEqual> m_volumeRows;   // volume name -> row
 };
 
 
@@ -133,7 +618,7 @@ public:
 };
 
 // Define a new frame type: this is going to be our main frame
-class frmMain : public wxFrame
+class frmMain : public wxFrame, public VolumeListener
 {
 public:
     // ctor(s)
@@ -157,12 +642,18 @@ public:
     void OnForceUnMountAll(wxCommandEvent& event);
     void OnInfo(wxCommandEvent& event);
     void OnRemoveFolder(wxCommandEvent& event);
+    void OnMountStateChanged(wxThreadEvent& event);
+    void OnSearchText(wxCommandEvent& event);
+    void OnSearchCancel(wxCommandEvent& event);
+    void OnMetricsTimer(wxTimerEvent& event);
+    void OnVolumeIdle(wxThreadEvent& event);
+
+    // VolumeListener, keeps the idle watcher in sync with our own mounts
+    virtual void OnVolumeChanged(const wxString& volumename);
 
     // generic routine
     bool unmountVolumeAsk(wxString& volumename);   // ask for confirmation
-    // function that does actual unmount is not a member function
-
-    int mountFolder(wxString& volumename, wxString& pw);
+    // the actual mount and unmount live in encfsgui_core.cpp
 
     // override default OnExit handler (so we can run code when user clicks close button on frame)
     virtual int OnExit(wxCommandEvent& event);
@@ -208,9 +699,21 @@ private:
     void RecreateList();
     // fill the control with items
     void FillListWithVolumes();
+    std::vector<wxString> GetFilteredVolumes();
     
     // ListView stuff
     mainListCtrl *m_listCtrl;
+    wxSearchCtrl *m_searchCtrl;
+    wxString m_filter;                  // current search box text
+
+    // keeps mount states up to date when volumes get (un)mounted outside of the app
+    MountWatcherThread *m_mountWatcher;
+
+    // unmounts volumes after their idle timeout, if encfs can't
+    IdleWatcherThread *m_idleWatcher;
+
+    // writes the metrics files, see encfsgui_metrics.cpp
+    wxTimer m_metricsTimer;
 
     wxDECLARE_EVENT_TABLE();
 
@@ -251,6 +754,7 @@ private:
     wxCheckBox * m_chkbx_save_password;
     wxCheckBox * m_chkbx_allow_other;
     wxCheckBox * m_chkbx_mount_as_local;    
+    wxSpinCtrl * m_spin_idle_timeout;
     wxCheckBox * m_chkbx_perfile_iv;
     wxCheckBox * m_chkbx_iv_chaining;
     wxCheckBox * m_chkbx_filename_to_iv_header_chaining;
@@ -259,11 +763,13 @@ private:
     wxComboBox * m_combo_cipher_keysize;
     wxComboBox * m_combo_cipher_blocksize;
     wxComboBox * m_combo_filename_enc;
-    std::map<wxString, wxString> m_encodingcaps;
+    EncFSCaps m_caps;
     //wxComboBox * m_combo_keyderivation;
     wxDECLARE_EVENT_TABLE();
     void SetEncfsOptionsState(bool);
-    bool createEncFSFolder();
+    void SetCipherSelection(wxCommandEvent &event);
+    void UpdateCipherSizes();
+    bool createEncFSFolder(wxString&);
 };
 
 
@@ -294,6 +800,7 @@ private:
     wxCheckBox * m_chkbx_save_password;
     wxCheckBox * m_chkbx_allow_other;
     wxCheckBox * m_chkbx_mount_as_local;    
+    wxSpinCtrl * m_spin_idle_timeout;
     wxDECLARE_EVENT_TABLE();
 };
 
@@ -311,7 +818,7 @@ public:
                  const wxSize& size, 
                  long style,
                  wxString selectedvolume,
-                 std::map<wxString, DBEntry*> volumedata);
+                 const VolumeMap& volumedata);
     void Create();
     void ChooseDestinationFolder(wxCommandEvent &event);
     void SaveSettings(wxCommandEvent &event);
@@ -327,8 +834,8 @@ private:
     wxCheckBox * m_chkbx_save_password;
     wxCheckBox * m_chkbx_allow_other;
     wxCheckBox * m_chkbx_mount_as_local;
+    wxSpinCtrl * m_spin_idle_timeout;
     wxButton * m_selectdst_button;
-    std::map<wxString, DBEntry*> m_editVolumeData;
     bool m_mounted;
     bool m_pwsaved;
     wxDECLARE_EVENT_TABLE();
@@ -345,7 +852,40 @@ void createNewEncFSFolder(wxWindow *);
 void openExistingEncFSFolder(wxWindow *);
 
 // encfsgui_edit.cpp
-void editExistingEncFSFolder(wxWindow *, wxString&, std::map<wxString, DBEntry*>);
+void editExistingEncFSFolder(wxWindow *, wxString&, const VolumeMap&);
+
+// encfsgui_quickmount.cpp
+wxString selectQuickMountVolume(wxWindow *, const VolumeMap&);
+
+// encfsgui_core.cpp
+bool syncVolumeData(VolumeMap&, std::vector<wxString>&, const std::vector<VolumeRecord>&);
+void loadVolumes(VolumeMap&, std::vector<wxString>&);
+int mountEncFSVolume(const wxString&, const wxString&, const wxString&, const wxString&, bool, bool, long, const wxString&, long);
+int mountVolume(VolumeMap&, const wxString&, const wxString&);
+void runAutoMountJobs(std::vector<AutoMountJob>&, long, long);
+wxArrayString autoMountVolumes(VolumeMap&, const PasswordPrompt&);
+bool unmountVolume(VolumeMap&, const wxString&);
+std::vector<UnmountResult> unmountVolumesBatch(const wxString&, const std::map<wxString, wxString>&, long, long);
+std::vector<UnmountResult> AutoUnmountVolumes(VolumeMap&, bool);
+wxString getUnmountSummary(const std::vector<UnmountResult>&);
+
+// encfsgui_cli.cpp
+bool isCLICommand(int, char **);
+int runCLI(int, char **);
+
+// encfsgui_daemon.cpp
+int runDaemon();
+wxString getDaemonSocketPath();
+bool daemonMountVolume(const wxString&, const wxString&, const wxString&, int&);
+bool daemonUnmountVolume(const wxString&, const wxString&, bool&);
+bool isDaemonRunning();
+
+// encfsgui_metrics.cpp
+void recordMountMetrics(const wxString&, int, bool, long);
+void recordUnmountMetrics(const wxString&, bool, bool, long);
+void recordCommandMetrics(const wxString&, const CmdResult&);
+void recordRefreshMetrics();
+void writeMetrics(const VolumeMap&);
 
 // encfsgui_helpers.cpp
 bool isEncFSBinInstalled();
@@ -361,19 +901,57 @@ wxString StrRunCMDSync(wxString&);
 wxArrayString ArrRunCMDSync(wxString&);
 wxArrayString ArrRunCMDASync(wxString&);
 wxString arrStrTowxStr(wxArrayString&);
+wxString toJSONString(const wxString&);
 
-bool IsVolumeSystemMounted(wxString, wxArrayString);
 void BrowseFolder(wxString&);
-wxString getKeychainPassword(wxString&);
 bool doesVolumeExist(wxString&);
 wxArrayString getEncFSVolumeInfo(wxString&);
-std::map<wxString, wxString> getEncodingCapabilities();
-wxString getExpectScriptContents(bool);
-wxString getChangePasswordScriptContents(wxString&);
+std::vector<PtyStep> getCreateVolumeDialogue(const wxString&, const wxString&, const wxString&, const wxString&,
+                                             bool, bool, bool, bool, const wxString&, bool);
+bool changeEncFSPassword(const wxString&, const wxString&, const wxString&);
 wxString getLaunchAgentContents();
 wxString getLatestVersion();
 bool IsLatestVersionNewer(const wxString&, wxString&);
 
+// encfsgui_mount.cpp
+bool readNativeMountTable(MountTable&);
+void parseMountOutput(wxArrayString&, MountTable&);
+bool IsMountPoint(const wxString&);
+bool IsFuseMountPoint(const wxString&);
+bool WaitForMount(const wxString&, long);
+
+// encfsgui_caps.cpp
+void StartEncFSCapsProbe();
+EncFSCaps getEncFSCaps();
+bool encfsSupportsIdle();
+
+// encfsgui_idle.cpp
+long getEncFSIdleMinutes(DBEntry *);
+
+// encfsgui_volinfo.cpp
+bool getEncFSVolumeConfig(const wxString&, EncFSVolumeConfig&);
+
+// encfsgui_registry.cpp
+VolumeRegistry& getVolumeRegistry();
+
+// encfsgui_secrets.cpp
+wxString getSavedPassword(const wxString&);
+SavedPasswordLookup getSavedPasswordLookup(const wxString&);
+void prefetchSavedPasswords(const wxArrayString&);
+bool savePassword(const wxString&, const wxString&);
+bool removeSavedPassword(const wxString&);
+void clearSavedPasswordCache();
+
+// encfsgui_exec.cpp
+CmdHandle RunCMDAsync(const CmdRequest&);
+CmdResult WaitCMD(CmdHandle&);
+CmdResult RunCMDWait(const CmdRequest&);
+void RunWorkerWait(const std::function<void()>&);
+void CancelCMD(CmdHandle&);
+bool IsCMDDone(CmdHandle&);
+bool IsCMDWaitActive();
+wxArrayString CMDOutputToArray(const wxString&);
+
 //encfsgui_settings.cpp
 void openSettings(wxWindow *);
 
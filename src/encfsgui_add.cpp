@@ -20,6 +20,7 @@
 #include <wx/file.h>
 #include <wx/time.h>
 #include <wx/stdpaths.h>
+#include <wx/spinctrl.h>
 #include <vector>
 #include <map>
 
@@ -35,6 +36,7 @@ enum
     ID_BTN_CHOOSE_SOURCE,
     ID_BTN_CHOOSE_DESTINATION,
     ID_RADIO_PROFILE,
+    ID_COMBO_CIPHER,
     ID_ENCFSPROFILE_BALANCED,
     ID_ENCFSPROFILE_PERFORMANCE,
     ID_ENCFSPROFILE_SECURE,
@@ -52,6 +54,7 @@ wxBEGIN_EVENT_TABLE(frmAddDialog, wxDialog)
     EVT_BUTTON(ID_BTN_CHOOSE_DESTINATION,  frmAddDialog::ChooseDestinationFolder)
     EVT_BUTTON(wxID_APPLY, frmAddDialog::SaveSettings)
     EVT_RADIOBOX(ID_RADIO_PROFILE, frmAddDialog::SetEncFSProfileSelection)
+    EVT_COMBOBOX(ID_COMBO_CIPHER, frmAddDialog::SetCipherSelection)
 wxEND_EVENT_TABLE()
 
 // ----------------------------------------------------------------------------
@@ -78,7 +81,8 @@ frmAddDialog::frmAddDialog(wxWindow *parent,
                            long style) :  wxDialog(parent, wxID_ANY, title, pos, size, style)
 {
     // get capabilities for this system
-    m_encodingcaps = getEncodingCapabilities();
+    // normally already discovered in the background at startup
+    m_caps = getEncFSCaps();
 }
 
 // event functions
@@ -108,9 +112,44 @@ void frmAddDialog::SetEncFSProfileSelection(wxCommandEvent& event)
     ApplyEncFSProfileSelection(selectedProfile);
 }
 
+void frmAddDialog::SetCipherSelection(wxCommandEvent& WXUNUSED(event))
+{
+    UpdateCipherSizes();
+}
+
 
 // member functions
 
+// only select values the combobox actually offers
+static void selectComboValue(wxComboBox * combo, const wxString& value)
+{
+    if (combo->FindString(value) != wxNOT_FOUND)
+    {
+        combo->SetValue(value);
+    }
+}
+
+
+// key & block sizes depend on the selected cipher
+// keep the current selection if the new cipher supports it
+void frmAddDialog::UpdateCipherSizes()
+{
+    wxString selectedalgo = m_combo_cipher_algo->GetValue();
+    wxString keysize = m_combo_cipher_keysize->GetValue();
+    wxString blocksize = m_combo_cipher_blocksize->GetValue();
+
+    wxArrayString arrKeySizes = m_caps.GetKeySizes(selectedalgo);
+    m_combo_cipher_keysize->Set(arrKeySizes);
+    m_combo_cipher_keysize->SetValue(arrKeySizes[0]);
+    selectComboValue(m_combo_cipher_keysize, keysize);
+
+    wxArrayString arrBlockSizes = m_caps.GetBlockSizes(selectedalgo);
+    m_combo_cipher_blocksize->Set(arrBlockSizes);
+    m_combo_cipher_blocksize->SetValue(arrBlockSizes[0]);
+    selectComboValue(m_combo_cipher_blocksize, blocksize);
+}
+
+
 void frmAddDialog::SetEncfsOptionsState(bool enabledstate)
 {
     if (!enabledstate)
@@ -146,15 +185,16 @@ void frmAddDialog::ApplyEncFSProfileSelection(int SelectedProfile)
 {
     if (SelectedProfile == ID_ENCFSPROFILE_BALANCED)
     {
-        m_combo_cipher_algo->SetValue("AES");
-        m_combo_cipher_blocksize->SetValue("2048");
-        m_combo_cipher_keysize->SetValue("192");
+        selectComboValue(m_combo_cipher_algo, "AES");
+        UpdateCipherSizes();
+        selectComboValue(m_combo_cipher_blocksize, "2048");
+        selectComboValue(m_combo_cipher_keysize, "192");
         m_combo_filename_enc->SetValue("Null");
-        if (m_encodingcaps.count("Stream") > 0)
+        if (m_caps.filenameencodings.count("Stream") > 0)
         {
             m_combo_filename_enc->SetValue("Stream");
         }
-        else if (m_encodingcaps.count("Block") > 0)
+        else if (m_caps.filenameencodings.count("Block") > 0)
         {
             m_combo_filename_enc->SetValue("Block");
         }
@@ -167,16 +207,17 @@ void frmAddDialog::ApplyEncFSProfileSelection(int SelectedProfile)
     }
     else if (SelectedProfile == ID_ENCFSPROFILE_SECURE)
     {
-        m_combo_cipher_algo->SetValue("AES");
-        m_combo_cipher_blocksize->SetValue("4096");
-        m_combo_cipher_keysize->SetValue("256");
+        selectComboValue(m_combo_cipher_algo, "AES");
+        UpdateCipherSizes();
+        selectComboValue(m_combo_cipher_blocksize, "4096");
+        selectComboValue(m_combo_cipher_keysize, "256");
         m_combo_filename_enc->SetValue("Null");
         // block preferred, as length of filename == multiple of cipher block size
-        if (m_encodingcaps.count("Block") > 0)
+        if (m_caps.filenameencodings.count("Block") > 0)
         {
             m_combo_filename_enc->SetValue("Block");
         }
-        else if (m_encodingcaps.count("Stream") > 0)
+        else if (m_caps.filenameencodings.count("Stream") > 0)
         {
             m_combo_filename_enc->SetValue("Stream");
         }
@@ -188,9 +229,10 @@ void frmAddDialog::ApplyEncFSProfileSelection(int SelectedProfile)
     }
     else if (SelectedProfile == ID_ENCFSPROFILE_PERFORMANCE)
     {
-        m_combo_cipher_algo->SetValue("AES");
-        m_combo_cipher_blocksize->SetValue("1024");
-        m_combo_cipher_keysize->SetValue("192");
+        selectComboValue(m_combo_cipher_algo, "AES");
+        UpdateCipherSizes();
+        selectComboValue(m_combo_cipher_blocksize, "1024");
+        selectComboValue(m_combo_cipher_keysize, "192");
         m_combo_filename_enc->SetValue("Null");
         //m_combo_keyderivation->SetValue("500");
         m_chkbx_block_mac_headers->SetValue(false);
@@ -251,24 +293,13 @@ void frmAddDialog::Create()
 
     wxSizer * const sizerEncFS_row1 = new wxBoxSizer(wxHORIZONTAL);
 
-    // Cipher
-    wxArrayString arrAlgos;
-    arrAlgos.Add("AES");
-    //arrAlgos.Add("Blowfish");  // forget it
-    wxArrayString arrKeySizes;
-    arrKeySizes.Add("128");
-    arrKeySizes.Add("192");
-    arrKeySizes.Add("256");
-    wxArrayString arrBlockSizes;
-    for (int blocksize = 64; blocksize <= 4096; blocksize += 16)
-    {
-        wxString thissize;
-        thissize.Printf(wxT("%d"), blocksize);
-        arrBlockSizes.Add(thissize);
-    }
+    // Cipher, as offered by the installed encfs
+    wxArrayString arrAlgos = m_caps.GetCiphers();
+    wxArrayString arrKeySizes = m_caps.GetKeySizes(arrAlgos[0]);
+    wxArrayString arrBlockSizes = m_caps.GetBlockSizes(arrAlgos[0]);
     wxArrayString arrFilenameEnc;
 
-    for (std::map<wxString, wxString>::iterator it= m_encodingcaps.begin(); it != m_encodingcaps.end(); it++)
+    for (std::map<wxString, wxString>::iterator it= m_caps.filenameencodings.begin(); it != m_caps.filenameencodings.end(); it++)
     {
         wxString encodingname = it->first;
         arrFilenameEnc.Add(encodingname);
@@ -276,7 +307,7 @@ void frmAddDialog::Create()
 
     // row 1 : cipher settings
     sizerEncFS_row1->Add(new wxStaticText(this, wxID_ANY, "Cipher algorithm:"));
-    m_combo_cipher_algo = new wxComboBox(this, wxID_ANY, arrAlgos[0], wxDefaultPosition, wxDefaultSize, arrAlgos, wxCB_READONLY);
+    m_combo_cipher_algo = new wxComboBox(this, ID_COMBO_CIPHER, arrAlgos[0], wxDefaultPosition, wxDefaultSize, arrAlgos, wxCB_READONLY);
     sizerEncFS_row1->Add(m_combo_cipher_algo,wxSizerFlags().Border(wxLEFT|wxBOTTOM|wxRIGHT, 5).Expand());
     sizerEncFS_row1->Add(new wxStaticText(this, wxID_ANY, "Keysize:"));
     m_combo_cipher_keysize = new wxComboBox(this, wxID_ANY, arrKeySizes[0], wxDefaultPosition, wxDefaultSize, arrKeySizes, wxCB_READONLY);
@@ -348,6 +379,13 @@ void frmAddDialog::Create()
     m_chkbx_mount_as_local->SetValue(false);
     sizerOptions->Add(m_chkbx_mount_as_local);    
 
+    // idle timeout
+    wxSizer * const sizerIdle = new wxBoxSizer(wxHORIZONTAL);
+    sizerIdle->Add(new wxStaticText(this, wxID_ANY, "Unmount after this many minutes without access (0 = never):"));
+    m_spin_idle_timeout = new wxSpinCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(80,22), wxSP_ARROW_KEYS, 0, 1440, 0);
+    sizerIdle->Add(m_spin_idle_timeout, wxSizerFlags().Border(wxLEFT|wxRIGHT, 5));
+    sizerOptions->Add(sizerIdle, wxSizerFlags().Border(wxTOP, 5));
+
     // glue together
     sizerMaster->Add(sizerVolume, wxSizerFlags(1).Expand().Border());
     sizerMaster->Add(sizerEncFS, wxSizerFlags(1).Expand().Border());
@@ -405,29 +443,21 @@ void frmAddDialog::ChooseDestinationFolder(wxCommandEvent& WXUNUSED(event))
 
 
 
-bool frmAddDialog::createEncFSFolder()
+bool frmAddDialog::createEncFSFolder(wxString& errormsg)
 {
     bool createdok = false;
     wxString encfsbin = getEncFSBinPath();
-    wxString cmd;
-    wxString scriptcontents;
-    wxString newline;
-    wxString args;
     wxString enc_path = m_source_field->GetValue();
     wxString pw = m_pass1->GetValue();
     wxString mount_path = m_destination_field->GetValue();
     wxString volumename = m_volumename_field->GetValue();
-    wxStandardPathsBase& stdp = wxStandardPaths::Get();
-    wxString tmpdir = stdp.GetTempDir();
-    wxString scriptfile;
-    scriptfile.Printf(wxT("%screateencfs.exp"), tmpdir );
 
     wxString algochoice="1";
     wxString filenameencodingchoice="1";
     wxString selectedalgo = m_combo_cipher_algo->GetValue();
-    if ( selectedalgo == "AES")
+    if (m_caps.ciphers.count(selectedalgo) > 0)
     {
-        algochoice = "1";
+        algochoice = m_caps.ciphers[selectedalgo];
     }
     else if (selectedalgo == "Blowfish")
     {
@@ -435,106 +465,56 @@ bool frmAddDialog::createEncFSFolder()
     }
 
     wxString selectedfilenameencoding = m_combo_filename_enc->GetValue();
-    filenameencodingchoice = m_encodingcaps[selectedfilenameencoding];
-    scriptcontents = getExpectScriptContents(false);
-    // replace keywords with actual values
-    scriptcontents.Replace("$ENCFSBIN", encfsbin);
-    scriptcontents.Replace("$ENCPATH", enc_path);
-    scriptcontents.Replace("$MOUNTPATH", mount_path);
-    scriptcontents.Replace("$CIPHERALGO", algochoice);
-    scriptcontents.Replace("$CIPHERKEYSIZE", m_combo_cipher_keysize->GetValue());
-    scriptcontents.Replace("$BLOCKSIZE", m_combo_cipher_blocksize->GetValue());
-    scriptcontents.Replace("$ENCODINGALGO", filenameencodingchoice);
-
+    filenameencodingchoice = m_caps.filenameencodings[selectedfilenameencoding];
+
+    wxString configfilepath;
+    configfilepath.Printf(wxT("%s/.encfs6.xml"), enc_path);
+
+    // drive encfs over a pty, answering its prompts one by one
+    // and continue as soon as encfs has written the config file,
+    // or exits without writing it
+    CmdRequest request;
+    request.argv.Add(encfsbin);
+    request.argv.Add("-v");
+    request.argv.Add(enc_path);
+    request.argv.Add(mount_path);
+    request.dialogue = getCreateVolumeDialogue(algochoice,
+                                               m_combo_cipher_keysize->GetValue(),
+                                               m_combo_cipher_blocksize->GetValue(),
+                                               filenameencodingchoice,
+                                               m_chkbx_iv_chaining->GetValue(),
+                                               m_chkbx_perfile_iv->GetValue(),
+                                               m_chkbx_filename_to_iv_header_chaining->GetValue(),
+                                               m_chkbx_block_mac_headers->GetValue(),
+                                               pw,
+                                               false);
+    request.waitforfile = configfilepath;
+    request.waitforfileend = "</boost_serialization>";
+    request.prompttimeoutms = 10000;
+    request.timeoutms = 60000;
+    CmdResult result = RunCMDWait(request);
+    pw = "";
 
-    if (m_chkbx_iv_chaining->GetValue())
+    if (result.filefound)
     {
-        scriptcontents.Replace("$IVCHAINING","");
+        createdok = true;
     }
-    else
-    {  
-        scriptcontents.Replace("$IVCHAINING","n");
-    }
-
-    if (m_chkbx_perfile_iv->GetValue())
+    else if (result.spawnfailed)
     {
-        scriptcontents.Replace("$PERFILEIV","");
+        errormsg.Printf(wxT("Unable to run '%s'"), encfsbin);
     }
-    else
+    else if (result.prompttimedout)
     {
-        scriptcontents.Replace("$PERFILEIV","n");
+        errormsg.Printf(wxT("encfs stopped responding after %d answer(s)\n\n%s"), (int)result.stepsdone, result.GetOutput());
     }
-
-    if (m_chkbx_filename_to_iv_header_chaining->GetValue())
+    else if (result.timedout)
     {
-        scriptcontents.Replace("$FILETOIVHEADERCHAINING","y");
+        errormsg.Printf(wxT("Timed out while waiting for encfs to create '%s'"), configfilepath);
     }
     else
     {
-        scriptcontents.Replace("$FILETOIVHEADERCHAINING","");   // n is default here
+        errormsg.Printf(wxT("encfs did not create '%s' (exit code %d)\n\n%s"), configfilepath, result.exitcode, result.GetOutput());
     }
-    
-    if (m_chkbx_block_mac_headers->GetValue())
-    {
-        scriptcontents.Replace("$BLOCKAUTHCODEHEADERS","y");
-    }
-    else
-    {
-        scriptcontents.Replace("$BLOCKAUTHCODEHEADERS",""); // n is default here
-    }
-
-    //scriptcontents.Replace("sleep x","sleep 2");
-    scriptcontents.Replace("sleep x","expect eof");
-
-    // write script to disk
-    wxTempFile * tmpfile = new wxTempFile();
-    tmpfile->Open(scriptfile);
-    if (tmpfile->IsOpened())
-    {
-        tmpfile->Write(scriptcontents);
-    }
-    tmpfile->Commit();
-
-    //cmd.Printf(wxT("sh -c \"'expect' '%s' '%s'\""), scriptfile, pw);
-    cmd.Printf(wxT("expect '%s' '%s'"), scriptfile, pw);
-    // run command asynchronously
-    wxArrayString arroutput = ArrRunCMDASync(cmd);
-    pw = "";
-    // wait for max 20 seconds, or until config file exists
-    bool configfilefound = false;
-    int nrruns = 0;
-    while (!configfilefound)
-    {
-        wxString configfilepath;
-        configfilepath.Printf(wxT("%s/.encfs6.xml"), enc_path);
-        wxFileName configfile;
-        configfile = wxFileName::wxFileName(configfilepath);
-
-        if (configfile.FileExists())
-        {
-            configfilefound = true;
-            createdok = true;
-        }
-        else 
-        {
-            // file does not exist
-            if (nrruns > 20)
-            {
-                configfilefound = true;
-                createdok = false;
-            }            
-        }
-        wxSleep(1);
-        ++nrruns;
-    }
-
-    // clean
-    tmpfile->Open(scriptfile);
-    if (tmpfile->IsOpened())
-    {
-        tmpfile->Write("#cleaned");
-    }
-    tmpfile->Commit();
 
     return createdok;
 }
@@ -658,7 +638,8 @@ void frmAddDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
         changeowner.Printf(wxT("chmod 700 '%s'"), dstfolder);
         outp = StrRunCMDSync(changeowner);
         // create the new volume
-        bool createdok = createEncFSFolder();
+        wxString createerror;
+        bool createdok = createEncFSFolder(createerror);
         if (createdok)
         {
             // next, save new volume
@@ -673,25 +654,22 @@ void frmAddDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
             pConfig->Write(wxT("passwordsaved"), m_chkbx_save_password->GetValue());
             pConfig->Write(wxT("allowother"),m_chkbx_allow_other->GetValue());
             pConfig->Write(wxT("mountaslocal"),m_chkbx_mount_as_local->GetValue());            
+            pConfig->Write(wxT("idletimeout"), (long)m_spin_idle_timeout->GetValue());
             pConfig->Flush();
             // save password in KeyChain, if needed
             if (m_chkbx_save_password->GetValue())
             {
-                wxString cmd;
-                wxString pwaddoutput;
-                wxString pw;
-                pw = m_pass1->GetValue();
-                cmd.Printf(wxT("sh -c \"security add-generic-password -U -a 'EncFSGUI_%s' -s 'EncFSGUI_%s' -w '%s' login.keychain\""), newvolumename, newvolumename, pw);
-                pw = "";
-                pwaddoutput = StrRunCMDSync(cmd);
+                savePassword(newvolumename, m_pass1->GetValue());
             }   
             Close(true);
         }
         else
         {
             wxString emsg;
-            emsg.Printf(wxT("Unable to create encfs folder"));
-            wxMessageDialog * dlg = new wxMessageDialog(this, emsg, emsg, wxOK|wxCENTRE|wxICON_ERROR);
+            wxString etitle;
+            etitle.Printf(wxT("Unable to create encfs folder"));
+            emsg.Printf(wxT("Unable to create encfs folder\n\n%s"), createerror);
+            wxMessageDialog * dlg = new wxMessageDialog(this, emsg, etitle, wxOK|wxCENTRE|wxICON_ERROR);
             dlg->ShowModal();
             dlg->Destroy();
         }
@@ -874,14 +852,12 @@ void frmOpenDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
         pConfig->Write(wxT("passwordsaved"), m_chkbx_save_password->GetValue());
         pConfig->Write(wxT("allowother"),m_chkbx_allow_other->GetValue());
         pConfig->Write(wxT("mountaslocal"),m_chkbx_mount_as_local->GetValue());        
+        pConfig->Write(wxT("idletimeout"), (long)m_spin_idle_timeout->GetValue());
         pConfig->Flush();
         // save password in KeyChain, if needed
         if (m_chkbx_save_password->GetValue())
         {
-            wxString cmd;
-            wxString pwaddoutput;
-            cmd.Printf(wxT("sh -c \"security add-generic-password -U -a 'EncFSGUI_%s' -s 'EncFSGUI_%s' -w '%s' login.keychain\""), newvolumename, newvolumename, m_pass1->GetValue());
-            pwaddoutput = StrRunCMDSync(cmd);
+            savePassword(newvolumename, m_pass1->GetValue());
         }   
         Close(true);
     }
@@ -958,6 +934,13 @@ void frmOpenDialog::Create()
     m_chkbx_mount_as_local->SetValue(false);
     sizerOptions->Add(m_chkbx_mount_as_local);    
 
+    // idle timeout
+    wxSizer * const sizerIdle = new wxBoxSizer(wxHORIZONTAL);
+    sizerIdle->Add(new wxStaticText(this, wxID_ANY, "Unmount after this many minutes without access (0 = never):"));
+    m_spin_idle_timeout = new wxSpinCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(80,22), wxSP_ARROW_KEYS, 0, 1440, 0);
+    sizerIdle->Add(m_spin_idle_timeout, wxSizerFlags().Border(wxLEFT|wxRIGHT, 5));
+    sizerOptions->Add(sizerIdle, wxSizerFlags().Border(wxTOP, 5));
+
     // glue together
     sizerMaster->Add(sizerVolume, wxSizerFlags(1).Expand().Border());
     sizerMaster->Add(sizerPassword, wxSizerFlags(1).Expand().Border());
@@ -0,0 +1,564 @@
+/*
+    encFSGui - encfsgui_caps.cpp
+    source file contains code to discover what the installed
+    encfs binary supports (ciphers, key/block sizes, filename encodings, --idle)
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/config.h>
+#include <wx/thread.h>
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
+#include <wx/tokenzr.h>
+#include <map>
+
+#include <sys/stat.h>
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// globals
+// ----------------------------------------------------------------------------
+
+// result of the startup probe, shared with the GUI thread
+static wxMutex g_capsMutex;
+static wxCondition g_capsCondition(g_capsMutex);
+static bool g_capsProbeRunning = false;
+static bool g_capsReady = false;
+static wxString g_capsBinPath;
+static EncFSCaps g_caps;
+
+
+// ----------------------------------------------------------------------------
+// EncFSCaps member functions
+// ----------------------------------------------------------------------------
+
+EncFSCaps::EncFSCaps()
+{
+    idle = false;
+}
+
+bool EncFSCaps::IsValid() const
+{
+    return (!fingerprint.IsEmpty() && filenameencodings.size() > 0 && ciphers.size() > 0);
+}
+
+
+// expand "min:max:step" into a list of sizes
+static wxArrayString expandSizeRange(const wxString& range, const wxString& fallback)
+{
+    wxArrayString sizes;
+    long minsize = 0;
+    long maxsize = 0;
+    long stepsize = 0;
+    wxStringTokenizer tokenizer(range, ":");
+    if (!tokenizer.GetNextToken().ToLong(&minsize) ||
+        !tokenizer.GetNextToken().ToLong(&maxsize) ||
+        !tokenizer.GetNextToken().ToLong(&stepsize) ||
+        minsize <= 0 || maxsize < minsize || stepsize <= 0)
+    {
+        if (range != fallback)
+        {
+            return expandSizeRange(fallback, fallback);
+        }
+        return sizes;
+    }
+
+    for (long thissize = minsize; thissize <= maxsize; thissize += stepsize)
+    {
+        wxString sizestr;
+        sizestr.Printf(wxT("%ld"), thissize);
+        sizes.Add(sizestr);
+    }
+    return sizes;
+}
+
+
+// ciphers in encfs menu order, AES if nothing was discovered
+wxArrayString EncFSCaps::GetCiphers() const
+{
+    std::map<long, wxString> ordered;
+    for (std::map<wxString, wxString>::const_iterator it = ciphers.begin(); it != ciphers.end(); it++)
+    {
+        long menunr = 0;
+        it->second.ToLong(&menunr);
+        ordered[menunr] = it->first;
+    }
+
+    wxArrayString names;
+    for (std::map<long, wxString>::iterator it = ordered.begin(); it != ordered.end(); it++)
+    {
+        names.Add(it->second);
+    }
+    if (names.GetCount() == 0)
+    {
+        names.Add("AES");
+    }
+    return names;
+}
+
+wxArrayString EncFSCaps::GetKeySizes(const wxString& cipher) const
+{
+    wxString fallback = "128:256:64";
+    std::map<wxString, wxString>::const_iterator it = keysizes.find(cipher);
+    if (it == keysizes.end())
+    {
+        return expandSizeRange(fallback, fallback);
+    }
+    return expandSizeRange(it->second, fallback);
+}
+
+wxArrayString EncFSCaps::GetBlockSizes(const wxString& cipher) const
+{
+    wxString fallback = "64:4096:16";
+    std::map<wxString, wxString>::const_iterator it = blocksizes.find(cipher);
+    if (it == blocksizes.end())
+    {
+        return expandSizeRange(fallback, fallback);
+    }
+    return expandSizeRange(it->second, fallback);
+}
+
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+// path, size, mtime and --version output of the encfs binary
+// any change means the cached capabilities may be stale
+static wxString getEncFSBinFingerprint(const wxString& encfsbin)
+{
+    wxString fingerprint = "";
+    struct stat st;
+    if (stat(encfsbin.utf8_str(), &st) != 0)
+    {
+        return fingerprint;
+    }
+
+    CmdRequest request;
+    request.argv.Add(encfsbin);
+    request.argv.Add("--version");
+    request.timeoutms = 15000;
+    CmdResult result = RunCMDWait(request);
+    wxString version = result.GetOutput();
+    version.Trim();
+
+    fingerprint.Printf(wxT("%s|%lld|%lld|%s"), encfsbin, (long long)st.st_size, (long long)st.st_mtime, version);
+    return fingerprint;
+}
+
+
+// parse the first number after marker, and an optional "to <number>"
+static bool scanSizeRange(const wxString& line, const wxString& marker, long& from, long& to)
+{
+    int pos = line.Find(marker);
+    if (pos == wxNOT_FOUND)
+    {
+        return false;
+    }
+    wxStringTokenizer tokenizer(line.Mid(pos + marker.Length()), " .");
+    if (!tokenizer.GetNextToken().ToLong(&from))
+    {
+        return false;
+    }
+    to = from;
+    if (tokenizer.GetNextToken() == "to")
+    {
+        if (!tokenizer.GetNextToken().ToLong(&to))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// "1. AES : 16 byte block cipher" -> "1" and "AES"
+static bool scanMenuEntry(const wxString& line, wxString& menunr, wxString& name)
+{
+    wxStringTokenizer tokenizer(line.Strip(wxString::both), " ");
+    wxString nrtoken = tokenizer.GetNextToken();
+    if (!nrtoken.EndsWith("."))
+    {
+        return false;
+    }
+    nrtoken.RemoveLast();
+    long dummy;
+    if (!nrtoken.ToLong(&dummy))
+    {
+        return false;
+    }
+    menunr = nrtoken;
+    name = tokenizer.GetNextToken();
+    return !name.IsEmpty();
+}
+
+
+// parse the encfs creation dialogue, up to the filename encoding prompt
+// probedcipher is the cipher that was selected during the dialogue,
+// encfs only shows the key and block size increments for that one
+static void parseEncFSCaps(const wxArrayString& arroutput, const wxString& probedcipher, EncFSCaps& caps)
+{
+    enum { SECTION_NONE, SECTION_CIPHERS, SECTION_ENCODINGS } section = SECTION_NONE;
+    std::map<wxString, long> keymin, keymax, blockmin, blockmax;
+    long keystep = 64;
+    long blockstep = 16;
+    wxString currentcipher = "";
+    wxString probedciphername = "";
+
+    for (size_t n = 0; n < arroutput.GetCount(); n++)
+    {
+        wxString thisline = arroutput[n];
+        wxString menunr;
+        wxString name;
+        long from = 0;
+        long to = 0;
+
+        if (thisline.Find("The following cipher algorithms are available") > -1)
+        {
+            section = SECTION_CIPHERS;
+        }
+        else if (thisline.Find("The following filename encoding algorithms are available") > -1)
+        {
+            section = SECTION_ENCODINGS;
+        }
+        else if (thisline.Find("Enter the number corresponding to your choice") > -1)
+        {
+            section = SECTION_NONE;
+        }
+        else if (section != SECTION_NONE && scanMenuEntry(thisline, menunr, name))
+        {
+            if (section == SECTION_CIPHERS)
+            {
+                caps.ciphers[name] = menunr;
+                currentcipher = name;
+                if (menunr == probedcipher)
+                {
+                    probedciphername = name;
+                }
+            }
+            else
+            {
+                caps.filenameencodings[name] = menunr;
+            }
+        }
+        else if (section == SECTION_CIPHERS && !currentcipher.IsEmpty())
+        {
+            if (scanSizeRange(thisline, "key lengths of ", from, to) ||
+                scanSizeRange(thisline, "key length ", from, to))
+            {
+                keymin[currentcipher] = from;
+                keymax[currentcipher] = to;
+            }
+            else if (scanSizeRange(thisline, "block sizes of ", from, to) ||
+                     scanSizeRange(thisline, "block size ", from, to))
+            {
+                blockmin[currentcipher] = from;
+                blockmax[currentcipher] = to;
+            }
+        }
+        else if (scanSizeRange(thisline, "in increments of ", from, to) && from > 0)
+        {
+            if (thisline.Find("bits in increments of ") > -1)
+            {
+                keystep = from;
+            }
+            else if (thisline.Find("bytes in increments of ") > -1)
+            {
+                blockstep = from;
+            }
+        }
+    }
+
+    for (std::map<wxString, long>::iterator it = keymin.begin(); it != keymin.end(); it++)
+    {
+        long step = (it->first == probedciphername) ? keystep : 64;
+        caps.keysizes[it->first].Printf(wxT("%ld:%ld:%ld"), it->second, keymax[it->first], step);
+    }
+    for (std::map<wxString, long>::iterator it = blockmin.begin(); it != blockmin.end(); it++)
+    {
+        long step = (it->first == probedciphername) ? blockstep : 16;
+        caps.blocksizes[it->first].Printf(wxT("%ld:%ld:%ld"), it->second, blockmax[it->first], step);
+    }
+}
+
+
+// run encfs with valid, but non-important values,
+// just to capture the lists it offers and stop before anything gets created
+static void probeEncFSCaps(const wxString& encfsbin, const wxString& tmp_dir, EncFSCaps& caps)
+{
+    wxString enc_path;
+    wxString plain_path;
+    enc_path.Printf(wxT("%s/%s"), tmp_dir, "tmp_encfsgui_crypt");
+    plain_path.Printf(wxT("%s/%s"), tmp_dir, "tmp_encfsgui_plain");
+
+    // start from empty dirs
+    if (wxFileName::DirExists(enc_path))
+    {
+        wxFileName::Rmdir(enc_path, wxPATH_RMDIR_RECURSIVE);
+    }
+    if (wxFileName::DirExists(plain_path))
+    {
+        wxFileName::Rmdir(plain_path, wxPATH_RMDIR_RECURSIVE);
+    }
+    wxFileName::Mkdir(enc_path, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    wxFileName::Mkdir(plain_path, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+    wxString probedcipher = "1";
+    CmdRequest request;
+    request.argv.Add(encfsbin);
+    request.argv.Add("-v");
+    request.argv.Add(enc_path);
+    request.argv.Add(plain_path);
+    request.dialogue = getCreateVolumeDialogue(probedcipher, "128", "1024", "1", true, true, false, false, "", true);
+    request.stopafterdialogue = true;
+    request.prompttimeoutms = 10000;
+    request.timeoutms = 30000;
+    CmdResult result = RunCMDWait(request);
+
+    parseEncFSCaps(CMDOutputToArray(result.out), probedcipher, caps);
+
+    // can encfs unmount idle volumes by itself ?
+    CmdRequest helprequest;
+    helprequest.argv.Add(encfsbin);
+    helprequest.argv.Add("--help");
+    helprequest.timeoutms = 15000;
+    CmdResult helpresult = RunCMDWait(helprequest);
+    caps.idle = (helpresult.GetOutput().Find("--idle") > -1);
+
+    // clean up again
+    if (wxFileName::DirExists(enc_path))
+    {
+        wxFileName::Rmdir(enc_path, wxPATH_RMDIR_RECURSIVE);
+    }
+    if (wxFileName::DirExists(plain_path))
+    {
+        wxFileName::Rmdir(plain_path, wxPATH_RMDIR_RECURSIVE);
+    }
+}
+
+
+// cached capabilities, only probe again when the encfs binary changed
+// returns true if encfs had to be probed
+static bool resolveEncFSCaps(const wxString& encfsbin, const wxString& tmp_dir, const EncFSCaps& cached, EncFSCaps& caps)
+{
+    wxString fingerprint = getEncFSBinFingerprint(encfsbin);
+    if (cached.IsValid() && cached.fingerprint == fingerprint)
+    {
+        caps = cached;
+        return false;
+    }
+
+    caps = EncFSCaps();
+    if (!fingerprint.IsEmpty())
+    {
+        probeEncFSCaps(encfsbin, tmp_dir, caps);
+        caps.fingerprint = fingerprint;
+    }
+    return true;
+}
+
+
+static void readCapsGroup(wxConfigBase *pConfig, const wxString& group, std::map<wxString, wxString>& values)
+{
+    pConfig->SetPath(group);
+    wxString capname;
+    long dummy;
+    bool bCont = pConfig->GetFirstEntry(capname, dummy);
+    while (bCont)
+    {
+        wxString capval = pConfig->Read(capname, "");
+        if (!capname.IsEmpty() && !capval.IsEmpty())
+        {
+            values[capname] = capval;
+        }
+        bCont = pConfig->GetNextEntry(capname, dummy);
+    }
+}
+
+static void writeCapsGroup(wxConfigBase *pConfig, const wxString& group, const std::map<wxString, wxString>& values)
+{
+    pConfig->SetPath(group);
+    for (std::map<wxString, wxString>::const_iterator it = values.begin(); it != values.end(); it++)
+    {
+        pConfig->Write(it->first, it->second);
+    }
+}
+
+
+// config access, GUI thread only
+static EncFSCaps loadCachedCaps()
+{
+    EncFSCaps caps;
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/EncFSCaps"));
+    caps.fingerprint = pConfig->Read(wxT("fingerprint"), "");
+    if (!pConfig->HasEntry(wxT("idle")))
+    {
+        // cached before --idle was probed, probe again
+        caps.fingerprint = "";
+    }
+    caps.idle = pConfig->ReadBool(wxT("idle"), false);
+    readCapsGroup(pConfig, wxT("/EncFSCaps/FilenameEncoding"), caps.filenameencodings);
+    readCapsGroup(pConfig, wxT("/EncFSCaps/Ciphers"), caps.ciphers);
+    readCapsGroup(pConfig, wxT("/EncFSCaps/KeySizes"), caps.keysizes);
+    readCapsGroup(pConfig, wxT("/EncFSCaps/BlockSizes"), caps.blocksizes);
+    return caps;
+}
+
+static void saveCachedCaps(const EncFSCaps& caps)
+{
+    if (!caps.IsValid())
+    {
+        return;
+    }
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    // replaced by /EncFSCaps
+    pConfig->DeleteGroup(wxT("/FilenameEncoding"));
+    pConfig->DeleteGroup(wxT("/EncFSCaps"));
+    pConfig->SetPath(wxT("/EncFSCaps"));
+    pConfig->Write(wxT("fingerprint"), caps.fingerprint);
+    pConfig->Write(wxT("idle"), caps.idle);
+    writeCapsGroup(pConfig, wxT("/EncFSCaps/FilenameEncoding"), caps.filenameencodings);
+    writeCapsGroup(pConfig, wxT("/EncFSCaps/Ciphers"), caps.ciphers);
+    writeCapsGroup(pConfig, wxT("/EncFSCaps/KeySizes"), caps.keysizes);
+    writeCapsGroup(pConfig, wxT("/EncFSCaps/BlockSizes"), caps.blocksizes);
+    pConfig->Flush();
+}
+
+
+// ----------------------------------------------------------------------------
+// EncFSCapsThread - checks the fingerprint and probes encfs if needed
+// ----------------------------------------------------------------------------
+
+class EncFSCapsThread : public wxThread
+{
+public:
+    EncFSCapsThread(const wxString& encfsbin, const wxString& tmp_dir, const EncFSCaps& cached)
+        : wxThread(wxTHREAD_DETACHED), m_encfsbin(encfsbin), m_tmpdir(tmp_dir), m_cached(cached)
+    {
+    }
+
+protected:
+    virtual ExitCode Entry()
+    {
+        EncFSCaps caps;
+        if (resolveEncFSCaps(m_encfsbin, m_tmpdir, m_cached, caps) && caps.IsValid() && wxTheApp)
+        {
+            wxTheApp->CallAfter([caps]() { saveCachedCaps(caps); });
+        }
+
+        wxMutexLocker lock(g_capsMutex);
+        g_caps = caps;
+        g_capsBinPath = m_encfsbin;
+        g_capsReady = true;
+        g_capsProbeRunning = false;
+        g_capsCondition.Broadcast();
+        return (ExitCode)0;
+    }
+
+private:
+    wxString m_encfsbin;
+    wxString m_tmpdir;
+    EncFSCaps m_cached;
+};
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+// kick off the capability check at startup, so the Add dialog doesn't have to wait
+void StartEncFSCapsProbe()
+{
+    if (!isEncFSBinInstalled())
+    {
+        return;
+    }
+
+    wxMutexLocker lock(g_capsMutex);
+    if (g_capsProbeRunning)
+    {
+        return;
+    }
+
+    EncFSCapsThread *capsthread = new EncFSCapsThread(getEncFSBinPath(),
+                                                      wxStandardPaths::Get().GetTempDir(),
+                                                      loadCachedCaps());
+    g_capsProbeRunning = true;
+    if (capsthread->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete capsthread;
+        g_capsProbeRunning = false;
+    }
+}
+
+
+// capabilities of the current encfs binary, GUI thread only
+// waits for the startup probe if it is still busy, or runs the check itself
+EncFSCaps getEncFSCaps()
+{
+    wxString encfsbin = getEncFSBinPath();
+    // the probe runs several encfs commands, keep handling events meanwhile
+    RunWorkerWait([]()
+    {
+        wxMutexLocker lock(g_capsMutex);
+        while (g_capsProbeRunning)
+        {
+            g_capsCondition.Wait();
+        }
+    });
+    {
+        wxMutexLocker lock(g_capsMutex);
+        if (g_capsReady && g_capsBinPath == encfsbin)
+        {
+            return g_caps;
+        }
+    }
+
+    EncFSCaps caps;
+    bool probed = resolveEncFSCaps(encfsbin, wxStandardPaths::Get().GetTempDir(), loadCachedCaps(), caps);
+    if (probed)
+    {
+        saveCachedCaps(caps);
+    }
+
+    wxMutexLocker lock(g_capsMutex);
+    g_caps = caps;
+    g_capsBinPath = encfsbin;
+    g_capsReady = true;
+    return caps;
+}
+
+
+// does encfs support --idle, GUI (main) thread only
+// doesn't wait for a running startup probe, the cached answer will do until then
+bool encfsSupportsIdle()
+{
+    wxString encfsbin = getEncFSBinPath();
+    bool probing;
+    {
+        wxMutexLocker lock(g_capsMutex);
+        if (g_capsReady && g_capsBinPath == encfsbin)
+        {
+            return g_caps.idle;
+        }
+        probing = g_capsProbeRunning;
+    }
+
+    EncFSCaps cached = loadCachedCaps();
+    if (cached.IsValid() || probing)
+    {
+        return (cached.IsValid() && cached.idle);
+    }
+    return getEncFSCaps().idle;
+}
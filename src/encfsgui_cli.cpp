@@ -0,0 +1,344 @@
+/*
+    encFSGui - encfsgui_cli.cpp
+    source file contains the command line mode
+    (--list, --mount, --unmount, --automount, --daemon)
+    runs without a GUI app object, no windows and no tray icon
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/init.h>
+#include <wx/config.h>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <termios.h>
+
+#include "encfsgui.h"
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+// exit codes
+enum
+{
+    CLI_OK = 0,
+    CLI_FAILED,     // the mount/unmount didn't work out
+    CLI_USAGE       // bad arguments or unknown volume
+};
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+static void printLine(FILE *stream, const wxString& line)
+{
+    fputs(line.utf8_str(), stream);
+    fputc('\n', stream);
+}
+
+static void printUsage()
+{
+    printLine(stderr, "usage: encfsgui --list [--json]");
+    printLine(stderr, "       encfsgui --mount NAME");
+    printLine(stderr, "       encfsgui --unmount NAME|--all");
+    printLine(stderr, "       encfsgui --automount");
+    printLine(stderr, "       encfsgui --daemon");
+    printLine(stderr, "");
+    printLine(stderr, "Passwords that are not saved are read from stdin.");
+}
+
+// one line from stdin, without echo if it's a terminal
+static wxString readPassword(const wxString& prompt)
+{
+    bool interactive = isatty(STDIN_FILENO);
+    struct termios oldattr;
+    if (interactive)
+    {
+        fputs(prompt.utf8_str(), stderr);
+        fflush(stderr);
+        tcgetattr(STDIN_FILENO, &oldattr);
+        struct termios newattr = oldattr;
+        newattr.c_lflag &= ~ECHO;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &newattr);
+    }
+
+    char buffer[1024];
+    wxString pw;
+    if (fgets(buffer, sizeof(buffer), stdin))
+    {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        pw = wxString::FromUTF8(buffer);
+    }
+    // don't leave the password behind on the stack
+    volatile char *p = buffer;
+    for (size_t i = 0; i < sizeof(buffer); i++)
+    {
+        p[i] = 0;
+    }
+
+    if (interactive)
+    {
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &oldattr);
+        fputc('\n', stderr);
+    }
+    return pw;
+}
+
+
+// ----------------------------------------------------------------------------
+// commands
+// ----------------------------------------------------------------------------
+
+static int cliList(VolumeMap& volumedata, const std::vector<wxString>& allvolumes, bool json)
+{
+    if (json)
+    {
+        wxString output = "[";
+        for (size_t i = 0; i < allvolumes.size(); i++)
+        {
+            DBEntry *thisvol = volumedata[allvolumes[i]].get();
+            output << (i > 0 ? ",\n  {" : "\n  {");
+            output << "\"name\": " << toJSONString(allvolumes[i]);
+            output << ", \"mounted\": " << (thisvol->getMountState() ? "true" : "false");
+            output << ", \"encpath\": " << toJSONString(thisvol->getEncPath());
+            output << ", \"mountpath\": " << toJSONString(thisvol->getMountPath());
+            output << ", \"automount\": " << (thisvol->getAutoMount() ? "true" : "false");
+            output << ", \"passwordsaved\": " << (thisvol->getPwSavedState() ? "true" : "false");
+            output << "}";
+        }
+        output << (allvolumes.empty() ? "]" : "\n]");
+        printLine(stdout, output);
+        return CLI_OK;
+    }
+
+    // tab separated, easy to cut
+    for (size_t i = 0; i < allvolumes.size(); i++)
+    {
+        DBEntry *thisvol = volumedata[allvolumes[i]].get();
+        wxString line;
+        line.Printf(wxT("%s\t%s\t%s\t%s"),
+                    thisvol->getMountState() ? "mounted" : "unmounted",
+                    allvolumes[i],
+                    thisvol->getEncPath(),
+                    thisvol->getMountPath());
+        printLine(stdout, line);
+    }
+    return CLI_OK;
+}
+
+static int cliMount(VolumeMap& volumedata, const wxString& volumename)
+{
+    VolumeMap::iterator it = volumedata.find(volumename);
+    if (it == volumedata.end())
+    {
+        printLine(stderr, wxString::Format(wxT("Unknown volume '%s'"), volumename));
+        return CLI_USAGE;
+    }
+    DBEntry *thisvol = it->second.get();
+    if (thisvol->getMountState())
+    {
+        printLine(stdout, wxString::Format(wxT("'%s' is already mounted at %s"), volumename, thisvol->getMountPath()));
+        return CLI_OK;
+    }
+    if (!isEncFSBinInstalled())
+    {
+        printLine(stderr, "encfs not found, check the encfs path in the settings");
+        return CLI_FAILED;
+    }
+
+    wxString pw;
+    if (thisvol->getPwSavedState())
+    {
+        pw = getSavedPassword(volumename);
+    }
+    if (pw.IsEmpty())
+    {
+        pw = readPassword(wxString::Format(wxT("Password for '%s': "), volumename));
+    }
+    if (pw.IsEmpty())
+    {
+        printLine(stderr, wxString::Format(wxT("No password for '%s'"), volumename));
+        return CLI_FAILED;
+    }
+
+    int mountstatus = mountVolume(volumedata, volumename, pw);
+    pw = "GoodLuckWithThat";
+    if (mountstatus == ID_MNT_OK)
+    {
+        printLine(stdout, wxString::Format(wxT("'%s' mounted at %s"), volumename, thisvol->getMountPath()));
+        return CLI_OK;
+    }
+    if (mountstatus == ID_MNT_PWDFAIL)
+    {
+        printLine(stderr, wxString::Format(wxT("'%s' : invalid password"), volumename));
+    }
+    else
+    {
+        printLine(stderr, wxString::Format(wxT("'%s' : unable to mount\n    Encfs folder: %s\n    Mount path: %s"),
+                                           volumename, thisvol->getEncPath(), thisvol->getMountPath()));
+    }
+    return CLI_FAILED;
+}
+
+static int cliUnmount(VolumeMap& volumedata, const wxString& volumename)
+{
+    if (volumename == "--all")
+    {
+        std::vector<UnmountResult> results = AutoUnmountVolumes(volumedata, true);
+        wxString summary = getUnmountSummary(results);
+        if (!summary.IsEmpty())
+        {
+            fputs(wxString("Unable to unmount the following volume(s):\n" + summary).utf8_str(), stderr);
+            return CLI_FAILED;
+        }
+        return CLI_OK;
+    }
+
+    VolumeMap::iterator it = volumedata.find(volumename);
+    if (it == volumedata.end())
+    {
+        printLine(stderr, wxString::Format(wxT("Unknown volume '%s'"), volumename));
+        return CLI_USAGE;
+    }
+    if (!it->second->getMountState())
+    {
+        printLine(stdout, wxString::Format(wxT("'%s' is not mounted"), volumename));
+        return CLI_OK;
+    }
+    if (!unmountVolume(volumedata, volumename))
+    {
+        printLine(stderr, wxString::Format(wxT("Unable to unmount '%s' (%s)"), volumename, it->second->getMountPath()));
+        return CLI_FAILED;
+    }
+    return CLI_OK;
+}
+
+static int cliAutoMount(VolumeMap& volumedata)
+{
+    if (!isEncFSBinInstalled())
+    {
+        printLine(stderr, "encfs not found, check the encfs path in the settings");
+        return CLI_FAILED;
+    }
+
+    // volumes without a saved password can only be asked for on a terminal,
+    // from cron or a login hook they get skipped
+    bool interactive = isatty(STDIN_FILENO);
+    wxArrayString skipped;
+    wxArrayString failedvolumes = autoMountVolumes(volumedata, [interactive, &skipped](const AutoMountJob& job)
+    {
+        wxString pw;
+        if (interactive)
+        {
+            wxString prompt;
+            if (job.nrtries > 1)
+            {
+                prompt.Printf(wxT("Invalid password, password for '%s': "), job.volumename);
+            }
+            else
+            {
+                prompt.Printf(wxT("Password for '%s': "), job.volumename);
+            }
+            pw = readPassword(prompt);
+        }
+        if (pw.IsEmpty())
+        {
+            skipped.Add(wxString::Format(wxT("'%s' : skipped, no password"), job.volumename));
+        }
+        return pw;
+    });
+
+    WX_APPEND_ARRAY(failedvolumes, skipped);
+    if (!failedvolumes.IsEmpty())
+    {
+        fputs(wxString("Unable to auto-mount the following volume(s):\n" + arrStrTowxStr(failedvolumes) + "\n").utf8_str(), stderr);
+        return CLI_FAILED;
+    }
+    return CLI_OK;
+}
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+bool isCLICommand(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+    wxString command = wxString::FromUTF8(argv[1]);
+    return (command == "--list" ||
+            command == "--mount" ||
+            command == "--unmount" ||
+            command == "--automount" ||
+            command == "--daemon");
+}
+
+// called from main(), before any GUI initialisation
+int runCLI(int argc, char **argv)
+{
+    wxString command = wxString::FromUTF8(argv[1]);
+    wxString argument;
+    if (argc > 2)
+    {
+        argument = wxString::FromUTF8(argv[2]);
+    }
+    if (argc > 3 ||
+        (command == "--list" && !argument.IsEmpty() && argument != "--json") ||
+        ((command == "--mount" || command == "--unmount") && argument.IsEmpty()) ||
+        ((command == "--automount" || command == "--daemon") && !argument.IsEmpty()))
+    {
+        printUsage();
+        return CLI_USAGE;
+    }
+
+    // a console app object is all we need, so wx never sets up the GUI
+    wxAppConsole::SetInstance(new wxAppConsole);
+    wxInitializer initializer(argc, argv);
+    if (!initializer.IsOk())
+    {
+        printLine(stderr, "Unable to initialize wxWidgets");
+        return CLI_FAILED;
+    }
+
+    // same config file as the GUI, cleaned up by wx on exit
+    wxConfigBase *pConfig = wxConfigBase::Create();
+    wxConfigBase::Set(pConfig);
+
+    if (command == "--daemon")
+    {
+        return runDaemon();
+    }
+
+    VolumeMap volumedata;
+    std::vector<wxString> allvolumes;
+    loadVolumes(volumedata, allvolumes);
+
+    if (command == "--list")
+    {
+        return cliList(volumedata, allvolumes, argument == "--json");
+    }
+    if (command == "--mount")
+    {
+        return cliMount(volumedata, argument);
+    }
+    if (command == "--unmount")
+    {
+        return cliUnmount(volumedata, argument);
+    }
+    return cliAutoMount(volumedata);
+}
@@ -0,0 +1,836 @@
+/*
+    encFSGui - encfsgui_core.cpp
+    source file contains the volume and mount engine,
+    shared by the GUI and the command line mode
+    nothing in here touches a window
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/config.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/thread.h>
+#include <wx/time.h>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// DBEntry member functions
+// ----------------------------------------------------------------------------
+
+// nr of DBEntry objects allocated since startup
+static unsigned long g_dbEntryAllocations = 0;
+
+void* DBEntry::operator new(size_t size)
+{
+    g_dbEntryAllocations++;
+    return ::operator new(size);
+}
+
+void DBEntry::operator delete(void* ptr)
+{
+    ::operator delete(ptr);
+}
+
+unsigned long DBEntry::GetAllocationCount()
+{
+    return g_dbEntryAllocations;
+}
+
+// DBENtry constructor
+DBEntry::DBEntry(wxString volname, 
+                 wxString enc_path, 
+                 wxString mount_path, 
+                 bool automount, 
+                 bool preventautounmount, 
+                 bool pwsaved,
+                 bool allowother,
+                 bool mountaslocal,
+                 long idletimeout)
+{
+    m_automount = automount;
+    m_volname = volname;
+    m_enc_path = enc_path;
+    m_mount_path = mount_path;
+    m_preventautounmount = preventautounmount;
+    m_pwsaved = pwsaved;
+    m_allowother = allowother;
+    m_mountaslocal = mountaslocal;
+    m_idletimeout = idletimeout;
+    m_mountstate = false;
+}
+
+
+void DBEntry::setMountState(bool newstate)
+{
+    if (m_mountstate == newstate)
+    {
+        return;
+    }
+    m_mountstate = newstate;
+    getVolumeRegistry().NotifyVolumeChanged(m_volname);
+}
+
+bool DBEntry::getMountState()
+{
+    return m_mountstate;
+}
+
+bool DBEntry::getPreventAutoUnmount()
+{
+    return m_preventautounmount;
+}
+
+bool DBEntry::getPwSavedState()
+{
+    return m_pwsaved;
+}
+
+wxString DBEntry::getEncPath()
+{
+    return m_enc_path;
+}
+
+bool DBEntry::getAutoMount()
+{
+    return m_automount;
+}
+
+wxString DBEntry::getMountPath()
+{
+    return m_mount_path;
+}
+
+wxString DBEntry::getVolName()
+{
+    return m_volname;
+}
+
+bool DBEntry::getAllowOther()
+{
+    return m_allowother;
+}
+
+bool DBEntry::getMountAsLocal()
+{
+    return m_mountaslocal;
+}
+
+long DBEntry::getIdleTimeout()
+{
+    return m_idletimeout;
+}
+
+// only assign what differs, so an unchanged entry costs nothing
+bool DBEntry::Update(const VolumeRecord& record)
+{
+    bool changed = false;
+    if (m_enc_path != record.enc_path)
+    {
+        m_enc_path = record.enc_path;
+        changed = true;
+    }
+    if (m_mount_path != record.mount_path)
+    {
+        m_mount_path = record.mount_path;
+        changed = true;
+    }
+    if (m_automount != record.automount ||
+        m_preventautounmount != record.preventautounmount ||
+        m_pwsaved != record.passwordsaved ||
+        m_allowother != record.allowother ||
+        m_mountaslocal != record.mountaslocal ||
+        m_idletimeout != record.idletimeout)
+    {
+        m_automount = record.automount;
+        m_preventautounmount = record.preventautounmount;
+        m_pwsaved = record.passwordsaved;
+        m_allowother = record.allowother;
+        m_mountaslocal = record.mountaslocal;
+        m_idletimeout = record.idletimeout;
+        changed = true;
+    }
+    return changed;
+}
+
+
+// ----------------------------------------------------------------------------
+// volume data
+// ----------------------------------------------------------------------------
+
+// bring the volume entries in line with the registry
+// entries are updated in place, returns true if the list of names changed
+bool syncVolumeData(VolumeMap& volumedata, std::vector<wxString>& allvolumes, const std::vector<VolumeRecord>& volumes)
+{
+    unsigned long allocationsbefore = DBEntry::GetAllocationCount();
+
+    // drop removed and incomplete volumes (and any empty slots left by lookups)
+    VolumeMap::iterator it = volumedata.begin();
+    while (it != volumedata.end())
+    {
+        const VolumeRecord* record = getVolumeRegistry().Find(it->first);
+        if (!it->second || !record || !record->IsComplete())
+        {
+            it = volumedata.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    // only rebuild the name list if it changed
+    bool nameschanged = false;
+    size_t nrcomplete = 0;
+    for (size_t i = 0; i < volumes.size(); i++)
+    {
+        if (!volumes[i].IsComplete())
+        {
+            continue;
+        }
+        if (nrcomplete >= allvolumes.size() || allvolumes[nrcomplete] != volumes[i].volname)
+        {
+            nameschanged = true;
+        }
+        nrcomplete++;
+    }
+    if (nrcomplete != allvolumes.size())
+    {
+        nameschanged = true;
+    }
+    if (nameschanged)
+    {
+        allvolumes.clear();
+    }
+
+    for (size_t i = 0; i < volumes.size(); i++)
+    {
+        const VolumeRecord& record = volumes[i];
+        if (!record.IsComplete())
+        {
+            continue;
+        }
+        if (nameschanged)
+        {
+            allvolumes.push_back(record.volname);
+        }
+
+        VolumeMap::iterator existing = volumedata.find(record.volname);
+        if (existing != volumedata.end())
+        {
+            if (existing->second->Update(record))
+            {
+                getVolumeRegistry().NotifyVolumeChanged(record.volname);
+            }
+        }
+        else
+        {
+            volumedata[record.volname].reset(new DBEntry(record.volname,
+                                                           record.enc_path,
+                                                           record.mount_path,
+                                                           record.automount,
+                                                           record.preventautounmount,
+                                                           record.passwordsaved,
+                                                           record.allowother,
+                                                           record.mountaslocal,
+                                                           record.idletimeout));
+        }
+    }
+
+    wxLogDebug(wxT("syncVolumeData: %lu volume(s), %lu new entry allocation(s)"),
+               (unsigned long)volumedata.size(),
+               DBEntry::GetAllocationCount() - allocationsbefore);
+
+    if (nameschanged)
+    {
+        getVolumeRegistry().NotifyVolumeListChanged();
+    }
+    return nameschanged;
+}
+
+
+// reload the volume settings if the config changed, and
+// refresh all mount states from one mount table snapshot
+void loadVolumes(VolumeMap& volumedata, std::vector<wxString>& allvolumes)
+{
+    MountSnapshot snapshot;
+    snapshot.Capture();
+
+    // volume settings only need to be synced if the config changed
+    VolumeRegistry& registry = getVolumeRegistry();
+    if (registry.Refresh())
+    {
+        syncVolumeData(volumedata, allvolumes, registry.GetVolumes());
+    }
+    recordRefreshMetrics();
+
+    for (VolumeMap::iterator it = volumedata.begin(); it != volumedata.end(); it++)
+    {
+        it->second->setMountState(snapshot.IsEncFSMounted(it->second->getMountPath()));
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// mount engine
+// ----------------------------------------------------------------------------
+
+// unmount a set of volumes (volume name -> mount path) at once
+// all umount commands run concurrently, then everything is verified against
+// one mount table snapshot, and the ones still mounted are tried again
+// doesn't read the config (the caller looks up umountbin), so it can run on a worker thread
+std::vector<UnmountResult> unmountVolumesBatch(const wxString& umountbin,
+                                               const std::map<wxString, wxString>& volumes,
+                                               long timeoutms,
+                                               long retries)
+{
+    std::vector<UnmountResult> results;
+    std::vector<size_t> todo;
+    for (std::map<wxString, wxString>::const_iterator it = volumes.begin(); it != volumes.end(); it++)
+    {
+        UnmountResult result;
+        result.volumename = it->first;
+        result.mountpath = it->second;
+        result.unmounted = false;
+        result.nrtries = 0;
+        todo.push_back(results.size());
+        results.push_back(result);
+    }
+
+    wxLongLong starttime = wxGetLocalTimeMillis();
+    std::vector<bool> timedout(results.size(), false);
+    MountSnapshot snapshot;
+    for (long attempt = 0; attempt <= retries && !todo.empty(); attempt++)
+    {
+        if (attempt > 0)
+        {
+            // give whoever keeps the volume busy a moment to let go
+            wxMilliSleep(250);
+        }
+
+        std::vector<CmdHandle> handles;
+        for (size_t i = 0; i < todo.size(); i++)
+        {
+            CmdRequest request;
+            request.argv.Add(umountbin);
+            request.argv.Add(results[todo[i]].mountpath);
+            // umount can hang on a busy or stale fuse mount
+            request.timeoutms = timeoutms;
+            handles.push_back(RunCMDAsync(request));
+            results[todo[i]].nrtries++;
+        }
+        for (size_t i = 0; i < handles.size(); i++)
+        {
+            CmdResult cmdresult = WaitCMD(handles[i]);
+            timedout[todo[i]] = cmdresult.timedout;
+            if (cmdresult.timedout)
+            {
+                results[todo[i]].error = "umount timed out";
+            }
+            else
+            {
+                results[todo[i]].error = cmdresult.GetOutput().Trim();
+            }
+        }
+
+        snapshot.Capture();
+        std::vector<size_t> stragglers;
+        for (size_t i = 0; i < todo.size(); i++)
+        {
+            UnmountResult & result = results[todo[i]];
+            if (snapshot.IsEncFSMounted(result.mountpath))
+            {
+                stragglers.push_back(todo[i]);
+            }
+            else
+            {
+                result.unmounted = true;
+                result.error.Clear();
+                recordUnmountMetrics(result.volumename, true, false, (wxGetLocalTimeMillis() - starttime).ToLong());
+            }
+        }
+        todo = stragglers;
+    }
+    for (size_t i = 0; i < todo.size(); i++)
+    {
+        recordUnmountMetrics(results[todo[i]].volumename, false, timedout[todo[i]], 0);
+    }
+    return results;
+}
+
+
+// human readable list of the volumes that failed to unmount
+// returns an empty string if all went well
+wxString getUnmountSummary(const std::vector<UnmountResult>& results)
+{
+    wxString summary;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const UnmountResult & result = results[i];
+        if (!result.unmounted)
+        {
+            wxString line;
+            line.Printf(wxT("'%s' (%s), %d attempt(s)"), result.volumename, result.mountpath, result.nrtries);
+            if (!result.error.IsEmpty())
+            {
+                line << "\n    " << result.error;
+            }
+            summary << line << "\n";
+        }
+    }
+    return summary;
+}
+
+
+// check one line of encfs output for a known failure
+// returns the mount result, or -1 if the line doesn't tell us anything
+int getEncFSMountOutcome(const wxString& line)
+{
+    if (line.Find("Error decoding volume key, password incorrect") > -1)
+    {
+        return ID_MNT_PWDFAIL;
+    }
+    // config file missing or unreadable
+    if (line.Find("Unable to load or parse config file") > -1 ||
+        line.Find("Unable to initialize encrypted filesystem") > -1)
+    {
+        return ID_MNT_OTHER;
+    }
+    // fuse refuses to mount (busy/non-empty mount point, missing kernel extension, ...)
+    if (line.StartsWith("fuse: ") ||
+        line.StartsWith("mount_osxfuse: ") ||
+        line.StartsWith("mount_macfuse: "))
+    {
+        return ID_MNT_OTHER;
+    }
+    return -1;
+}
+
+
+// mount an encfs volume
+// doesn't touch the GUI, the config or m_VolumeData, so it can run on a worker thread
+// (which is why the caller has to look up the encfs binary)
+int mountEncFSVolume(const wxString& encfsbin,
+                     const wxString& volumename,
+                     const wxString& encvol,
+                     const wxString& mountvol,
+                     bool allowother,
+                     bool mountaslocal,
+                     long idleminutes,
+                     const wxString& pw,
+                     long readytimeout)
+{
+    wxString cmdoutput;
+    wxLongLong starttime = wxGetLocalTimeMillis();
+
+    // first, create mount point if necessary
+    if (!wxFileName::DirExists(mountvol))
+    {
+        wxFileName::Mkdir(mountvol, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    }
+
+    // mount, exec encfs directly and hand over the password on stdin (-S)
+    // so it doesn't show up in the process list
+    CmdRequest request;
+    request.argv.Add(encfsbin);
+    request.argv.Add("-v");
+    request.argv.Add("-S");
+    if (allowother)
+    {
+        request.argv.Add("-o");
+        request.argv.Add("allow_other");
+    }
+    if (mountaslocal)
+    {
+        request.argv.Add("-o");
+        request.argv.Add("local");
+    }
+    if (idleminutes > 0)
+    {
+        // encfs unmounts by itself after this many minutes without access
+        request.argv.Add(wxString::Format(wxT("--idle=%ld"), idleminutes));
+    }
+    request.argv.Add("-o");
+    request.argv.Add("volname=" + volumename);
+    request.argv.Add(encvol);
+    request.argv.Add(mountvol);
+    request.stdindata = pw + "\n";
+    request.timeoutms = 60000;
+
+    // watch the encfs output as it arrives, and stop waiting
+    // as soon as it tells us the mount is not going to happen
+    request.online = [](const wxString& line, bool WXUNUSED(isstderr))
+    {
+        return (getEncFSMountOutcome(line) > -1);
+    };
+
+    CmdResult result = RunCMDWait(request);
+    cmdoutput = result.GetOutput();
+    int outcome = -1;
+    if (result.settled)
+    {
+        outcome = getEncFSMountOutcome(result.settledline);
+    }
+
+    //wxLogDebug(wxT("----------------------------"));
+    //wxLogDebug(cmdoutput);
+    //wxLogDebug(wxT("----------------------------"));
+    int mountstatus = ID_MNT_OTHER;
+    bool timedout = result.timedout;
+    if (outcome > -1)
+    {
+        mountstatus = outcome;
+    }
+    else if (!result.spawnfailed && result.exitcode == 0)
+    {
+        // encfs was happy, but may return before the mount is attached
+        // (no point waiting if it didn't start or gave up)
+        if (WaitForMount(mountvol, readytimeout))
+        {
+            mountstatus = ID_MNT_OK;
+        }
+        else
+        {
+            // the mount point just never showed up
+            timedout = true;
+        }
+    }
+    recordMountMetrics(volumename, mountstatus, timedout, (wxGetLocalTimeMillis() - starttime).ToLong());
+    return mountstatus;
+}
+
+
+// mount one auto-mount job, through the daemon if there is one
+static int mountAutoMountJob(AutoMountJob& job, long readytimeout, const wxString& socketpath)
+{
+    int mountstatus;
+    if (daemonMountVolume(socketpath, job.volumename, job.pw, mountstatus))
+    {
+        return mountstatus;
+    }
+    return mountEncFSVolume(job.encfsbin, job.volumename, job.encvol, job.mountvol,
+                            job.allowother, job.mountaslocal, job.idleminutes,
+                            job.pw, readytimeout);
+}
+
+
+// AutoMountWorker - takes mount jobs from a shared list until it runs dry
+
+class AutoMountWorker : public wxThread
+{
+public:
+    AutoMountWorker(std::vector<AutoMountJob>& jobs,
+                    size_t& nextjob,
+                    wxCriticalSection& jobsCS,
+                    long readytimeout,
+                    const wxString& socketpath)
+        : wxThread(wxTHREAD_JOINABLE), m_jobs(jobs), m_nextjob(nextjob), m_jobsCS(jobsCS)
+    {
+        m_readytimeout = readytimeout;
+        m_socketpath = socketpath;
+    }
+
+protected:
+    virtual ExitCode Entry() wxOVERRIDE
+    {
+        while (true)
+        {
+            size_t thisjob;
+            {
+                wxCriticalSectionLocker lock(m_jobsCS);
+                thisjob = m_nextjob++;
+            }
+            if (thisjob >= m_jobs.size())
+            {
+                break;
+            }
+            AutoMountJob & job = m_jobs[thisjob];
+            job.mountstatus = mountAutoMountJob(job, m_readytimeout, m_socketpath);
+        }
+        return (wxThread::ExitCode)0;
+    }
+
+private:
+    std::vector<AutoMountJob>& m_jobs;
+    size_t& m_nextjob;
+    wxCriticalSection& m_jobsCS;
+    long m_readytimeout;
+    wxString m_socketpath;
+};
+
+
+// mount all jobs, with at most 'concurrency' mounts running at the same time
+void runAutoMountJobs(std::vector<AutoMountJob>& jobs, long concurrency, long readytimeout)
+{
+    size_t nextjob = 0;
+    wxCriticalSection jobsCS;
+    std::vector<AutoMountWorker*> workers;
+    wxString socketpath = getDaemonSocketPath();
+
+    size_t nrworkers = (concurrency < 1) ? 1 : concurrency;
+    if (nrworkers > jobs.size())
+    {
+        nrworkers = jobs.size();
+    }
+    for (size_t i = 0; i < nrworkers; i++)
+    {
+        AutoMountWorker *worker = new AutoMountWorker(jobs, nextjob, jobsCS, readytimeout, socketpath);
+        if (worker->Run() != wxTHREAD_NO_ERROR)
+        {
+            delete worker;
+            break;
+        }
+        workers.push_back(worker);
+    }
+
+    // no threads at all ? mount them one by one then
+    if (workers.empty())
+    {
+        for (; nextjob < jobs.size(); nextjob++)
+        {
+            jobs[nextjob].mountstatus = mountAutoMountJob(jobs[nextjob], readytimeout, socketpath);
+        }
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i]->Wait();
+        delete workers[i];
+    }
+}
+
+
+// mount one volume with the given password
+int mountVolume(VolumeMap& volumedata, const wxString& volumename, const wxString& pw)
+{
+    VolumeMap::iterator it = volumedata.find(volumename);
+    if (it == volumedata.end() || !it->second)
+    {
+        return ID_MNT_OTHER;
+    }
+    DBEntry *thisvol = it->second.get();
+
+    // encfs may return before the fuse file system is attached
+    // so wait until the mount point shows up, instead of checking only once
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    long readytimeout = pConfig->Read(wxT("mountreadytimeout"), 5000l);
+
+    // a running daemon owns all mounts, hand it over instead of racing it
+    int mountstatus;
+    if (!daemonMountVolume(getDaemonSocketPath(), volumename, pw, mountstatus))
+    {
+        mountstatus = mountEncFSVolume(getEncFSBinPath(),
+                                       volumename,
+                                       thisvol->getEncPath(),
+                                       thisvol->getMountPath(),
+                                       thisvol->getAllowOther(),
+                                       thisvol->getMountAsLocal(),
+                                       getEncFSIdleMinutes(thisvol),
+                                       pw,
+                                       readytimeout);
+    }
+    if (mountstatus == ID_MNT_OK)
+    {
+        thisvol->setMountState(true);
+    }
+    return mountstatus;
+}
+
+
+// mount all unmounted automount volumes
+// passwords are collected first (saved ones in one batch, the others through 'prompt'),
+// so the mounts themselves can run unattended and in parallel
+// returns a description of each volume that could not be mounted
+wxArrayString autoMountVolumes(VolumeMap& volumedata, const PasswordPrompt& prompt)
+{
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    long readytimeout = pConfig->Read(wxT("mountreadytimeout"), 5000l);
+    long concurrency = pConfig->Read(wxT("automountconcurrency"), 4l);
+
+    // phase 1 : collect all passwords
+    wxArrayString savedpwvolumes;
+    for (VolumeMap::iterator it= volumedata.begin(); it != volumedata.end(); it++)
+    {
+        DBEntry * thisvol = it->second.get();
+        if ((not thisvol->getMountState()) && thisvol->getAutoMount() && thisvol->getPwSavedState())
+        {
+            savedpwvolumes.Add(it->first);
+        }
+    }
+    prefetchSavedPasswords(savedpwvolumes);
+    wxString encfsbin = getEncFSBinPath();
+
+    std::vector<AutoMountJob> pending;
+    for (VolumeMap::iterator it= volumedata.begin(); it != volumedata.end(); it++)
+    {
+        wxString volumename = it->first;
+        DBEntry * thisvol = it->second.get();
+        if ((not thisvol->getMountState()) && (thisvol->getAutoMount()) )
+        {
+            AutoMountJob job;
+            job.volumename = volumename;
+            job.encvol = thisvol->getEncPath();
+            job.mountvol = thisvol->getMountPath();
+            job.allowother = thisvol->getAllowOther();
+            job.mountaslocal = thisvol->getMountAsLocal();
+            job.idleminutes = getEncFSIdleMinutes(thisvol);
+            job.encfsbin = encfsbin;
+            job.nrtries = 1;
+            job.mountstatus = ID_MNT_OTHER;
+            if (thisvol->getPwSavedState())
+            {
+                job.pw = getSavedPassword(volumename);
+            }
+            else
+            {
+                job.pw = prompt(job);
+            }
+            // empty password = user cancelled, skip this one
+            if (!job.pw.IsEmpty())
+            {
+                pending.push_back(job);
+            }
+        }
+    }
+
+    // phase 2 : mount in parallel, ask again for the ones with a wrong password
+    wxArrayString failedvolumes;
+    while (!pending.empty())
+    {
+        runAutoMountJobs(pending, concurrency, readytimeout);
+
+        std::vector<AutoMountJob> retry;
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            AutoMountJob & job = pending[i];
+            // to do : instead of setting pw to a new value, clear out memory location directly 
+            job.pw = "GoodLuckWithThat";
+            if (job.mountstatus == ID_MNT_OK)
+            {
+                volumedata[job.volumename]->setMountState(true);
+            }
+            else if (job.mountstatus == ID_MNT_PWDFAIL && job.nrtries < 5)
+            {
+                job.nrtries++;
+                job.pw = prompt(job);
+                if (!job.pw.IsEmpty())
+                {
+                    retry.push_back(job);
+                }
+            }
+            else
+            {
+                wxString failedmsg;
+                if (job.mountstatus == ID_MNT_PWDFAIL)
+                {
+                    failedmsg.Printf(wxT("'%s' : invalid password"), job.volumename);
+                }
+                else
+                {
+                    failedmsg.Printf(wxT("'%s' : unable to mount\n    Encfs folder: %s\n    Mount path: %s"), job.volumename, job.encvol, job.mountvol);
+                }
+                failedvolumes.Add(failedmsg);
+            }
+        }
+        pending = retry;
+    }
+    return failedvolumes;
+}
+
+
+// unmount one volume, right away
+bool unmountVolume(VolumeMap& volumedata, const wxString& volumename)
+{
+    VolumeMap::iterator it = volumedata.find(volumename);
+    if (it == volumedata.end() || !it->second)
+    {
+        return false;
+    }
+    DBEntry *thisvol = it->second.get();
+
+    bool unmounted;
+    if (daemonUnmountVolume(getDaemonSocketPath(), volumename, unmounted))
+    {
+        if (unmounted)
+        {
+            thisvol->setMountState(false);
+        }
+        return unmounted;
+    }
+
+    std::map<wxString, wxString> volumes;
+    volumes[volumename] = thisvol->getMountPath();
+
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    long timeoutms = pConfig->Read(wxT("unmounttimeout"), 30000l);
+
+    std::vector<UnmountResult> results = unmountVolumesBatch(getUMountBinPath(), volumes, timeoutms, 0);
+    if (results[0].unmounted)
+    {
+        // it's gone - reset stuff
+        thisvol->setMountState(false);
+        return true;    // unmount success
+    }
+    return false;
+}
+
+
+// unmount everything that is mounted, except the ones that
+// don't want to be auto-unmounted (unless forced)
+std::vector<UnmountResult> AutoUnmountVolumes(VolumeMap& volumedata, bool forced)
+{
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    long timeoutms = pConfig->Read(wxT("unmounttimeout"), 30000l);
+    long retries = pConfig->Read(wxT("unmountretries"), 2l);
+
+    // find out what is really mounted right now
+    MountSnapshot snapshot;
+    snapshot.Capture();
+
+    std::map<wxString, wxString> tounmount;
+    if (!snapshot.GetMountPointsByType("encfs").empty())
+    {
+        for (VolumeMap::iterator it= volumedata.begin(); it != volumedata.end(); it++)
+        {
+            DBEntry * thisvol = it->second.get();
+            wxString mountvol = thisvol->getMountPath();
+            if (snapshot.IsEncFSMounted(mountvol) && (!thisvol->getPreventAutoUnmount() || forced)) 
+            {
+                tounmount[it->first] = mountvol;
+            }
+        }
+    }
+
+    std::vector<UnmountResult> results;
+    if (!tounmount.empty())
+    {
+        results = unmountVolumesBatch(getUMountBinPath(), tounmount, timeoutms, retries);
+    }
+
+    for (VolumeMap::iterator it= volumedata.begin(); it != volumedata.end(); it++)
+    {
+        DBEntry * thisvol = it->second.get();
+        thisvol->setMountState(snapshot.IsEncFSMounted(thisvol->getMountPath()));
+    }
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        volumedata[results[i].volumename]->setMountState(!results[i].unmounted);
+    }
+    return results;
+}
@@ -0,0 +1,1150 @@
+/*
+    encFSGui - encfsgui_daemon.cpp
+    source file contains the resident mount daemon (encfsgui --daemon)
+    and the client side of its Unix socket protocol
+
+    the daemon owns the volume list and runs every mount and unmount,
+    so the GUI, the command line and login scripts don't race each other
+
+    protocol: one request per line, fields separated by tabs
+        status                  -> volume<TAB>state<TAB>name<TAB>encpath<TAB>mountpath ... ok
+        mount<TAB>name[<TAB>pw] -> ok | error<TAB>reason<TAB>message
+                                   (pw hex encoded utf-8, empty = use the saved password)
+        unmount<TAB>name        -> ok | error<TAB>reason<TAB>message
+        subscribe               -> ok, then event<TAB>mounted|unmounted<TAB>name
+                                   and event<TAB>volumes when the list changed
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/config.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/stdpaths.h>
+#include <wx/tokenzr.h>
+#include <wx/thread.h>
+#include <wx/time.h>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "encfsgui.h"
+
+// ----------------------------------------------------------------------------
+// constants & globals
+// ----------------------------------------------------------------------------
+
+// longest request line we accept from a client
+#define DAEMON_MAX_LINE 65536
+
+// replies a client may leave unread before it gets dropped
+#define DAEMON_MAX_OUTPUT (4 * 1024 * 1024)
+
+// how long a client waits for a reply, a mount may take a while
+#define DAEMON_CLIENT_TIMEOUT 180
+
+// write end of the daemon wakeup pipe, for the signal handler
+static int g_daemonWakeupFd = -1;
+static volatile sig_atomic_t g_daemonStop = 0;
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+static bool isSocketAnswering(const struct sockaddr_un& addr)
+{
+    int probefd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probefd < 0)
+    {
+        return false;
+    }
+    bool answering = (connect(probefd, (const struct sockaddr*)&addr, sizeof(addr)) == 0);
+    close(probefd);
+    return answering;
+}
+
+static wxString toHex(const wxString& value)
+{
+    wxScopedCharBuffer utf8 = value.utf8_str();
+    wxString hexvalue;
+    for (size_t i = 0; i < utf8.length(); i++)
+    {
+        hexvalue << wxString::Format(wxT("%02x"), (unsigned char)utf8.data()[i]);
+    }
+    return hexvalue;
+}
+
+static wxString fromHex(const wxString& hexvalue)
+{
+    std::string bytes;
+    for (size_t i = 0; i + 1 < hexvalue.length(); i += 2)
+    {
+        unsigned long byte;
+        if (!hexvalue.Mid(i, 2).ToULong(&byte, 16))
+        {
+            return "";
+        }
+        bytes += (char)byte;
+    }
+    return wxString::FromUTF8(bytes.c_str(), bytes.length());
+}
+
+static void setCloseOnExec(int fd)
+{
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+// only our own user gets to talk to the daemon
+static bool isSameUser(int fd)
+{
+#if defined(SO_PEERCRED)
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+    {
+        return false;
+    }
+    return (cred.uid == geteuid());
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0)
+    {
+        return false;
+    }
+    return (uid == geteuid());
+#endif
+}
+
+static bool fillSocketAddress(const wxString& socketpath, struct sockaddr_un& addr)
+{
+    wxScopedCharBuffer path = socketpath.utf8_str();
+    if (path.length() == 0 || path.length() >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.length());
+    return true;
+}
+
+static void onDaemonSignal(int WXUNUSED(signum))
+{
+    g_daemonStop = 1;
+    if (g_daemonWakeupFd > -1)
+    {
+        char stopbyte = 'x';
+        ssize_t written = write(g_daemonWakeupFd, &stopbyte, 1);
+        (void)written;
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// Classes
+// ----------------------------------------------------------------------------
+
+class EncFSDaemon;
+
+// DaemonOp - one mount or unmount in progress
+// clients asking for the same thing while it runs just wait for it too
+
+struct DaemonOp
+{
+    wxString volumename;
+    bool mount;
+    wxString encvol;
+    wxString mountvol;
+    bool allowother;
+    bool mountaslocal;
+    long idleminutes;
+    wxString encfsbin;          // the worker threads can't read the config
+    wxString umountbin;
+    wxString pw;
+    SavedPasswordLookup pwlookup;   // runs on the worker, the keychain may take a while
+    long timeoutms;
+    int result;             // ID_MNT_*
+    wxString error;
+    std::vector<int> clients;
+    wxThread *thread;
+};
+
+class DaemonOpThread : public wxThread
+{
+public:
+    DaemonOpThread(DaemonOp *op, EncFSDaemon *daemon) : wxThread(wxTHREAD_JOINABLE)
+    {
+        m_op = op;
+        m_daemon = daemon;
+    }
+
+protected:
+    virtual ExitCode Entry() wxOVERRIDE;
+
+private:
+    DaemonOp *m_op;
+    EncFSDaemon *m_daemon;
+};
+
+
+// EncFSDaemon - owns the volumes, serves the socket
+
+class EncFSDaemon : public VolumeListener
+{
+public:
+    //ctor
+    EncFSDaemon();
+    ~EncFSDaemon();
+
+    int Run(const wxString& socketpath);
+
+    // any thread
+    void OpDone(DaemonOp *op);
+    void MountStateChanged(const wxString& volumename, bool ismounted);
+    void VolumeIdle(const wxString& volumename);
+
+    virtual void OnVolumeChanged(const wxString&);
+    virtual void OnVolumeListChanged();
+
+private:
+    bool Listen(const wxString& socketpath);
+    void Wakeup();
+    void Accept();
+    bool ReadClient(int fd);
+    void CloseClient(int fd);
+    bool SendLine(int fd, const wxString& line);
+    bool FlushClient(int fd);
+    void Broadcast(const wxString& line);
+    void HandleRequest(int fd, const wxString& line);
+    void HandleStatus(int fd);
+    void HandleOp(int fd, const wxString& volumename, bool mount, const wxString& pw);
+    void FinishOps();
+    void ApplyStateChanges();
+    void UnmountIdleVolumes();
+    void UpdateIdleWatcher();
+    void RefreshVolumes();
+
+    int m_listenfd;
+    int m_wakeupPipe[2];
+    std::map<int, std::string> m_clients;       // fd -> input not yet handled
+    std::map<int, std::string> m_output;        // fd -> replies not written yet
+    std::set<int> m_subscribers;
+    std::set<int> m_deadclients;                // closed after this poll round
+    std::map<wxString, DaemonOp*> m_ops;        // volume name -> op in progress
+    VolumeMap m_volumedata;
+    std::vector<wxString> m_allvolumes;
+    MountWatcherThread *m_mountWatcher;
+    IdleWatcherThread *m_idleWatcher;
+
+    wxCriticalSection m_queueCS;                // protects the 3 queues below
+    std::vector<DaemonOp*> m_doneOps;
+    std::vector<std::pair<wxString, bool> > m_stateChanges;
+    std::vector<wxString> m_idleVolumes;
+};
+
+
+// ----------------------------------------------------------------------------
+// DaemonOpThread member functions
+// ----------------------------------------------------------------------------
+
+wxThread::ExitCode DaemonOpThread::Entry()
+{
+    DaemonOp *op = m_op;
+    if (op->mount)
+    {
+        if (op->pw.IsEmpty() && op->pwlookup)
+        {
+            op->pw = op->pwlookup();
+            op->pwlookup = SavedPasswordLookup();
+        }
+        if (op->pw.IsEmpty())
+        {
+            op->result = ID_MNT_PWDFAIL;
+            op->error = "no password";
+        }
+        else
+        {
+            op->result = mountEncFSVolume(op->encfsbin, op->volumename, op->encvol, op->mountvol,
+                                          op->allowother, op->mountaslocal, op->idleminutes,
+                                          op->pw, op->timeoutms);
+        }
+        op->pw = "GoodLuckWithThat";
+    }
+    else
+    {
+        std::map<wxString, wxString> volumes;
+        volumes[op->volumename] = op->mountvol;
+        std::vector<UnmountResult> results = unmountVolumesBatch(op->umountbin, volumes, op->timeoutms, 0);
+        op->result = results[0].unmounted ? ID_MNT_OK : ID_MNT_OTHER;
+        op->error = results[0].error;
+    }
+    m_daemon->OpDone(op);
+    return (wxThread::ExitCode)0;
+}
+
+
+// ----------------------------------------------------------------------------
+// EncFSDaemon member functions
+// ----------------------------------------------------------------------------
+
+EncFSDaemon::EncFSDaemon()
+{
+    m_listenfd = -1;
+    m_mountWatcher = NULL;
+    m_idleWatcher = NULL;
+    if (pipe(m_wakeupPipe) == 0)
+    {
+        // never block, not even in the signal handler
+        for (int i = 0; i < 2; i++)
+        {
+            setCloseOnExec(m_wakeupPipe[i]);
+            fcntl(m_wakeupPipe[i], F_SETFL, fcntl(m_wakeupPipe[i], F_GETFL) | O_NONBLOCK);
+        }
+    }
+    else
+    {
+        m_wakeupPipe[0] = -1;
+        m_wakeupPipe[1] = -1;
+    }
+    getVolumeRegistry().AddListener(this);
+}
+
+EncFSDaemon::~EncFSDaemon()
+{
+    getVolumeRegistry().RemoveListener(this);
+    if (m_wakeupPipe[0] > -1)
+    {
+        close(m_wakeupPipe[0]);
+        close(m_wakeupPipe[1]);
+    }
+}
+
+
+bool EncFSDaemon::Listen(const wxString& socketpath)
+{
+    struct sockaddr_un addr;
+    if (!fillSocketAddress(socketpath, addr))
+    {
+        wxLogError(wxT("Invalid daemon socket path '%s'"), socketpath);
+        return false;
+    }
+
+    // someone answering on the socket ? then there's a daemon already
+    if (isSocketAnswering(addr))
+    {
+        wxLogError(wxT("An encfsgui daemon is already listening on '%s'"), socketpath);
+        return false;
+    }
+    // left behind by a daemon that didn't exit cleanly
+    unlink(addr.sun_path);
+
+    wxFileName::Mkdir(wxFileName(socketpath).GetPath(), 0700, wxPATH_MKDIR_FULL);
+
+    m_listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listenfd < 0)
+    {
+        return false;
+    }
+    setCloseOnExec(m_listenfd);
+    mode_t oldmask = umask(0077);
+    int rc = bind(m_listenfd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(oldmask);
+    if (rc != 0 || listen(m_listenfd, 16) != 0)
+    {
+        wxLogError(wxT("Unable to listen on '%s' : %s"), socketpath, wxString::FromUTF8(strerror(errno)));
+        close(m_listenfd);
+        m_listenfd = -1;
+        return false;
+    }
+    return true;
+}
+
+
+void EncFSDaemon::Wakeup()
+{
+    char wakebyte = 'w';
+    ssize_t written = write(m_wakeupPipe[1], &wakebyte, 1);
+    (void)written;
+}
+
+// called from a DaemonOpThread
+void EncFSDaemon::OpDone(DaemonOp *op)
+{
+    {
+        wxCriticalSectionLocker lock(m_queueCS);
+        m_doneOps.push_back(op);
+    }
+    Wakeup();
+}
+
+// called from the mount watcher thread
+void EncFSDaemon::MountStateChanged(const wxString& volumename, bool ismounted)
+{
+    {
+        wxCriticalSectionLocker lock(m_queueCS);
+        m_stateChanges.push_back(std::make_pair(volumename, ismounted));
+    }
+    Wakeup();
+}
+
+// called from the idle watcher thread
+void EncFSDaemon::VolumeIdle(const wxString& volumename)
+{
+    {
+        wxCriticalSectionLocker lock(m_queueCS);
+        m_idleVolumes.push_back(volumename);
+    }
+    Wakeup();
+}
+
+
+// pushed to the subscribers, from DBEntry::setMountState()
+void EncFSDaemon::OnVolumeChanged(const wxString& volumename)
+{
+    VolumeMap::iterator it = m_volumedata.find(volumename);
+    if (it == m_volumedata.end() || !it->second)
+    {
+        return;
+    }
+    wxString line;
+    line.Printf(wxT("event\t%s\t%s"), it->second->getMountState() ? "mounted" : "unmounted", volumename);
+    Broadcast(line);
+}
+
+void EncFSDaemon::OnVolumeListChanged()
+{
+    Broadcast("event\tvolumes");
+}
+
+
+void EncFSDaemon::Accept()
+{
+    int fd = accept(m_listenfd, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+    setCloseOnExec(fd);
+    if (!isSameUser(fd))
+    {
+        close(fd);
+        return;
+    }
+    // a client that stops reading must not block everybody else
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    m_clients[fd] = "";
+}
+
+// false if the client is gone
+bool EncFSDaemon::ReadClient(int fd)
+{
+    char buf[4096];
+    ssize_t nread = read(fd, buf, sizeof(buf));
+    if (nread < 0)
+    {
+        return (errno == EAGAIN || errno == EINTR);
+    }
+    if (nread == 0)
+    {
+        return false;
+    }
+
+    std::string& input = m_clients[fd];
+    input.append(buf, nread);
+    size_t eol;
+    while ((eol = input.find('\n')) != std::string::npos)
+    {
+        wxString line = wxString::FromUTF8(input.c_str(), eol);
+        input.erase(0, eol + 1);
+        HandleRequest(fd, line);
+        if (m_deadclients.count(fd))
+        {
+            return false;
+        }
+    }
+    return (input.length() < DAEMON_MAX_LINE);
+}
+
+void EncFSDaemon::CloseClient(int fd)
+{
+    close(fd);
+    m_clients.erase(fd);
+    m_output.erase(fd);
+    m_subscribers.erase(fd);
+    // the fd number may get reused, don't reply to a stranger
+    for (std::map<wxString, DaemonOp*>::iterator it = m_ops.begin(); it != m_ops.end(); it++)
+    {
+        std::vector<int>& clients = it->second->clients;
+        clients.erase(std::remove(clients.begin(), clients.end(), fd), clients.end());
+    }
+}
+
+bool EncFSDaemon::SendLine(int fd, const wxString& line)
+{
+    // -1 = the daemon asked for it itself (idle unmount)
+    if (fd < 0 || m_deadclients.count(fd))
+    {
+        return false;
+    }
+    // queued, whatever doesn't fit in the socket buffer goes out on POLLOUT
+    std::string& output = m_output[fd];
+    output.append(line.utf8_str());
+    output += "\n";
+    if (!FlushClient(fd))
+    {
+        m_deadclients.insert(fd);
+        return false;
+    }
+    return true;
+}
+
+// write as much queued output as the client takes right now
+// false if the client is gone, or stopped reading for too long
+bool EncFSDaemon::FlushClient(int fd)
+{
+    std::string& output = m_output[fd];
+    size_t sent = 0;
+    while (sent < output.length())
+    {
+        ssize_t written = write(fd, output.c_str() + sent, output.length() - sent);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0 && errno == EAGAIN)
+        {
+            break;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        sent += written;
+    }
+    output.erase(0, sent);
+    return (output.length() <= DAEMON_MAX_OUTPUT);
+}
+
+void EncFSDaemon::Broadcast(const wxString& line)
+{
+    for (std::set<int>::iterator it = m_subscribers.begin(); it != m_subscribers.end(); it++)
+    {
+        SendLine(*it, line);
+    }
+}
+
+
+// the GUI may have changed the volumes, cheap if it didn't
+void EncFSDaemon::RefreshVolumes()
+{
+    VolumeRegistry& registry = getVolumeRegistry();
+    if (registry.HasConfigFileChanged())
+    {
+        // our wxFileConfig still has the old contents, and running ops read from it
+        if (!m_ops.empty())
+        {
+            return;
+        }
+        delete wxConfigBase::Set(wxConfigBase::Create());
+    }
+    recordRefreshMetrics();
+    if (!registry.Refresh())
+    {
+        return;
+    }
+    syncVolumeData(m_volumedata, m_allvolumes, registry.GetVolumes());
+
+    MountSnapshot snapshot;
+    snapshot.Capture();
+    std::map<wxString, wxString> watchedpaths;
+    std::map<wxString, bool> knownstates;
+    for (VolumeMap::iterator it = m_volumedata.begin(); it != m_volumedata.end(); it++)
+    {
+        it->second->setMountState(snapshot.IsEncFSMounted(it->second->getMountPath()));
+        watchedpaths[it->first] = it->second->getMountPath();
+        knownstates[it->first] = it->second->getMountState();
+    }
+    if (m_mountWatcher)
+    {
+        m_mountWatcher->SetWatchedVolumes(watchedpaths, knownstates);
+    }
+    UpdateIdleWatcher();
+}
+
+
+void EncFSDaemon::HandleRequest(int fd, const wxString& line)
+{
+    wxArrayString fields = wxStringTokenize(line, "\t", wxTOKEN_RET_EMPTY_ALL);
+    wxString command = fields.IsEmpty() ? wxString() : fields[0];
+
+    if (command == "status")
+    {
+        HandleStatus(fd);
+    }
+    else if (command == "mount" && fields.GetCount() >= 2)
+    {
+        HandleOp(fd, fields[1], true, fields.GetCount() >= 3 ? fromHex(fields[2]) : wxString());
+    }
+    else if (command == "unmount" && fields.GetCount() >= 2)
+    {
+        HandleOp(fd, fields[1], false, "");
+    }
+    else if (command == "subscribe")
+    {
+        m_subscribers.insert(fd);
+        SendLine(fd, "ok");
+    }
+    else
+    {
+        SendLine(fd, "error\tusage\tunknown request");
+    }
+}
+
+// straight from memory, the mount watcher keeps it current
+void EncFSDaemon::HandleStatus(int fd)
+{
+    RefreshVolumes();
+    for (size_t i = 0; i < m_allvolumes.size(); i++)
+    {
+        DBEntry *thisvol = m_volumedata[m_allvolumes[i]].get();
+        wxString state = thisvol->getMountState() ? "mounted" : "unmounted";
+        std::map<wxString, DaemonOp*>::iterator op = m_ops.find(m_allvolumes[i]);
+        if (op != m_ops.end())
+        {
+            state = op->second->mount ? "mounting" : "unmounting";
+        }
+        wxString line;
+        line.Printf(wxT("volume\t%s\t%s\t%s\t%s"), state, m_allvolumes[i],
+                    thisvol->getEncPath(), thisvol->getMountPath());
+        SendLine(fd, line);
+    }
+    SendLine(fd, "ok");
+}
+
+void EncFSDaemon::HandleOp(int fd, const wxString& volumename, bool mount, const wxString& pw)
+{
+    // an identical request is already running, wait for that one
+    std::map<wxString, DaemonOp*>::iterator running = m_ops.find(volumename);
+    if (running != m_ops.end())
+    {
+        if (running->second->mount == mount)
+        {
+            running->second->clients.push_back(fd);
+        }
+        else
+        {
+            SendLine(fd, wxString::Format(wxT("error\tbusy\t'%s' is being %s"), volumename,
+                                          running->second->mount ? "mounted" : "unmounted"));
+        }
+        return;
+    }
+
+    RefreshVolumes();
+    VolumeMap::iterator it = m_volumedata.find(volumename);
+    if (it == m_volumedata.end() || !it->second)
+    {
+        SendLine(fd, wxString::Format(wxT("error\tunknown\tunknown volume '%s'"), volumename));
+        return;
+    }
+    DBEntry *thisvol = it->second.get();
+    if (thisvol->getMountState() == mount)
+    {
+        // nothing to do
+        SendLine(fd, "ok");
+        return;
+    }
+
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+
+    DaemonOp *op = new DaemonOp;
+    op->volumename = volumename;
+    op->mount = mount;
+    op->encvol = thisvol->getEncPath();
+    op->mountvol = thisvol->getMountPath();
+    op->allowother = thisvol->getAllowOther();
+    op->mountaslocal = thisvol->getMountAsLocal();
+    op->idleminutes = getEncFSIdleMinutes(thisvol);
+    op->pw = pw;
+    if (mount)
+    {
+        op->timeoutms = pConfig->Read(wxT("mountreadytimeout"), 5000l);
+        op->encfsbin = getEncFSBinPath();
+        if (op->pw.IsEmpty() && thisvol->getPwSavedState())
+        {
+            // the password cache lives on this thread, the lookup itself
+            // must not keep the other clients waiting
+            op->pwlookup = getSavedPasswordLookup(volumename);
+        }
+    }
+    else
+    {
+        op->timeoutms = pConfig->Read(wxT("unmounttimeout"), 30000l);
+        op->umountbin = getUMountBinPath();
+    }
+    op->result = ID_MNT_OTHER;
+    op->clients.push_back(fd);
+    op->thread = new DaemonOpThread(op, this);
+    if (op->thread->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete op->thread;
+        delete op;
+        SendLine(fd, "error\tother\tunable to start a worker thread");
+        return;
+    }
+    m_ops[volumename] = op;
+    // tell the subscribers something is going on
+    Broadcast(wxString::Format(wxT("event\t%s\t%s"), mount ? "mounting" : "unmounting", volumename));
+}
+
+
+// main thread, reply to everyone waiting on an op that finished
+void EncFSDaemon::FinishOps()
+{
+    std::vector<DaemonOp*> doneops;
+    {
+        wxCriticalSectionLocker lock(m_queueCS);
+        doneops.swap(m_doneOps);
+    }
+    for (size_t i = 0; i < doneops.size(); i++)
+    {
+        DaemonOp *op = doneops[i];
+        op->thread->Wait();
+        delete op->thread;
+        m_ops.erase(op->volumename);
+
+        wxString reply = "ok";
+        if (op->result == ID_MNT_OK)
+        {
+            VolumeMap::iterator it = m_volumedata.find(op->volumename);
+            if (it != m_volumedata.end() && it->second)
+            {
+                it->second->setMountState(op->mount);
+            }
+        }
+        else if (op->result == ID_MNT_PWDFAIL)
+        {
+            reply.Printf(wxT("error\tpassword\tinvalid password for '%s'"), op->volumename);
+        }
+        else
+        {
+            wxString error = op->error;
+            error.Replace("\n", " ");
+            error.Replace("\t", " ");
+            reply.Printf(wxT("error\tother\tunable to %s '%s' %s"), op->mount ? "mount" : "unmount",
+                         op->volumename, error);
+            // it didn't happen, let the subscribers know the state didn't change
+            OnVolumeChanged(op->volumename);
+        }
+        for (size_t c = 0; c < op->clients.size(); c++)
+        {
+            SendLine(op->clients[c], reply);
+        }
+        delete op;
+    }
+    if (!doneops.empty())
+    {
+        UpdateIdleWatcher();
+    }
+}
+
+void EncFSDaemon::ApplyStateChanges()
+{
+    std::vector<std::pair<wxString, bool> > changes;
+    {
+        wxCriticalSectionLocker lock(m_queueCS);
+        changes.swap(m_stateChanges);
+    }
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+        VolumeMap::iterator it = m_volumedata.find(changes[i].first);
+        if (it != m_volumedata.end() && it->second)
+        {
+            it->second->setMountState(changes[i].second);
+        }
+    }
+    if (!changes.empty())
+    {
+        UpdateIdleWatcher();
+    }
+}
+
+
+// unmount what the idle watcher reported, like a client asking for it
+void EncFSDaemon::UnmountIdleVolumes()
+{
+    std::vector<wxString> idlevolumes;
+    {
+        wxCriticalSectionLocker lock(m_queueCS);
+        idlevolumes.swap(m_idleVolumes);
+    }
+    for (size_t i = 0; i < idlevolumes.size(); i++)
+    {
+        wxLogMessage(wxT("'%s' has been idle, unmounting"), idlevolumes[i]);
+        HandleOp(-1, idlevolumes[i], false, wxString());
+    }
+}
+
+
+void EncFSDaemon::UpdateIdleWatcher()
+{
+    if (m_idleWatcher)
+    {
+        m_idleWatcher->SetWatchedVolumes(m_volumedata);
+    }
+}
+
+
+int EncFSDaemon::Run(const wxString& socketpath)
+{
+    if (m_wakeupPipe[0] < 0 || !Listen(socketpath))
+    {
+        return 1;
+    }
+
+    g_daemonWakeupFd = m_wakeupPipe[1];
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGTERM, onDaemonSignal);
+    signal(SIGINT, onDaemonSignal);
+    signal(SIGHUP, onDaemonSignal);
+
+    // mount states change under us when someone runs umount, or a volume goes away
+    m_mountWatcher = new MountWatcherThread([this](const wxString& volumename, bool ismounted)
+    {
+        MountStateChanged(volumename, ismounted);
+    });
+    if (m_mountWatcher->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete m_mountWatcher;
+        m_mountWatcher = NULL;
+    }
+    // and volumes with an idle timeout get unmounted, if encfs doesn't do it
+    m_idleWatcher = new IdleWatcherThread([this](const wxString& volumename)
+    {
+        VolumeIdle(volumename);
+    });
+    if (m_idleWatcher->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete m_idleWatcher;
+        m_idleWatcher = NULL;
+    }
+    RefreshVolumes();
+
+    wxLogMessage(wxT("encfsgui daemon listening on '%s'"), socketpath);
+
+    // the daemon writes the metrics files, the GUI leaves them alone while it runs
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    long metricsinterval = pConfig->Read(wxT("metricsinterval"), 60l) * 1000;
+    wxLongLong nextmetrics = wxGetLocalTimeMillis();
+
+    while (!g_daemonStop)
+    {
+        int polltimeout = -1;
+        if (metricsinterval > 0)
+        {
+            wxLongLong now = wxGetLocalTimeMillis();
+            if (now >= nextmetrics)
+            {
+                writeMetrics(m_volumedata);
+                nextmetrics = now + metricsinterval;
+            }
+            polltimeout = (nextmetrics - now).ToLong();
+        }
+
+        std::vector<struct pollfd> fds;
+        struct pollfd pfd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        pfd.fd = m_listenfd;
+        fds.push_back(pfd);
+        pfd.fd = m_wakeupPipe[0];
+        fds.push_back(pfd);
+        for (std::map<int, std::string>::iterator it = m_clients.begin(); it != m_clients.end(); it++)
+        {
+            pfd.fd = it->first;
+            pfd.events = m_output[it->first].empty() ? POLLIN : (POLLIN | POLLOUT);
+            fds.push_back(pfd);
+        }
+
+        int rc = poll(&fds[0], fds.size(), polltimeout);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[1].revents)
+        {
+            char buf[64];
+            while (read(m_wakeupPipe[0], buf, sizeof(buf)) > 0)
+            {
+            }
+            FinishOps();
+            ApplyStateChanges();
+            UnmountIdleVolumes();
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            Accept();
+        }
+        for (size_t i = 2; i < fds.size(); i++)
+        {
+            int fd = fds[i].fd;
+            if ((fds[i].revents & POLLOUT) && !m_deadclients.count(fd) && !FlushClient(fd))
+            {
+                m_deadclients.insert(fd);
+            }
+            if ((fds[i].revents & ~POLLOUT) && !m_deadclients.count(fd) && !ReadClient(fd))
+            {
+                m_deadclients.insert(fd);
+            }
+        }
+        for (std::set<int>::iterator it = m_deadclients.begin(); it != m_deadclients.end(); it++)
+        {
+            CloseClient(*it);
+        }
+        m_deadclients.clear();
+    }
+
+    wxLogMessage(wxT("encfsgui daemon stopping"));
+    g_daemonWakeupFd = -1;
+
+    // let running mounts and unmounts finish, they can't be taken back halfway
+    for (std::map<wxString, DaemonOp*>::iterator it = m_ops.begin(); it != m_ops.end(); it++)
+    {
+        it->second->thread->Wait();
+        delete it->second->thread;
+        delete it->second;
+    }
+    m_ops.clear();
+    {
+        wxCriticalSectionLocker lock(m_queueCS);
+        m_doneOps.clear();
+    }
+
+    if (m_mountWatcher)
+    {
+        m_mountWatcher->RequestStop();
+        m_mountWatcher->Wait();
+        delete m_mountWatcher;
+        m_mountWatcher = NULL;
+    }
+    if (m_idleWatcher)
+    {
+        m_idleWatcher->RequestStop();
+        m_idleWatcher->Wait();
+        delete m_idleWatcher;
+        m_idleWatcher = NULL;
+    }
+
+    for (std::map<int, std::string>::iterator it = m_clients.begin(); it != m_clients.end(); it++)
+    {
+        close(it->first);
+    }
+    m_clients.clear();
+    m_output.clear();
+    m_subscribers.clear();
+    close(m_listenfd);
+    m_listenfd = -1;
+    unlink(socketpath.utf8_str());
+    return 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// client side
+// ----------------------------------------------------------------------------
+
+// send one request, collect the reply lines up to and including ok/error
+// returns false if there is no daemon to talk to
+static bool daemonRequest(const wxString& socketpath, const wxString& request, wxArrayString& reply)
+{
+    struct sockaddr_un addr;
+    if (!fillSocketAddress(socketpath, addr))
+    {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    setCloseOnExec(fd);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        // no daemon, or a stale socket file
+        close(fd);
+        return false;
+    }
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    struct timeval timeout;
+    timeout.tv_sec = DAEMON_CLIENT_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string data(request.utf8_str());
+    data += "\n";
+    size_t sent = 0;
+    while (sent < data.length())
+    {
+#if defined(MSG_NOSIGNAL)
+        ssize_t written = send(fd, data.c_str() + sent, data.length() - sent, MSG_NOSIGNAL);
+#else
+        ssize_t written = send(fd, data.c_str() + sent, data.length() - sent, 0);
+#endif
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            close(fd);
+            return false;
+        }
+        sent += written;
+    }
+    // don't leave the password behind
+    std::fill(data.begin(), data.end(), '\0');
+
+    reply.Clear();
+    std::string input;
+    bool done = false;
+    while (!done)
+    {
+        char buf[4096];
+        ssize_t nread = read(fd, buf, sizeof(buf));
+        if (nread < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (nread <= 0)
+        {
+            break;
+        }
+        input.append(buf, nread);
+        size_t eol;
+        while (!done && (eol = input.find('\n')) != std::string::npos)
+        {
+            wxString line = wxString::FromUTF8(input.c_str(), eol);
+            input.erase(0, eol + 1);
+            reply.Add(line);
+            done = (line == "ok" || line.StartsWith("error\t"));
+        }
+    }
+    close(fd);
+    if (!done)
+    {
+        // the daemon went away halfway, we can't tell what happened
+        reply.Add("error\tother\tno reply from the encfsgui daemon");
+    }
+    return true;
+}
+
+
+// same, but without freezing the GUI while the daemon works on it
+static bool daemonRequestWait(const wxString& socketpath, const wxString& request, wxArrayString& reply)
+{
+    bool answered = false;
+    RunWorkerWait([&]() { answered = daemonRequest(socketpath, request, reply); });
+    return answered;
+}
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+wxString getDaemonSocketPath()
+{
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    wxString socketpath = pConfig->Read(wxT("daemonsocket"), "");
+    if (socketpath.IsEmpty())
+    {
+        socketpath = wxStandardPaths::Get().GetUserDataDir() + "/daemon.sock";
+    }
+    return socketpath;
+}
+
+// the GUI uses this to leave the metrics files to the daemon
+bool isDaemonRunning()
+{
+    struct sockaddr_un addr;
+    return (fillSocketAddress(getDaemonSocketPath(), addr) && isSocketAnswering(addr));
+}
+
+// returns false if there is no daemon, the caller mounts by itself then
+// doesn't read the config, so it can run on a worker thread
+bool daemonMountVolume(const wxString& socketpath, const wxString& volumename, const wxString& pw, int& mountstatus)
+{
+    wxArrayString reply;
+    if (!daemonRequestWait(socketpath, "mount\t" + volumename + "\t" + toHex(pw), reply))
+    {
+        return false;
+    }
+    wxString result = reply.Last();
+    if (result == "ok")
+    {
+        mountstatus = ID_MNT_OK;
+    }
+    else if (result.StartsWith("error\tpassword\t"))
+    {
+        mountstatus = ID_MNT_PWDFAIL;
+    }
+    else
+    {
+        mountstatus = ID_MNT_OTHER;
+    }
+    return true;
+}
+
+// returns false if there is no daemon, the caller unmounts by itself then
+bool daemonUnmountVolume(const wxString& socketpath, const wxString& volumename, bool& unmounted)
+{
+    wxArrayString reply;
+    if (!daemonRequestWait(socketpath, "unmount\t" + volumename, reply))
+    {
+        return false;
+    }
+    unmounted = (reply.Last() == "ok");
+    return true;
+}
+
+// encfsgui --daemon, runs until SIGTERM/SIGINT/SIGHUP
+int runDaemon()
+{
+    EncFSDaemon daemon;
+    return daemon.Run(getDaemonSocketPath());
+}
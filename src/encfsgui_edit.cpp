@@ -20,6 +20,7 @@
 #include <wx/file.h>
 #include <wx/time.h>
 #include <wx/stdpaths.h>
+#include <wx/spinctrl.h>
 #include <vector>
 #include <map>
 
@@ -53,19 +54,17 @@ frmEditDialog::frmEditDialog(wxWindow *parent,
                            const wxSize &size, 
                            long style,
                            wxString selectedvolume,
-                           std::map<wxString, DBEntry*> volumedata) :  wxDialog(parent, wxID_ANY, title, pos, size, style)
+                           const VolumeMap& volumedata) :  wxDialog(parent, wxID_ANY, title, pos, size, style)
 {
     m_volumename = selectedvolume;
-    DBEntry * thisvol = volumedata[selectedvolume];
+    DBEntry * thisvol = volumedata.at(selectedvolume).get();
     m_mounted = thisvol->getMountState();
-    m_editVolumeData = volumedata;
 }
 
 
 void frmEditDialog::Create()
 {
 
-    wxString config_volname;
     wxString srcfolder;
     wxString dstfolder;
     bool automount;
@@ -73,17 +72,24 @@ void frmEditDialog::Create()
     bool savedpassword;
     bool allow_other;
     bool mount_as_local;
+    long idle_timeout;
 
-    wxConfigBase *pConfig = wxConfigBase::Get();
-    config_volname.Printf(wxT("/Volumes/%s"), m_volumename);
-    pConfig->SetPath(config_volname);
-    srcfolder = pConfig->Read(wxT("enc_path"));
-    dstfolder = pConfig->Read(wxT("mount_path"));
-    automount = pConfig->ReadBool(wxT("automount"), 0l);
-    prevent_autounmount = pConfig->ReadBool(wxT("preventautounmount"),0l);
-    allow_other = pConfig->ReadBool(wxT("allowother"),0l);
-    mount_as_local = pConfig->ReadBool(wxT("mountaslocal"),0l);
-    savedpassword = pConfig->ReadBool(wxT("passwordsaved"),0l);
+    VolumeRegistry& registry = getVolumeRegistry();
+    registry.Refresh();
+    VolumeRecord record;
+    const VolumeRecord* thisrecord = registry.Find(m_volumename);
+    if (thisrecord)
+    {
+        record = *thisrecord;
+    }
+    srcfolder = record.enc_path;
+    dstfolder = record.mount_path;
+    automount = record.automount;
+    prevent_autounmount = record.preventautounmount;
+    allow_other = record.allowother;
+    mount_as_local = record.mountaslocal;
+    idle_timeout = record.idletimeout;
+    savedpassword = record.passwordsaved;
     m_pwsaved = savedpassword;
 
     wxSizer * const sizerMaster = new wxBoxSizer(wxVERTICAL);
@@ -153,6 +159,13 @@ void frmEditDialog::Create()
     m_chkbx_mount_as_local->SetValue(mount_as_local);
     sizerMount->Add(m_chkbx_mount_as_local);
 
+    // idle timeout
+    wxSizer * const sizerIdle = new wxBoxSizer(wxHORIZONTAL);
+    sizerIdle->Add(new wxStaticText(this, wxID_ANY, "Unmount after this many minutes without access (0 = never):"));
+    m_spin_idle_timeout = new wxSpinCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(80,22), wxSP_ARROW_KEYS, 0, 1440, idle_timeout);
+    sizerIdle->Add(m_spin_idle_timeout, wxSizerFlags().Border(wxLEFT|wxRIGHT, 5));
+    sizerMount->Add(sizerIdle, wxSizerFlags().Border(wxTOP, 5));
+
     sizerMaster->Add(sizerVolume, wxSizerFlags(1).Expand().Border());
     sizerMaster->Add(sizerPassword, wxSizerFlags(1).Expand().Border());
     sizerMaster->Add(sizerMount, wxSizerFlags(1).Expand().Border());
@@ -308,17 +321,13 @@ void frmEditDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
             // rename password entry in Keychain if pw was saved
             if (m_pwsaved)
             {
-                wxString cmd;
-                wxString pwaddoutput;
                 wxString previouspw;
                 // get previous pass first
-                previouspw = getKeychainPassword(oldvolname);
+                previouspw = getSavedPassword(oldvolname);
                 // remove old entry
-                cmd.Printf(wxT("sh -c \"security delete-generic-password -U -a 'EncFSGUI_%s' -s 'EncFSGUI_%s' login.keychain\""), oldvolname, oldvolname);
-                pwaddoutput = StrRunCMDSync(cmd);
+                removeSavedPassword(oldvolname);
                 // add entry with new name
-                cmd.Printf(wxT("sh -c \"security add-generic-password -U -a 'EncFSGUI_%s' -s 'EncFSGUI_%s' -w '%s' login.keychain\""), newvolname, newvolname, previouspw);
-                pwaddoutput = StrRunCMDSync(cmd);
+                savePassword(newvolname, previouspw);
                 previouspw = "";
 
             }
@@ -336,6 +345,7 @@ void frmEditDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
         pConfig->Write(wxT("preventautounmount"),m_chkbx_prevent_autounmount->GetValue());
         pConfig->Write(wxT("allowother"),m_chkbx_allow_other->GetValue());
         pConfig->Write(wxT("mountaslocal"),m_chkbx_mount_as_local->GetValue());
+        pConfig->Write(wxT("idletimeout"), (long)m_spin_idle_timeout->GetValue());
         pConfig->Flush();
 
         bool okToClose = true;
@@ -355,10 +365,7 @@ void frmEditDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
                                                             wxYES_NO|wxCENTRE|wxNO_DEFAULT|wxICON_QUESTION);
             if (dlg->ShowModal() == wxID_YES)
             {
-                wxString cmd;
-                wxString pwaddoutput;
-                cmd.Printf(wxT("sh -c \"security delete-generic-password -U -a 'EncFSGUI_%s' -s 'EncFSGUI_%s' login.keychain\""), newvolname, newvolname);
-                pwaddoutput = StrRunCMDSync(cmd);
+                removeSavedPassword(newvolname);
                 pConfig->SetPath(config_volname);
                 pConfig->Write(wxT("passwordsaved"), false);
                 pConfig->Flush();
@@ -378,13 +385,7 @@ void frmEditDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
                                                                 wxYES_NO|wxCENTRE|wxNO_DEFAULT|wxICON_QUESTION);
                 if (dlg->ShowModal() == wxID_YES)
                 {
-                    wxString cmd;
-                    wxString pwaddoutput;
-                    wxString pw;
-                    pw = m_pass1->GetValue();
-                    cmd.Printf(wxT("sh -c \"security add-generic-password -U -a 'EncFSGUI_%s' -s 'EncFSGUI_%s' -w '%s' login.keychain\""), newvolname, newvolname, pw);
-                    pw = "";
-                    pwaddoutput = StrRunCMDSync(cmd);
+                    savePassword(newvolname, m_pass1->GetValue());
                     pConfig->SetPath(config_volname);
                     pConfig->Write(wxT("passwordsaved"), true);
                     pConfig->Flush();
@@ -405,13 +406,7 @@ void frmEditDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
                                                                 wxYES_NO|wxCENTRE|wxNO_DEFAULT|wxICON_QUESTION);
                 if (dlg->ShowModal() == wxID_YES)
                 {
-                    wxString cmd;
-                    wxString pwaddoutput;
-                    wxString pw;
-                    pw = m_pass1->GetValue();
-                    cmd.Printf(wxT("sh -c \"security add-generic-password -U -a 'EncFSGUI_%s' -s 'EncFSGUI_%s' -w '%s' login.keychain\""), newvolname, newvolname, pw);
-                    pw = "";
-                    pwaddoutput = StrRunCMDSync(cmd);
+                    savePassword(newvolname, m_pass1->GetValue());
                     pConfig->SetPath(config_volname);
                     pConfig->Write(wxT("passwordsaved"), true);
                     pConfig->Flush();
@@ -433,7 +428,7 @@ void frmEditDialog::SaveSettings(wxCommandEvent& WXUNUSED(event))
 // helper functions
 // ----------------------------------------------------------------------------
 
-void editExistingEncFSFolder(wxWindow *parent, wxString& selectedvolume, std::map<wxString, DBEntry*> volumedata)
+void editExistingEncFSFolder(wxWindow *parent, wxString& selectedvolume, const VolumeMap& volumedata)
 {
     wxSize frmEditSize;
     frmEditSize.Set(600,540);
@@ -443,7 +438,7 @@ void editExistingEncFSFolder(wxWindow *parent, wxString& selectedvolume, std::ma
     wxString strTitle;
     strTitle.Printf(wxT("Edit EncFS folder '%s'"), selectedvolume); 
     bool ismounted = false;
-    DBEntry * thisvol = volumedata[selectedvolume];
+    DBEntry * thisvol = volumedata.at(selectedvolume).get();
     ismounted = thisvol->getMountState();
     if (ismounted)
     {
@@ -0,0 +1,1226 @@
+/*
+    encFSGui - encfsgui_exec.cpp
+    source file contains code to run external commands
+    in the background, without blocking the GUI thread
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/thread.h>
+#include <wx/evtloop.h>
+#include <wx/time.h>
+#include <wx/utils.h>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <termios.h>
+
+#if defined(__APPLE__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    #include <util.h>       // forkpty
+#elif defined(__FreeBSD__)
+    #include <libutil.h>
+#else
+    #include <pty.h>
+#endif
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    #include <sys/event.h>
+    #define ENCFSGUI_FILEWATCH_KQUEUE 1
+#elif defined(__linux__)
+    #include <sys/inotify.h>
+    #define ENCFSGUI_FILEWATCH_INOTIFY 1
+#endif
+
+#include "encfsgui.h"
+
+extern char **environ;
+
+
+// ----------------------------------------------------------------------------
+// CmdState - shared between the worker thread and the caller
+// ----------------------------------------------------------------------------
+
+class CmdState
+{
+public:
+    CmdState() : m_doneCondition(m_mutex)
+    {
+        m_done = false;
+        m_settled = false;
+        m_cancelled = false;
+        m_pid = -1;
+        if (pipe(m_cancelPipe) != 0)
+        {
+            m_cancelPipe[0] = -1;
+            m_cancelPipe[1] = -1;
+        }
+        else
+        {
+            fcntl(m_cancelPipe[0], F_SETFD, FD_CLOEXEC);
+            fcntl(m_cancelPipe[1], F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    ~CmdState()
+    {
+        if (m_cancelPipe[0] > -1)
+        {
+            close(m_cancelPipe[0]);
+            close(m_cancelPipe[1]);
+        }
+    }
+
+    CmdRequest m_request;
+    CmdResult m_result;
+    bool m_done;
+    bool m_settled;     // outcome already known (line callback, file showed up)
+    bool m_cancelled;
+    pid_t m_pid;
+    int m_cancelPipe[2];
+    wxMutex m_mutex;
+    wxCondition m_doneCondition;
+};
+
+
+// counts nested WaitCMD() calls on the GUI thread
+static int g_cmdWaitDepth = 0;
+
+
+// ----------------------------------------------------------------------------
+// CmdWorkerThread - runs one command and collects its output
+// ----------------------------------------------------------------------------
+
+class CmdWorkerThread : public wxThread
+{
+public:
+    CmdWorkerThread(CmdHandle state) : wxThread(wxTHREAD_DETACHED)
+    {
+        m_state = state;
+        m_step = 0;
+        m_matchpos = 0;
+    }
+
+protected:
+    virtual ExitCode Entry() wxOVERRIDE;
+
+private:
+    bool Spawn(int *inpipe, int *outpipe, int *errpipe);
+    bool SpawnPty(int *inpipe, int *outpipe);
+    bool AdvanceDialogue(int ptyfd);
+    void EmitLines(const std::string & bytes, size_t & linestart, bool isstderr, bool flush);
+    void Settle(const wxString & settledline = wxEmptyString);
+    void Finish();
+    CmdHandle m_state;
+    CmdResult m_result;
+    std::string m_outbytes;
+    std::string m_errbytes;
+    wxLongLong m_starttime;
+    // pty dialogue state
+    size_t m_step;
+    size_t m_matchpos;
+    wxLongLong m_stepdeadline;
+};
+
+
+static void setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+static void closePipe(int *fds)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (fds[i] > -1)
+        {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+
+static bool openPipe(int *fds)
+{
+    if (pipe(fds) != 0)
+    {
+        fds[0] = -1;
+        fds[1] = -1;
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// FileWatch - wakes up poll() when something changes in a folder
+// ----------------------------------------------------------------------------
+
+class FileWatch
+{
+public:
+    FileWatch()
+    {
+        m_fd = -1;
+        m_dirfd = -1;
+        m_filefd = -1;
+    }
+
+    ~FileWatch()
+    {
+        Close();
+    }
+
+    // watch the folder that will contain filepath
+    // endmarker: what the file ends with once it is complete (kqueue only, see Drain())
+    // if this fails, poll() simply keeps waking up every now and then
+    void Open(const wxString& filepath, const wxString& endmarker)
+    {
+        wxString dirpath = filepath.BeforeLast('/');
+        if (dirpath.IsEmpty())
+        {
+            dirpath = "/";
+        }
+        m_filepath = std::string(filepath.fn_str());
+        m_filename = std::string(filepath.AfterLast('/').fn_str());
+        m_endmarker = std::string(endmarker.utf8_str());
+#if defined(ENCFSGUI_FILEWATCH_INOTIFY)
+        m_fd = inotify_init();
+        if (m_fd > -1)
+        {
+            fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+            setNonBlocking(m_fd);
+            // close_write: don't pick up the file while it is still being written
+            if (inotify_add_watch(m_fd, dirpath.fn_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+            {
+                Close();
+            }
+        }
+#elif defined(ENCFSGUI_FILEWATCH_KQUEUE)
+        m_dirfd = open(dirpath.fn_str(), O_RDONLY);
+        m_fd = kqueue();
+        if (m_fd > -1 && m_dirfd > -1)
+        {
+            fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+            fcntl(m_dirfd, F_SETFD, FD_CLOEXEC);
+            struct kevent change;
+            EV_SET(&change, m_dirfd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+            if (kevent(m_fd, &change, 1, NULL, 0, NULL) < 0)
+            {
+                Close();
+            }
+        }
+        else
+        {
+            Close();
+        }
+#endif
+    }
+
+    void Close()
+    {
+        if (m_fd > -1)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+        if (m_dirfd > -1)
+        {
+            close(m_dirfd);
+            m_dirfd = -1;
+        }
+        if (m_filefd > -1)
+        {
+            close(m_filefd);
+            m_filefd = -1;
+        }
+    }
+
+    // swallow pending notifications
+    // returns true if the file was closed after writing, or moved into place
+    // kqueue has no close notification, so there the folder and then the file itself
+    // are watched for writes, and the file counts as written once it ends with the end marker
+    // (without one, we only know at child exit)
+    bool Drain()
+    {
+        bool written = false;
+#if defined(ENCFSGUI_FILEWATCH_INOTIFY)
+        char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while (m_fd > -1 && (len = read(m_fd, buf, sizeof(buf))) > 0)
+        {
+            for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len)
+            {
+                const struct inotify_event *event = (const struct inotify_event *)ptr;
+                if (event->len > 0 && m_filename == event->name)
+                {
+                    written = true;
+                }
+            }
+        }
+#elif defined(ENCFSGUI_FILEWATCH_KQUEUE)
+        struct kevent events[8];
+        struct timespec nowait = { 0, 0 };
+        while (m_fd > -1 && kevent(m_fd, NULL, 0, events, 8, &nowait) > 0)
+        {
+        }
+        if (m_fd < 0 || m_endmarker.empty())
+        {
+            return false;
+        }
+        if (m_filefd < 0)
+        {
+            // the file showed up, follow its writes from now on
+            m_filefd = open(m_filepath.c_str(), O_RDONLY);
+            if (m_filefd > -1)
+            {
+                fcntl(m_filefd, F_SETFD, FD_CLOEXEC);
+                struct kevent change;
+                EV_SET(&change, m_filefd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_EXTEND, 0, NULL);
+                kevent(m_fd, &change, 1, NULL, 0, NULL);
+            }
+        }
+        written = isFileComplete();
+#endif
+        return written;
+    }
+
+    int GetFd() const
+    {
+        return m_fd;
+    }
+
+private:
+    // regular file, ending with the end marker (trailing whitespace aside)
+    bool isFileComplete() const
+    {
+        struct stat st;
+        if (stat(m_filepath.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        {
+            return false;
+        }
+        int fd = open(m_filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        char buf[256];
+        off_t offset = (st.st_size > (off_t)sizeof(buf)) ? st.st_size - (off_t)sizeof(buf) : 0;
+        ssize_t len = pread(fd, buf, sizeof(buf), offset);
+        close(fd);
+        if (len <= 0)
+        {
+            return false;
+        }
+        std::string tail(buf, len);
+        size_t end = tail.find_last_not_of(" \t\r\n");
+        if (end == std::string::npos || end + 1 < m_endmarker.size())
+        {
+            return false;
+        }
+        return (tail.compare(end + 1 - m_endmarker.size(), m_endmarker.size(), m_endmarker) == 0);
+    }
+
+    int m_fd;
+    int m_dirfd;
+    int m_filefd;   // kqueue, the file itself once it exists
+    std::string m_filepath;
+    std::string m_filename;
+    std::string m_endmarker;
+};
+
+
+// file is there, and not empty
+// only trusted once the command has exited, it may still be writing before that
+static bool isFileWritten(const std::string& filepath)
+{
+    struct stat st;
+    return (stat(filepath.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0);
+}
+
+
+// bytes coming from external tools are utf-8 on OSX and on any sane Linux box
+static wxString bytesToWxStr(const std::string & bytes)
+{
+    wxString returnval = wxString::FromUTF8(bytes.c_str(), bytes.size());
+    if (returnval.IsEmpty() && !bytes.empty())
+    {
+        returnval = wxString::From8BitData(bytes.c_str(), bytes.size());
+    }
+    return returnval;
+}
+
+
+// convert argv, args must stay alive for as long as argv is used
+static void buildArgv(const wxArrayString& input, std::vector<std::string>& args, std::vector<char*>& argv)
+{
+    for (size_t i = 0; i < input.GetCount(); i++)
+    {
+        args.push_back(std::string(input[i].utf8_str()));
+    }
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+}
+
+
+// write everything, waiting a little if the other side is slow
+static bool writeAll(int fd, const std::string& data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t nwritten = write(fd, data.c_str() + written, data.size() - written);
+        if (nwritten > 0)
+        {
+            written += nwritten;
+        }
+        else if (errno == EAGAIN || errno == EINTR)
+        {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, 1000) == 0)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool CmdWorkerThread::Spawn(int *inpipe, int *outpipe, int *errpipe)
+{
+    CmdRequest & request = m_state->m_request;
+    if (request.argv.IsEmpty())
+    {
+        return false;
+    }
+
+    std::vector<std::string> args;
+    std::vector<char*> argv;
+    buildArgv(request.argv, args, argv);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, inpipe[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, outpipe[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, errpipe[1], 2);
+
+    // own process group, so a timeout/cancel takes down the whole tree
+    // and restore SIGPIPE, which we ignore ourselves
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t defaultsignals;
+    sigemptyset(&defaultsignals);
+    sigaddset(&defaultsignals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaultsignals);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    pid_t pid;
+    int rc = posix_spawnp(&pid, argv[0], &actions, &attr, &argv[0], environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (rc != 0)
+    {
+        return false;
+    }
+
+    wxMutexLocker lock(m_state->m_mutex);
+    m_state->m_pid = pid;
+    return true;
+}
+
+
+// run the command on a pseudo terminal instead of pipes, for tools that
+// want to talk to a terminal (encfs and encfsctl read passwords from /dev/tty)
+// output ends up in stdout, the pty master is used for both directions
+bool CmdWorkerThread::SpawnPty(int *inpipe, int *outpipe)
+{
+    CmdRequest & request = m_state->m_request;
+    if (request.argv.IsEmpty())
+    {
+        return false;
+    }
+
+    std::vector<std::string> args;
+    std::vector<char*> argv;
+    buildArgv(request.argv, args, argv);
+
+    // tells us if exec failed in the child
+    int execpipe[2];
+    if (!openPipe(execpipe))
+    {
+        return false;
+    }
+
+    int master = -1;
+    pid_t pid = forkpty(&master, NULL, NULL, NULL);
+    if (pid < 0)
+    {
+        closePipe(execpipe);
+        return false;
+    }
+    if (pid == 0)
+    {
+        // child, only async-signal-safe calls from here on
+        signal(SIGPIPE, SIG_DFL);
+        execvp(argv[0], &argv[0]);
+        int execerr = errno;
+        ssize_t nwritten = write(execpipe[1], &execerr, sizeof(execerr));
+        (void)nwritten;
+        _exit(127);
+    }
+
+    fcntl(master, F_SETFD, FD_CLOEXEC);
+    close(execpipe[1]);
+    int execerr = 0;
+    ssize_t nread;
+    do
+    {
+        nread = read(execpipe[0], &execerr, sizeof(execerr));
+    } while (nread < 0 && errno == EINTR);
+    close(execpipe[0]);
+    if (nread > 0)
+    {
+        waitpid(pid, NULL, 0);
+        close(master);
+        return false;
+    }
+
+    // we don't want our own answers echoed back into the output
+    struct termios tio;
+    if (tcgetattr(master, &tio) == 0)
+    {
+        tio.c_lflag &= ~(ECHO | ECHONL);
+        tcsetattr(master, TCSANOW, &tio);
+    }
+
+    outpipe[0] = master;
+    inpipe[1] = dup(master);
+    if (inpipe[1] > -1)
+    {
+        fcntl(inpipe[1], F_SETFD, FD_CLOEXEC);
+    }
+
+    wxMutexLocker lock(m_state->m_mutex);
+    m_state->m_pid = pid;
+    return true;
+}
+
+
+// look for the next prompt(s) in the output so far, and answer them
+// returns true once all steps have been answered
+bool CmdWorkerThread::AdvanceDialogue(int ptyfd)
+{
+    std::vector<PtyStep> & dialogue = m_state->m_request.dialogue;
+    while (m_step < dialogue.size())
+    {
+        std::string prompt(dialogue[m_step].prompt.utf8_str());
+        size_t pos = m_outbytes.find(prompt, m_matchpos);
+        if (dialogue[m_step].optional && m_step + 1 < dialogue.size())
+        {
+            // skip it if the next prompt shows up first
+            std::string nextprompt(dialogue[m_step + 1].prompt.utf8_str());
+            size_t nextpos = m_outbytes.find(nextprompt, m_matchpos);
+            if (nextpos != std::string::npos && (pos == std::string::npos || nextpos < pos))
+            {
+                m_step++;
+                continue;
+            }
+        }
+        if (pos == std::string::npos)
+        {
+            return false;
+        }
+        m_matchpos = pos + prompt.size();
+
+        std::string response(dialogue[m_step].response.utf8_str());
+        response += "\n";
+        bool sent = (ptyfd > -1 && writeAll(ptyfd, response));
+        std::fill(response.begin(), response.end(), 0);
+        if (!sent)
+        {
+            return false;
+        }
+        m_step++;
+        m_result.stepsdone = m_step;
+        m_stepdeadline = wxGetLocalTimeMillis() + m_state->m_request.prompttimeoutms;
+    }
+    return true;
+}
+
+
+wxThread::ExitCode CmdWorkerThread::Entry()
+{
+    CmdRequest & request = m_state->m_request;
+    CmdResult & result = m_result;
+    m_starttime = wxGetLocalTimeMillis();
+    wxLongLong starttime = m_starttime;
+
+    int inpipe[2] = { -1, -1 };
+    int outpipe[2] = { -1, -1 };
+    int errpipe[2] = { -1, -1 };
+
+    bool usepty = !request.dialogue.empty();
+    bool spawned;
+    if (usepty)
+    {
+        spawned = SpawnPty(inpipe, outpipe);
+    }
+    else
+    {
+        spawned = (openPipe(inpipe) && openPipe(outpipe) && openPipe(errpipe) && Spawn(inpipe, outpipe, errpipe));
+    }
+    if (!spawned)
+    {
+        closePipe(inpipe);
+        closePipe(outpipe);
+        closePipe(errpipe);
+        result.spawnfailed = true;
+        Finish();
+        return (wxThread::ExitCode)0;
+    }
+
+    if (!usepty)
+    {
+        // close the child's ends
+        close(inpipe[0]);
+        inpipe[0] = -1;
+        close(outpipe[1]);
+        outpipe[1] = -1;
+        close(errpipe[1]);
+        errpipe[1] = -1;
+        setNonBlocking(errpipe[0]);
+    }
+    setNonBlocking(inpipe[1]);
+    setNonBlocking(outpipe[0]);
+    m_stepdeadline = starttime + request.prompttimeoutms;
+
+    std::string stdindata(request.stdindata.utf8_str());
+    size_t stdinwritten = 0;
+    if (stdindata.empty())
+    {
+        closePipe(inpipe);
+    }
+
+    std::string & outbytes = m_outbytes;
+    std::string & errbytes = m_errbytes;
+    size_t outlinestart = 0;
+    size_t errlinestart = 0;
+    // settle as soon as the file we're waiting for has been written
+    FileWatch filewatch;
+    std::string waitforfile(request.waitforfile.fn_str());
+    if (!waitforfile.empty())
+    {
+        filewatch.Open(request.waitforfile, request.waitforfileend);
+    }
+
+    pid_t pid = m_state->m_pid;
+    int status = 0;
+    bool exited = false;
+    bool killed = false;
+    wxLongLong deadline = starttime + request.timeoutms;
+
+    while (!exited)
+    {
+        struct pollfd fds[5];
+        int nfds = 0;
+        int outidx = -1;
+        int erridx = -1;
+        int inidx = -1;
+        int watchidx = -1;
+        if (outpipe[0] > -1)
+        {
+            fds[nfds].fd = outpipe[0];
+            fds[nfds].events = POLLIN;
+            outidx = nfds++;
+        }
+        if (errpipe[0] > -1)
+        {
+            fds[nfds].fd = errpipe[0];
+            fds[nfds].events = POLLIN;
+            erridx = nfds++;
+        }
+        if (inpipe[1] > -1)
+        {
+            fds[nfds].fd = inpipe[1];
+            fds[nfds].events = POLLOUT;
+            inidx = nfds++;
+        }
+        if (!waitforfile.empty() && filewatch.GetFd() > -1)
+        {
+            fds[nfds].fd = filewatch.GetFd();
+            fds[nfds].events = POLLIN;
+            watchidx = nfds++;
+        }
+        fds[nfds].fd = m_state->m_cancelPipe[0];
+        fds[nfds].events = POLLIN;
+        int cancelidx = nfds++;
+        for (int i = 0; i < nfds; i++)
+        {
+            fds[i].revents = 0;
+        }
+
+        // the child may exit while a daemonized grandchild still holds the pipes,
+        // so don't rely on EOF alone and check on the child every now and then
+        int waitms = 100;
+        if (usepty && m_step < request.dialogue.size() && request.prompttimeoutms > 0 && !killed)
+        {
+            // the expected prompt didn't show up in time
+            wxLongLong remaining = m_stepdeadline - wxGetLocalTimeMillis();
+            if (remaining <= 0)
+            {
+                result.prompttimedout = true;
+                killed = true;
+                kill(-pid, SIGTERM);
+                kill(pid, SIGTERM);
+                deadline = wxGetLocalTimeMillis() + 1000;
+                continue;
+            }
+            if (remaining < waitms)
+            {
+                waitms = remaining.ToLong();
+            }
+        }
+        if (request.timeoutms > 0 && !killed)
+        {
+            wxLongLong remaining = deadline - wxGetLocalTimeMillis();
+            if (remaining <= 0)
+            {
+                result.timedout = true;
+                killed = true;
+                kill(-pid, SIGTERM);
+                kill(pid, SIGTERM);
+                // give it one more second to clean up
+                deadline = wxGetLocalTimeMillis() + 1000;
+                continue;
+            }
+            if (remaining < waitms)
+            {
+                waitms = remaining.ToLong();
+            }
+        }
+        else if (killed && wxGetLocalTimeMillis() > deadline)
+        {
+            kill(-pid, SIGKILL);
+            kill(pid, SIGKILL);
+        }
+
+        int rc = poll(fds, nfds, waitms);
+        if (rc < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        if (rc > 0 && fds[cancelidx].revents)
+        {
+            // drain the cancel byte, so poll doesn't keep waking up
+            char cancelbyte;
+            ssize_t nread = read(m_state->m_cancelPipe[0], &cancelbyte, 1);
+            (void)nread;
+            if (!killed)
+            {
+                result.cancelled = true;
+                killed = true;
+                kill(-pid, SIGTERM);
+                kill(pid, SIGTERM);
+                deadline = wxGetLocalTimeMillis() + 1000;
+            }
+        }
+
+        char buf[4096];
+        if (outidx > -1 && fds[outidx].revents)
+        {
+            ssize_t nread = read(outpipe[0], buf, sizeof(buf));
+            if (nread > 0)
+            {
+                outbytes.append(buf, nread);
+                EmitLines(outbytes, outlinestart, false, false);
+                if (usepty && AdvanceDialogue(outpipe[0]) && request.stopafterdialogue && !killed)
+                {
+                    // got what we came for, no need to let it run any further
+                    Settle();
+                    killed = true;
+                    kill(-pid, SIGTERM);
+                    kill(pid, SIGTERM);
+                    deadline = wxGetLocalTimeMillis() + 1000;
+                }
+            }
+            else if (nread == 0 || (errno != EAGAIN && errno != EINTR))
+            {
+                closePipe(outpipe);
+            }
+        }
+        if (erridx > -1 && fds[erridx].revents)
+        {
+            ssize_t nread = read(errpipe[0], buf, sizeof(buf));
+            if (nread > 0)
+            {
+                errbytes.append(buf, nread);
+                EmitLines(errbytes, errlinestart, true, false);
+            }
+            else if (nread == 0 || (errno != EAGAIN && errno != EINTR))
+            {
+                closePipe(errpipe);
+            }
+        }
+        if (inidx > -1 && fds[inidx].revents)
+        {
+            if (fds[inidx].revents & POLLOUT)
+            {
+                ssize_t nwritten = write(inpipe[1], stdindata.c_str() + stdinwritten, stdindata.size() - stdinwritten);
+                if (nwritten > 0)
+                {
+                    stdinwritten += nwritten;
+                }
+                else if (errno != EAGAIN && errno != EINTR)
+                {
+                    stdinwritten = stdindata.size();
+                }
+            }
+            else
+            {
+                // POLLERR/POLLHUP, child is not reading anymore
+                stdinwritten = stdindata.size();
+            }
+            if (stdinwritten >= stdindata.size())
+            {
+                closePipe(inpipe);
+            }
+        }
+
+        if (!waitforfile.empty() && watchidx > -1 && fds[watchidx].revents)
+        {
+            if (filewatch.Drain())
+            {
+                result.filefound = true;
+                Settle();
+                waitforfile.clear();
+                filewatch.Close();
+            }
+        }
+
+        if (outpipe[0] < 0 && errpipe[0] < 0)
+        {
+            // both pipes closed, child is about to exit
+            exited = (waitpid(pid, &status, 0) == pid);
+            break;
+        }
+        exited = (waitpid(pid, &status, WNOHANG) == pid);
+    }
+
+    // pick up whatever is still sitting in the pipes
+    char buf[4096];
+    ssize_t nread;
+    while (outpipe[0] > -1 && (nread = read(outpipe[0], buf, sizeof(buf))) > 0)
+    {
+        outbytes.append(buf, nread);
+    }
+    while (errpipe[0] > -1 && (nread = read(errpipe[0], buf, sizeof(buf))) > 0)
+    {
+        errbytes.append(buf, nread);
+    }
+    closePipe(inpipe);
+    closePipe(outpipe);
+    closePipe(errpipe);
+    EmitLines(outbytes, outlinestart, false, true);
+    EmitLines(errbytes, errlinestart, true, true);
+
+    if (!exited)
+    {
+        waitpid(pid, &status, 0);
+    }
+
+    if (!waitforfile.empty() && isFileWritten(waitforfile))
+    {
+        result.filefound = true;
+    }
+
+    // don't leave the password lying around
+    std::fill(stdindata.begin(), stdindata.end(), 0);
+
+    result.out = bytesToWxStr(outbytes);
+    result.err = bytesToWxStr(errbytes);
+    if (WIFEXITED(status))
+    {
+        result.exitcode = WEXITSTATUS(status);
+    }
+    result.durationms = (wxGetLocalTimeMillis() - starttime).ToLong();
+
+    Finish();
+    return (wxThread::ExitCode)0;
+}
+
+
+// hand complete lines to the line callback, as soon as they arrive
+void CmdWorkerThread::EmitLines(const std::string & bytes, size_t & linestart, bool isstderr, bool flush)
+{
+    CmdLineCallback & online = m_state->m_request.online;
+    if (!online)
+    {
+        linestart = bytes.size();
+        return;
+    }
+    while (linestart < bytes.size())
+    {
+        size_t lineend = bytes.find('\n', linestart);
+        if (lineend == std::string::npos)
+        {
+            if (!flush)
+            {
+                // wait for the rest of the line
+                return;
+            }
+            lineend = bytes.size();
+        }
+        std::string line = bytes.substr(linestart, lineend - linestart);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
+        linestart = lineend + 1;
+        wxString text = bytesToWxStr(line);
+        if (online(text, isstderr))
+        {
+            Settle(text);
+        }
+    }
+}
+
+
+// let waiters continue with the output collected so far,
+// the command itself keeps running until it exits
+void CmdWorkerThread::Settle(const wxString & settledline)
+{
+    {
+        wxMutexLocker lock(m_state->m_mutex);
+        if (m_state->m_settled || m_state->m_done)
+        {
+            return;
+        }
+        m_state->m_settled = true;
+        // only the first settle counts, later lines can't change the outcome
+        m_result.settledline = settledline;
+        m_state->m_result = m_result;
+        m_state->m_result.settled = true;
+        m_state->m_result.out = bytesToWxStr(m_outbytes);
+        m_state->m_result.err = bytesToWxStr(m_errbytes);
+        m_state->m_result.durationms = (wxGetLocalTimeMillis() - m_starttime).ToLong();
+        m_state->m_doneCondition.Broadcast();
+    }
+    wxWakeUpIdle();
+}
+
+
+// publish the result, and hand it to the callback on the GUI thread
+void CmdWorkerThread::Finish()
+{
+    CmdResult result;
+    CmdCallback callback;
+    wxString command;
+    {
+        wxMutexLocker lock(m_state->m_mutex);
+        if (!m_state->m_request.argv.IsEmpty())
+        {
+            command = m_state->m_request.argv[0];
+        }
+        m_state->m_done = true;
+        m_state->m_pid = -1;
+        m_state->m_request.stdindata.Clear();
+        m_state->m_request.dialogue.clear();
+        m_result.settled = m_state->m_settled;
+        m_state->m_result = m_result;
+        result = m_result;
+        callback = m_state->m_request.oncomplete;
+        m_state->m_doneCondition.Broadcast();
+    }
+    recordCommandMetrics(command, result);
+
+    wxAppConsole *app = wxAppConsole::GetInstance();
+    if (callback && app)
+    {
+        app->CallAfter([callback, result]() { callback(result); });
+    }
+    // make a waiting WaitCMD() return right away
+    wxWakeUpIdle();
+}
+
+
+// ----------------------------------------------------------------------------
+// CmdResult member functions
+// ----------------------------------------------------------------------------
+
+CmdResult::CmdResult()
+{
+    exitcode = -1;
+    timedout = false;
+    cancelled = false;
+    spawnfailed = false;
+    settled = false;
+    filefound = false;
+    prompttimedout = false;
+    stepsdone = 0;
+    durationms = 0;
+}
+
+
+bool CmdResult::Succeeded() const
+{
+    return (exitcode == 0 && !timedout && !cancelled && !spawnfailed);
+}
+
+
+// stdout and stderr combined, the way StrRunCMDSync() returns it
+wxString CmdResult::GetOutput() const
+{
+    wxString returnval = out;
+    if (!err.IsEmpty())
+    {
+        if (!returnval.IsEmpty() && !returnval.EndsWith("\n"))
+        {
+            returnval << "\n";
+        }
+        returnval << err;
+    }
+    return returnval;
+}
+
+
+// CmdRequest constructor
+CmdRequest::CmdRequest()
+{
+    timeoutms = 0;
+    prompttimeoutms = 0;
+    stopafterdialogue = false;
+}
+
+
+// PtyStep constructor
+PtyStep::PtyStep(const wxString& prompttext, const wxString& responsetext, bool isoptional)
+{
+    prompt = prompttext;
+    response = responsetext;
+    optional = isoptional;
+}
+
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+// start a command on a worker thread
+// the returned handle can be used to wait for, or cancel the command
+CmdHandle RunCMDAsync(const CmdRequest & request)
+{
+    static bool sigpipeignored = false;
+    if (!sigpipeignored)
+    {
+        // a child that exits early must not take us down while we feed its stdin
+        signal(SIGPIPE, SIG_IGN);
+        sigpipeignored = true;
+    }
+
+    CmdHandle state = std::make_shared<CmdState>();
+    state->m_request = request;
+
+    CmdWorkerThread *worker = new CmdWorkerThread(state);
+    if (worker->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete worker;
+        wxMutexLocker lock(state->m_mutex);
+        state->m_result.spawnfailed = true;
+        state->m_done = true;
+    }
+    return state;
+}
+
+
+void CancelCMD(CmdHandle & state)
+{
+    wxMutexLocker lock(state->m_mutex);
+    if (!state->m_done && !state->m_cancelled && state->m_cancelPipe[1] > -1)
+    {
+        state->m_cancelled = true;
+        char cancelbyte = 'c';
+        ssize_t written = write(state->m_cancelPipe[1], &cancelbyte, 1);
+        (void)written;
+    }
+}
+
+
+bool IsCMDDone(CmdHandle & state)
+{
+    wxMutexLocker lock(state->m_mutex);
+    return state->m_done;
+}
+
+
+// done, or settled early
+static bool isCMDResolved(CmdHandle & state)
+{
+    wxMutexLocker lock(state->m_mutex);
+    return (state->m_done || state->m_settled);
+}
+
+
+bool IsCMDWaitActive()
+{
+    return (g_cmdWaitDepth > 0);
+}
+
+
+// wait for a command to finish
+// on the GUI thread, keep handling events (repaints, taskbar icon) meanwhile,
+// but disable user input on our windows so nothing else gets started
+CmdResult WaitCMD(CmdHandle & state)
+{
+    wxEventLoopBase *loop = wxEventLoopBase::GetActive();
+    if (wxThread::IsMain() && loop)
+    {
+        wxWindowDisabler disabler;
+        ++g_cmdWaitDepth;
+        while (!isCMDResolved(state))
+        {
+            loop->DispatchTimeout(100);
+        }
+        --g_cmdWaitDepth;
+    }
+    else
+    {
+        wxMutexLocker lock(state->m_mutex);
+        while (!state->m_done && !state->m_settled)
+        {
+            state->m_doneCondition.Wait();
+        }
+    }
+
+    wxMutexLocker lock(state->m_mutex);
+    return state->m_result;
+}
+
+
+CmdResult RunCMDWait(const CmdRequest & request)
+{
+    CmdHandle state = RunCMDAsync(request);
+    return WaitCMD(state);
+}
+
+
+// WorkerWaitThread - runs a blocking call (socket i/o, ...) for RunWorkerWait()
+
+class WorkerWaitThread : public wxThread
+{
+public:
+    WorkerWaitThread(const std::function<void()>& work) : wxThread(wxTHREAD_JOINABLE), m_work(work)
+    {
+        m_done = false;
+    }
+
+    bool IsDone()
+    {
+        wxCriticalSectionLocker lock(m_doneCS);
+        return m_done;
+    }
+
+protected:
+    virtual ExitCode Entry() wxOVERRIDE
+    {
+        m_work();
+        {
+            wxCriticalSectionLocker lock(m_doneCS);
+            m_done = true;
+        }
+        wxWakeUpIdle();
+        return (wxThread::ExitCode)0;
+    }
+
+private:
+    const std::function<void()>& m_work;
+    wxCriticalSection m_doneCS;
+    bool m_done;
+};
+
+
+// run something that may block for a while, the way RunCMDWait() runs a command:
+// on the GUI thread it runs on a worker, while we keep handling events,
+// anywhere else it simply runs right away
+void RunWorkerWait(const std::function<void()>& work)
+{
+    wxEventLoopBase *loop = wxEventLoopBase::GetActive();
+    if (!wxThread::IsMain() || !loop)
+    {
+        work();
+        return;
+    }
+
+    WorkerWaitThread *worker = new WorkerWaitThread(work);
+    if (worker->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete worker;
+        work();
+        return;
+    }
+    {
+        wxWindowDisabler disabler;
+        ++g_cmdWaitDepth;
+        while (!worker->IsDone())
+        {
+            loop->DispatchTimeout(100);
+        }
+        --g_cmdWaitDepth;
+    }
+    worker->Wait();
+    delete worker;
+}
+
+
+// split command output into lines, the way wxExecute does
+wxArrayString CMDOutputToArray(const wxString & output)
+{
+    wxArrayString lines;
+    wxString remaining = output;
+    while (!remaining.IsEmpty())
+    {
+        wxString rest;
+        wxString thisline = remaining.BeforeFirst('\n', &rest);
+        if (thisline.EndsWith("\r"))
+        {
+            thisline.RemoveLast();
+        }
+        lines.Add(thisline);
+        remaining = rest;
+    }
+    return lines;
+}
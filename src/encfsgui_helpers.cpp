@@ -28,6 +28,8 @@
 
 #include <curl/curl.h>
 
+#include "encfsgui.h"
+
 //
 // globals
 //
@@ -101,6 +103,43 @@ bool isEncFSBinInstalled()
 }
 
 
+// quoted and escaped, for the JSON outputs
+wxString toJSONString(const wxString& value)
+{
+    wxString escaped = "\"";
+    for (wxString::const_iterator it = value.begin(); it != value.end(); ++it)
+    {
+        wxUniChar c = *it;
+        if (c == '"')
+        {
+            escaped << "\\\"";
+        }
+        else if (c == '\\')
+        {
+            escaped << "\\\\";
+        }
+        else if (c == '\n')
+        {
+            escaped << "\\n";
+        }
+        else if (c == '\t')
+        {
+            escaped << "\\t";
+        }
+        else if (c.GetValue() < 0x20)
+        {
+            escaped << wxString::Format(wxT("\\u%04x"), (int)c.GetValue());
+        }
+        else
+        {
+            escaped << c;
+        }
+    }
+    escaped << "\"";
+    return escaped;
+}
+
+
 // convert output array into wxString
 wxString arrStrTowxStr(wxArrayString & input)
 {
@@ -202,36 +241,6 @@ wxString getEncFSBinVersion()
 }
 
 
-// Check if volumepath is in "/sbin/mount" output
-// to determine if volume is mounted by encfs already
-bool IsVolumeSystemMounted(wxString volpath, wxArrayString mountinfo)
-{
-    bool matchfound = false;
-    size_t count = mountinfo.GetCount();
-    wxString encmarker = "encfs";
-    // add a space to volpath, to make sure we have an exact match
-    wxString volpathsearch = volpath + " ";
-    for ( size_t n = 0; n < count; n++ )
-    {
-        signed int checkval = -1;
-        wxString thisline;
-        thisline = mountinfo[n];
-        if (not thisline.IsEmpty())
-        {
-            signed int pos1;
-            signed int pos2;
-            pos1 = thisline.Find(volpathsearch);
-            pos2 = thisline.Find(encmarker);
-            if ( (pos1 > checkval) && (pos2 > checkval) )
-            {
-                return true;
-            }
-        }
-    }
-    return matchfound;
-}
-
-
 void BrowseFolder(wxString & mountpath)
 {
     wxString cmd;
@@ -241,203 +250,95 @@ void BrowseFolder(wxString & mountpath)
     wxExecute(cmd, wxEXEC_ASYNC, NULL, &env);
 }
 
-wxString getKeychainPassword(wxString & volumename)
-{
-    wxString cmd;
-    wxString fullname;
-    wxString output;
-    fullname.Printf(wxT("EncFSGUI_%s"), volumename);
-    cmd.Printf(wxT("sh -c 'security find-generic-password -a \"%s\" -s \"%s\" -w login.keychain'"), fullname, fullname);
-    output = StrRunCMDSync(cmd);
-    return output;
-}
-
 bool doesVolumeExist(wxString & volumename)
 {
-    wxConfigBase *pConfig = wxConfigBase::Get();
-    pConfig->SetPath(wxT("/Volumes"));
-    wxString thisvolumename;
-    long dummy;
-    bool bCont = pConfig->GetFirstGroup(thisvolumename, dummy);
-    while ( bCont ) { 
-        if (thisvolumename == volumename)
-        {
-            return true;
-        }
-        bCont = pConfig->GetNextGroup(thisvolumename, dummy);
-    }
-    return false;
+    VolumeRegistry& registry = getVolumeRegistry();
+    registry.Refresh();
+    return registry.Exists(volumename);
 }
 
 wxArrayString getEncFSVolumeInfo(wxString& encfs_volume)
 {
-    wxString cmd;
     wxString encfsctlbin = getEncFSCTLBinPath();
-    wxArrayString cmdoutput;
-
-    cmd.Printf(wxT("sh -c \"'%s' '%s'\""), encfsctlbin, encfs_volume);
-    cmdoutput = ArrRunCMDSync(cmd);
-    return cmdoutput;
+    CmdRequest request;
+    request.argv.Add(encfsctlbin);
+    request.argv.Add(encfs_volume);
+    request.timeoutms = 15000;
+    CmdResult result = RunCMDWait(request);
+
+    // output may end up in stderr, depending on the exit code of encfsctl
+    if (!result.out.IsEmpty())
+    {
+        return CMDOutputToArray(result.out);
+    }
+    return CMDOutputToArray(result.err);
 }
 
-wxString getExpectScriptContents(bool insertbreak)
+// prompts encfs shows when creating a new volume in expert mode, and our answers
+// with probeonly, stop right after the filename encoding list was shown
+std::vector<PtyStep> getCreateVolumeDialogue(const wxString& cipheralgo,
+                                             const wxString& cipherkeysize,
+                                             const wxString& blocksize,
+                                             const wxString& encodingalgo,
+                                             bool ivchaining,
+                                             bool perfileiv,
+                                             bool filetoivheaderchaining,
+                                             bool blockauthcodeheaders,
+                                             const wxString& pw,
+                                             bool probeonly)
 {
-    wxString newline;
-    wxString scriptcontents;
-
-    // header
-    newline.Printf(wxT("#!/usr/bin/env expect\n"));
-    scriptcontents << newline;
-
-    newline.Printf(wxT("set passwd [lindex $argv 0]\n"));
-    scriptcontents << newline;
+    std::vector<PtyStep> dialogue;
 
-    newline.Printf(wxT("set timeout 10\n"));
-    scriptcontents << newline;
+    // activate expert mode
+    dialogue.push_back(PtyStep("?>", "x"));
 
-    // launch encfs
-    newline.Printf(wxT("spawn \"$ENCFSBIN\" -v \"$ENCPATH\" \"$MOUNTPATH\"\n"));
-    scriptcontents << newline;
+    // cipher algorithm, key size, block size
+    dialogue.push_back(PtyStep("Enter the number corresponding to your choice: ", cipheralgo));
+    dialogue.push_back(PtyStep("Selected key size:", cipherkeysize));
+    dialogue.push_back(PtyStep("filesystem block size:", blocksize));
 
-    // activate expert mode
-    newline.Printf(wxT("expect \"Please choose from one of the following options:\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("expect \"?>\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"x\\n\"\n"));
-    scriptcontents << newline;
-
-    // set cipher algorithm
-    newline.Printf(wxT("expect \"Enter the number corresponding to your choice: \"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$CIPHERALGO\\n\"\n"));
-    scriptcontents << newline;
-
-    // select cipher keysize
-    newline.Printf(wxT("expect \"Selected key size:\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$CIPHERKEYSIZE\\n\"\n"));
-    scriptcontents << newline;
-
-    // select filesystem block size
-    newline.Printf(wxT("expect \"filesystem block size:\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$BLOCKSIZE\\n\"\n"));
-    scriptcontents << newline;
-
-    // select encoding algo
-    newline.Printf(wxT("expect \"Enter the number corresponding to your choice: \"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$ENCODINGALGO\\n\"\n"));
-    scriptcontents << newline;
-
-    if (insertbreak)
+    // filename encoding
+    dialogue.push_back(PtyStep("Enter the number corresponding to your choice: ", encodingalgo));
+    if (probeonly)
     {
-        newline.Printf(wxT("break\n"));
-        scriptcontents << newline;        
+        return dialogue;
     }
 
-    // filename IV chaining
-    newline.Printf(wxT("expect \"Enable filename initialization vector chaining?\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$IVCHAINING\\n\"\n"));
-    scriptcontents << newline;
-
-    // per filename IV
-    newline.Printf(wxT("expect \"Enable per-file initialization vectors?\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$PERFILEIV\\n\"\n"));
-    scriptcontents << newline;
+    // empty answer = accept the default (y)
+    dialogue.push_back(PtyStep("Enable filename initialization vector chaining?", ivchaining ? "" : "n"));
+    dialogue.push_back(PtyStep("Enable per-file initialization vectors?", perfileiv ? "" : "n"));
 
     // file to IV header chaining can only be used when both previous options are enabled
     // which means it might slide to the next option right away
-    newline.Printf(wxT("expect {\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("\t\"Enable filename to IV header chaining?\" {\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("\t\tsend \"$FILETOIVHEADERCHAINING\\n\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("\t\texpect \"Enable block authentication code headers\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("\t\tsend \"$BLOCKAUTHCODEHEADERS\\n\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("\t\t}\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("\t\"Enable block authentication code headers\" {\n"));  //space matters
-    scriptcontents << newline;
-    newline.Printf(wxT("\t\tsend \"$BLOCKAUTHCODEHEADERS\\n\"\n"));
-    scriptcontents << newline;   
-    newline.Printf(wxT("\t\t}\n"));
-    scriptcontents << newline;   
-    newline.Printf(wxT("\t}\n"));
-    scriptcontents << newline;    
-
-    // add random bytes to each block header
-    newline.Printf(wxT("expect \"Select a number of bytes, from 0 (no random bytes) to 8: \"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"0\\n\"\n"));
-    scriptcontents << newline;
-
-    // file-hole pass-through
-    newline.Printf(wxT("expect \"Enable file-hole pass-through?\"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"\\n\"\n"));
-    scriptcontents << newline;        
+    // empty answer = accept the default (n)
+    dialogue.push_back(PtyStep("Enable filename to IV header chaining?", filetoivheaderchaining ? "y" : "", true));
+    dialogue.push_back(PtyStep("Enable block authentication code headers", blockauthcodeheaders ? "y" : ""));
 
-    // password
-    newline.Printf(wxT("expect \"New Encfs Password: \"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$passwd\\n\"\n"));
-    scriptcontents << newline;    
-
-    newline.Printf(wxT("expect \"Verify Encfs Password: \"\n"));
-    scriptcontents << newline;
-    newline.Printf(wxT("send \"$passwd\\n\"\n"));
-    scriptcontents << newline;    
+    // no random bytes in block headers, default file-hole pass-through
+    dialogue.push_back(PtyStep("Select a number of bytes, from 0 (no random bytes) to 8: ", "0"));
+    dialogue.push_back(PtyStep("Enable file-hole pass-through?", ""));
 
-    newline.Printf(wxT("puts \"\\nDone.\\n\"\n"));
-    scriptcontents << newline;
-
-    newline.Printf(wxT("expect \"\\n\"\n"));
-    scriptcontents << newline;    
-    
-    newline.Printf(wxT("sleep x\n"));  
-    scriptcontents << newline;
+    // password
+    dialogue.push_back(PtyStep("New Encfs Password: ", pw));
+    dialogue.push_back(PtyStep("Verify Encfs Password: ", pw));
 
-    return scriptcontents;
+    return dialogue;
 }
 
-wxString getChangePasswordScriptContents(wxString & enc_path)
-{
-    wxString scriptcontents;
-    wxString newline;
-    wxString encfsctlbin = getEncFSCTLBinPath();
-
-    newline.Printf(wxT("#!/usr/bin/env expect\n"));
-    scriptcontents << newline;
-
-    newline.Printf(wxT("set oldpw [lindex $argv 0]\n"));
-    scriptcontents << newline;
-
-    newline.Printf(wxT("set newpw [lindex $argv 1]\n"));
-    scriptcontents << newline;
 
-    newline.Printf(wxT("spawn '%s' autopasswd '%s'\n"), encfsctlbin, enc_path);
-    scriptcontents << newline;
-
-    newline.Printf(wxT("expect \"Enter current Encfs password\"\n"));
-    scriptcontents << newline;
-    
-    newline.Printf(wxT("send \"$oldpw\r\"\n"));
-    scriptcontents << newline;
-
-    newline.Printf(wxT("expect \"Enter new Encfs password\"\n"));
-    scriptcontents << newline;
-    
-    newline.Printf(wxT("send \"$newpw\r\"\n"));
-    scriptcontents << newline;
-
-    return scriptcontents;
+// change the password of an encfs volume with encfsctl autopasswd
+bool changeEncFSPassword(const wxString& enc_path, const wxString& oldpw, const wxString& newpw)
+{
+    CmdRequest request;
+    request.argv.Add(getEncFSCTLBinPath());
+    request.argv.Add("autopasswd");
+    request.argv.Add(enc_path);
+    request.dialogue.push_back(PtyStep("Enter current Encfs password", oldpw));
+    request.dialogue.push_back(PtyStep("Enter new Encfs password", newpw));
+    request.prompttimeoutms = 10000;
+    request.timeoutms = 60000;
+    CmdResult result = RunCMDWait(request);
+    return result.Succeeded();
 }
 
 
@@ -466,190 +367,6 @@ wxString getLaunchAgentContents()
 }
 
 
-std::map<wxString, wxString> getEncodingCapabilities()
-{
-    std::map<wxString, wxString> encodingcaps;
-
-    // first, check if we have discovered the capabilities already
-    wxConfigBase *pConfig = wxConfigBase::Get();
-    pConfig->SetPath(wxT("/FilenameEncoding"));
-    wxString capname;
-    long dummy;
-    wxString capval;
-    bool bCont = pConfig->GetFirstEntry(capname, dummy);
-    while (bCont)
-    {
-        // read value for this capname
-        capval = pConfig->Read(capname, "");
-        if (!capname.IsEmpty() && !capval.IsEmpty())
-        {
-            encodingcaps[capname] = capval;
-        }
-        bCont = pConfig->GetNextEntry(capname, dummy);
-    }
-
-
-    if (encodingcaps.size() == 0)
-    {
-        // create 2 temporary dirs
-        wxStandardPathsBase& stdp = wxStandardPaths::Get();
-        wxString tmp_dir = stdp.GetTempDir();
-        wxString enc_dir = "tmp_encfsgui_crypt";
-        wxString plain_dir = "tmp_encfsgui_plain";
-        wxString encfsbin = getEncFSBinPath();
-        wxString msg="";
-        wxString cmd="";
-
-        wxString enc_path;
-        wxString plain_path;
-        enc_path.Printf(wxT("%s/%s"), tmp_dir, enc_dir);
-        plain_path.Printf(wxT("%s/%s"), tmp_dir, plain_dir);
-
-        // remove existing dirs, if they exist
-        wxDir * dirEnc = new wxDir(enc_path);
-        wxDir * dirPlain = new wxDir(plain_path);
-
-        if (dirEnc->Exists(enc_path))
-        {
-            dirEnc->Remove(enc_path, wxPATH_RMDIR_RECURSIVE);
-        }
-        if (dirPlain->Exists(plain_path))
-        {
-            dirPlain->Remove(plain_path, wxPATH_RMDIR_RECURSIVE);
-        }
-
-        // create dirs
-        dirEnc->Make(enc_path);
-        dirPlain->Make(plain_path);
-
-        // true means insert 'break' after listing the filename encoding options
-        wxString scriptcontents = getExpectScriptContents(true); 
-
-        // use valid, but non-important values
-        scriptcontents.Replace("$ENCFSBIN", encfsbin);
-        scriptcontents.Replace("$ENCPATH", enc_path);
-        scriptcontents.Replace("$MOUNTPATH", plain_path);
-        scriptcontents.Replace("$CIPHERALGO", "1");
-        scriptcontents.Replace("$CIPHERKEYSIZE", "128");
-        scriptcontents.Replace("$BLOCKSIZE", "1024");
-        scriptcontents.Replace("$ENCODINGALGO", "1");
-        scriptcontents.Replace("$IVCHAINING","");
-        scriptcontents.Replace("$PERFILEIV","");
-        scriptcontents.Replace("$FILETOIVHEADERCHAINING","");
-        scriptcontents.Replace("$BLOCKAUTHCODEHEADERS","");
-        scriptcontents.Replace("sleep x","expect eof");    
-
-        // run encfs, just to capture the output related with filename encoding mechanisms
-        // write script to disk
-        wxString pw = "DefaultPassword";
-        wxTempFile * tmpfile = new wxTempFile();
-        wxString scriptfile;
-        scriptfile.Printf(wxT("%screateencfs.exp"), tmp_dir );
-        tmpfile->Open(scriptfile);
-        if (tmpfile->IsOpened())
-        {
-            tmpfile->Write(scriptcontents);
-        }
-        tmpfile->Commit();
-
-        cmd.Printf(wxT("expect '%s' '%s'"), scriptfile, pw);
-        // run command synchronously this time, it shouldn't take long :)
-        wxArrayString arroutput = ArrRunCMDSync(cmd);
-        
-        // parse the output, look for information about available file encoding mechanisms
-        // and add them to map
-        bool startfound = false;
-        bool endfound = false;
-        wxArrayString rawCaps;
-        size_t count = arroutput.GetCount();
-        for ( size_t n = 0; n < count; n++ )
-        {
-            wxString thisline = arroutput[n];
-            if (!startfound)
-            {
-                if (thisline.Find("The following filename encoding algorithms are available") > -1)
-                {
-                    startfound = true;
-                }
-            }
-            else
-            {
-                if (thisline.Find(".") == -1)
-                {
-                    endfound = true;
-                }
-                else
-                {
-                    rawCaps.Add(thisline);
-                }
-            }
-            if (startfound && endfound)
-            {
-                break;
-            }
-        }
-
-        for (size_t n = 0; n < rawCaps.GetCount(); n++)
-        {
-            wxString rawline = rawCaps[n];
-            // Tokenize the string
-            wxStringTokenizer tokenizer(rawline, " ");
-            int tokenindex = 0;
-            wxString encodingnr="";
-            wxString encodingname="";
-            while ( tokenizer.HasMoreTokens() )
-            {
-                wxString thistoken = tokenizer.GetNextToken();
-                if (tokenindex == 0)
-                {
-                    thistoken.Replace(".","");
-                    encodingnr = thistoken;
-                }
-                else if (tokenindex == 1)
-                {
-                    encodingname = thistoken;
-                }
-                tokenindex++;
-            }
-            // save into map
-            if (!encodingnr.IsEmpty() && !encodingname.IsEmpty())
-            {
-                encodingcaps[encodingname] = encodingnr;
-            }
-        }
-
-        
-        // clean up again
-        tmpfile->Open(scriptfile);
-        if (tmpfile->IsOpened())
-        {
-            tmpfile->Write("#cleaned");
-        }
-        tmpfile->Commit();
-
-        if (dirEnc->Exists(enc_path))
-        {
-            dirEnc->Remove(enc_path, wxPATH_RMDIR_RECURSIVE);
-        }
-        if (dirPlain->Exists(plain_path))
-        {
-            dirPlain->Remove(plain_path, wxPATH_RMDIR_RECURSIVE);
-        }    
-    } 
-
-    // save/rewrite config
-    pConfig->SetPath(wxT("/FilenameEncoding"));
-    for (std::map<wxString, wxString>::iterator it= encodingcaps.begin(); it != encodingcaps.end(); it++)
-    {
-        wxString encodingname = it->first;
-        wxString encodingval = it->second;
-        pConfig->Write(encodingname, encodingval);
-    }
-    pConfig->Flush();
-    return encodingcaps;
-}
-
-
 void renameVolume(wxString& oldname, wxString& newname)
 {
     wxConfigBase *pConfig = wxConfigBase::Get();
@@ -666,6 +383,7 @@ void renameVolume(wxString& oldname, wxString& newname)
     bool passwordsaved = pConfig->ReadBool(wxT("passwordsaved"), 0l);
     bool allowother = pConfig->ReadBool(wxT("allowother"), 0l);
     bool mountaslocal = pConfig->ReadBool(wxT("mountaslocal"), 0l);
+    long idletimeout = pConfig->Read(wxT("idletimeout"), 0l);
     // delete old group
     pConfig->DeleteGroup(currentvol);
     // create a new one
@@ -677,6 +395,7 @@ void renameVolume(wxString& oldname, wxString& newname)
     pConfig->Write("passwordsaved", passwordsaved);
     pConfig->Write(wxT("allowother"),allowother);
     pConfig->Write(wxT("mountaslocal"),mountaslocal);            
+    pConfig->Write(wxT("idletimeout"),idletimeout);
     
     pConfig->Flush();
 }
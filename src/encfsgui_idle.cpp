@@ -0,0 +1,569 @@
+/*
+    encFSGui - encfsgui_idle.cpp
+    source file contains the idle auto-unmount
+    encfs --idle does the job when the installed encfs supports it,
+    IdleWatcherThread tracks access to the mount points otherwise
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/thread.h>
+#include <wx/time.h>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <string>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <limits.h>
+
+#if defined(__linux__)
+    #include <dirent.h>
+    #include <sys/inotify.h>
+    #define ENCFSGUI_IDLE_INOTIFY 1
+#endif
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+// resolution of the idle timeouts
+#define IDLE_TICK_SECONDS 15
+
+// slots in the timer wheel, one tick each
+// longer timeouts go around more than once
+#define IDLE_WHEEL_SLOTS 256
+
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+// anything that touches a watched folder of the volume counts as access
+#define IDLE_WATCH_MASK (IN_ACCESS | IN_MODIFY | IN_ATTRIB | IN_OPEN | IN_CLOSE | \
+                         IN_CREATE | IN_DELETE | IN_MOVE)
+#endif
+
+// subfolders get a watch of their own when they are created or opened,
+// up to this many per volume (inotify watches are a per-user limit)
+#define IDLE_MAX_SUBWATCHES 256
+
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+
+// symlink in /proc pointing at, or below, the mount point
+static bool isLinkBelow(const std::string& linkpath, const std::string& mountpath)
+{
+    char target[PATH_MAX];
+    ssize_t len = readlink(linkpath.c_str(), target, sizeof(target) - 1);
+    if (len <= 0)
+    {
+        return false;
+    }
+    std::string path(target, len);
+    return (path == mountpath || path.compare(0, mountpath.size() + 1, mountpath + "/") == 0);
+}
+
+#endif
+
+
+// second opinion before unmounting, for folders we didn't get to watch:
+// does a process have its working directory, or a file open, below the mount point ?
+// only our own processes can be checked, which is everybody without allow_other
+static bool isMountInUse(const wxString& mountpath)
+{
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+    std::string normalized(MountSnapshot::NormalizePath(mountpath).fn_str());
+    DIR *proc = opendir("/proc");
+    if (!proc)
+    {
+        return false;
+    }
+    bool inuse = false;
+    struct dirent *procentry;
+    while (!inuse && (procentry = readdir(proc)) != NULL)
+    {
+        if (procentry->d_name[0] < '0' || procentry->d_name[0] > '9')
+        {
+            continue;
+        }
+        std::string piddir = std::string("/proc/") + procentry->d_name;
+        inuse = isLinkBelow(piddir + "/cwd", normalized);
+        DIR *fds = inuse ? NULL : opendir((piddir + "/fd").c_str());
+        if (!fds)
+        {
+            continue;
+        }
+        struct dirent *fdentry;
+        while (!inuse && (fdentry = readdir(fds)) != NULL)
+        {
+            if (fdentry->d_name[0] != '.')
+            {
+                inuse = isLinkBelow(piddir + "/fd/" + fdentry->d_name, normalized);
+            }
+        }
+        closedir(fds);
+    }
+    closedir(proc);
+    return inuse;
+#else
+    (void)mountpath;
+    return false;
+#endif
+}
+
+
+// ----------------------------------------------------------------------------
+// IdleWatcherThread member functions
+// ----------------------------------------------------------------------------
+
+IdleWatcherThread::IdleWatcherThread(wxEvtHandler *handler, int eventid) : wxThread(wxTHREAD_JOINABLE)
+{
+    m_handler = handler;
+    m_eventid = eventid;
+    m_stop = false;
+    m_watchedChanged = false;
+    m_inotifyfd = -1;
+    m_tick = 0;
+    m_wheel.resize(IDLE_WHEEL_SLOTS);
+    // wakes up the thread when the volumes changed or it needs to stop
+    // non-blocking, so nobody hangs on it if the thread is not reading
+    if (pipe(m_wakeupPipe) != 0)
+    {
+        m_wakeupPipe[0] = -1;
+        m_wakeupPipe[1] = -1;
+    }
+    else
+    {
+        fcntl(m_wakeupPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(m_wakeupPipe[1], F_SETFL, O_NONBLOCK);
+    }
+}
+
+// no event loop to post to, report through a callback instead
+IdleWatcherThread::IdleWatcherThread(const VolumeIdleCallback& callback) : IdleWatcherThread(NULL, 0)
+{
+    m_callback = callback;
+}
+
+// destructor
+IdleWatcherThread::~IdleWatcherThread()
+{
+    if (m_wakeupPipe[0] > -1)
+    {
+        close(m_wakeupPipe[0]);
+        close(m_wakeupPipe[1]);
+    }
+}
+
+
+// called from the main thread after the volumes or their mount states changed
+// only mounted volumes with an idle timeout that encfs doesn't handle are tracked
+void IdleWatcherThread::SetWatchedVolumes(const VolumeMap& volumedata)
+{
+    std::map<wxString, std::pair<wxString, long> > watched;
+    bool nativeidle = false;
+    bool nativechecked = false;
+    for (VolumeMap::const_iterator it = volumedata.begin(); it != volumedata.end(); it++)
+    {
+        DBEntry *thisvol = it->second.get();
+        if (!thisvol || !thisvol->getMountState() || thisvol->getIdleTimeout() <= 0)
+        {
+            continue;
+        }
+        if (!nativechecked)
+        {
+            nativeidle = encfsSupportsIdle();
+            nativechecked = true;
+        }
+        if (nativeidle)
+        {
+            break;
+        }
+        watched[it->first] = std::make_pair(thisvol->getMountPath(), thisvol->getIdleTimeout());
+    }
+    if (nativeidle)
+    {
+        watched.clear();
+    }
+
+    {
+        wxCriticalSectionLocker lock(m_watchedCS);
+        if (watched == m_watched)
+        {
+            return;
+        }
+        m_watched.swap(watched);
+        m_watchedChanged = true;
+    }
+    if (m_wakeupPipe[1] > -1)
+    {
+        char wakeupbyte = 'u';
+        ssize_t written = write(m_wakeupPipe[1], &wakeupbyte, 1);
+        (void)written;
+    }
+}
+
+
+void IdleWatcherThread::RequestStop()
+{
+    {
+        wxCriticalSectionLocker lock(m_watchedCS);
+        m_stop = true;
+    }
+    if (m_wakeupPipe[1] > -1)
+    {
+        char stopbyte = 'x';
+        ssize_t written = write(m_wakeupPipe[1], &stopbyte, 1);
+        (void)written;
+    }
+}
+
+
+// put a volume in the slot of its deadline
+void IdleWatcherThread::Schedule(const wxString& volumename, IdleVolume& vol, long due)
+{
+    if (due <= m_tick)
+    {
+        due = m_tick + 1;
+    }
+    vol.due = due;
+    m_wheel[due % IDLE_WHEEL_SLOTS].push_back(volumename);
+}
+
+
+// start and stop tracking, to match what the main thread handed over
+void IdleWatcherThread::ApplyWatchedVolumes()
+{
+    std::map<wxString, std::pair<wxString, long> > watched;
+    {
+        wxCriticalSectionLocker lock(m_watchedCS);
+        if (!m_watchedChanged)
+        {
+            return;
+        }
+        watched = m_watched;
+        m_watchedChanged = false;
+    }
+
+    // unmounted, removed, or moved: stop watching
+    // names left behind in the wheel are skipped when their slot comes up
+    std::map<wxString, IdleVolume>::iterator it = m_volumes.begin();
+    while (it != m_volumes.end())
+    {
+        std::map<wxString, std::pair<wxString, long> >::iterator found = watched.find(it->first);
+        if (found == watched.end() || found->second.first != it->second.mountpath)
+        {
+            RemoveWatches(it->second);
+            m_volumes.erase(it++);
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    for (std::map<wxString, std::pair<wxString, long> >::iterator w = watched.begin(); w != watched.end(); w++)
+    {
+        long timeoutticks = w->second.second * 60 / IDLE_TICK_SECONDS;
+        std::map<wxString, IdleVolume>::iterator existing = m_volumes.find(w->first);
+        if (existing != m_volumes.end())
+        {
+            // a new timeout takes effect when the current deadline comes up
+            existing->second.timeoutticks = timeoutticks;
+            continue;
+        }
+
+        IdleVolume vol;
+        vol.mountpath = w->second.first;
+        vol.timeoutticks = timeoutticks;
+        vol.lastaccess = m_tick;
+        vol.due = 0;
+        vol.wd = -1;
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+        vol.wd = inotify_add_watch(m_inotifyfd, vol.mountpath.fn_str(), IDLE_WATCH_MASK);
+#endif
+        if (vol.wd < 0)
+        {
+            // without access information it would get unmounted while in use
+            wxLogDebug(wxT("IdleWatcherThread: unable to watch '%s'"), vol.mountpath);
+            continue;
+        }
+        m_watches[vol.wd].volumename = w->first;
+        m_watches[vol.wd].path = vol.mountpath;
+        IdleVolume& added = (m_volumes[w->first] = vol);
+        Schedule(w->first, added, m_tick + timeoutticks);
+    }
+}
+
+
+// watch a subfolder of a volume as well, unless it has enough of them already
+// a folder that was moved afterwards keeps its old path here, so watches
+// below it just fail to get added, and isMountInUse() covers for them
+void IdleWatcherThread::AddSubWatch(const wxString& volumename, IdleVolume& vol, const wxString& path)
+{
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+    if (vol.subwatches.size() >= IDLE_MAX_SUBWATCHES)
+    {
+        return;
+    }
+    int wd = inotify_add_watch(m_inotifyfd, path.fn_str(), IDLE_WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0 || m_watches.find(wd) != m_watches.end())
+    {
+        // gone already, or watched already
+        return;
+    }
+    vol.subwatches.insert(wd);
+    m_watches[wd].volumename = volumename;
+    m_watches[wd].path = path;
+#else
+    (void)volumename;
+    (void)vol;
+    (void)path;
+#endif
+}
+
+
+void IdleWatcherThread::RemoveWatches(IdleVolume& vol)
+{
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+    if (vol.wd > -1)
+    {
+        inotify_rm_watch(m_inotifyfd, vol.wd);
+        m_watches.erase(vol.wd);
+        vol.wd = -1;
+    }
+    for (std::set<int>::iterator it = vol.subwatches.begin(); it != vol.subwatches.end(); it++)
+    {
+        inotify_rm_watch(m_inotifyfd, *it);
+        m_watches.erase(*it);
+    }
+#endif
+    vol.subwatches.clear();
+}
+
+
+// only remember when the volume was used, the deadline is checked when its slot comes up
+void IdleWatcherThread::ReadAccessEvents()
+{
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(m_inotifyfd, buf, sizeof(buf))) > 0)
+    {
+        for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+            std::map<int, IdleWatch>::iterator watch = m_watches.find(event->wd);
+            if (watch == m_watches.end())
+            {
+                continue;
+            }
+            std::map<wxString, IdleVolume>::iterator it = m_volumes.find(watch->second.volumename);
+            if (event->mask & IN_IGNORED)
+            {
+                if (it != m_volumes.end() && it->second.wd == event->wd)
+                {
+                    // unmounted, the kernel dropped the watch
+                    it->second.wd = -1;
+                    RemoveWatches(it->second);
+                    m_volumes.erase(it);
+                }
+                else if (it != m_volumes.end())
+                {
+                    // subfolder removed
+                    it->second.subwatches.erase(event->wd);
+                }
+                m_watches.erase(event->wd);
+            }
+            else if (it != m_volumes.end())
+            {
+                it->second.lastaccess = m_tick;
+                // a subfolder got created or opened, follow it down
+                if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_OPEN | IN_MOVED_TO)) && event->len > 0)
+                {
+                    AddSubWatch(it->first, it->second, watch->second.path + "/" + wxString::FromUTF8(event->name));
+                }
+            }
+        }
+    }
+#endif
+}
+
+
+// advance the wheel by one slot, and handle the volumes that are due
+void IdleWatcherThread::Tick()
+{
+    m_tick++;
+    std::vector<wxString> slot;
+    slot.swap(m_wheel[m_tick % IDLE_WHEEL_SLOTS]);
+
+    std::set<wxString> handled;
+    for (size_t i = 0; i < slot.size(); i++)
+    {
+        const wxString& volumename = slot[i];
+        std::map<wxString, IdleVolume>::iterator it = m_volumes.find(volumename);
+        if (it == m_volumes.end() || !handled.insert(volumename).second)
+        {
+            // no longer watched, or in here twice
+            continue;
+        }
+        IdleVolume& vol = it->second;
+        if (vol.due > m_tick)
+        {
+            // due in a later round of the wheel, or moved to another slot
+            if (vol.due % IDLE_WHEEL_SLOTS == m_tick % IDLE_WHEEL_SLOTS)
+            {
+                m_wheel[m_tick % IDLE_WHEEL_SLOTS].push_back(volumename);
+            }
+            continue;
+        }
+
+        long deadline = vol.lastaccess + vol.timeoutticks;
+        if (deadline > m_tick)
+        {
+            // used since it was scheduled
+            Schedule(volumename, vol, deadline);
+            continue;
+        }
+        if (isMountInUse(vol.mountpath))
+        {
+            // quiet, but something still sits in there
+            vol.lastaccess = m_tick;
+            Schedule(volumename, vol, m_tick + vol.timeoutticks);
+            continue;
+        }
+
+        VolumeIdle(volumename);
+        // stays watched until it is really gone, if the unmount
+        // didn't work out (busy), try again after another idle period
+        vol.lastaccess = m_tick;
+        Schedule(volumename, vol, m_tick + vol.timeoutticks);
+    }
+}
+
+
+void IdleWatcherThread::VolumeIdle(const wxString& volumename)
+{
+    if (m_callback)
+    {
+        m_callback(volumename);
+        return;
+    }
+    wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, m_eventid);
+    event->SetString(volumename);
+    wxQueueEvent(m_handler, event);
+}
+
+
+wxThread::ExitCode IdleWatcherThread::Entry()
+{
+    if (m_wakeupPipe[0] < 0)
+    {
+        return (wxThread::ExitCode)1;
+    }
+
+#if defined(ENCFSGUI_IDLE_INOTIFY)
+
+    m_inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyfd < 0)
+    {
+        return (wxThread::ExitCode)1;
+    }
+
+    wxLongLong nexttick = wxGetLocalTimeMillis() + IDLE_TICK_SECONDS * 1000;
+    bool keepgoing = true;
+    while (keepgoing)
+    {
+        // nothing to track = nothing to wake up for
+        int timeout = -1;
+        if (!m_volumes.empty())
+        {
+            wxLongLong remaining = nexttick - wxGetLocalTimeMillis();
+            timeout = (remaining > 0) ? remaining.ToLong() : 0;
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = m_inotifyfd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = m_wakeupPipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        int rc = poll(fds, 2, timeout);
+        if (rc < 0)
+        {
+            keepgoing = (errno == EINTR);
+            continue;
+        }
+        if (fds[1].revents)
+        {
+            char buf[64];
+            while (read(m_wakeupPipe[0], buf, sizeof(buf)) > 0)
+            {
+            }
+            {
+                wxCriticalSectionLocker lock(m_watchedCS);
+                keepgoing = !m_stop;
+            }
+            bool wasempty = m_volumes.empty();
+            ApplyWatchedVolumes();
+            if (wasempty)
+            {
+                nexttick = wxGetLocalTimeMillis() + IDLE_TICK_SECONDS * 1000;
+            }
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            ReadAccessEvents();
+        }
+        if (!m_volumes.empty() && wxGetLocalTimeMillis() >= nexttick)
+        {
+            Tick();
+            nexttick += IDLE_TICK_SECONDS * 1000;
+        }
+    }
+
+    close(m_inotifyfd);
+    m_inotifyfd = -1;
+
+#else
+
+    // no inotify (OSX), encfs --idle is all we have
+
+#endif
+
+    return (wxThread::ExitCode)0;
+}
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+// minutes to pass to encfs --idle, 0 if encfs can't do it
+// (IdleWatcherThread takes care of those), main thread only
+long getEncFSIdleMinutes(DBEntry *thisvol)
+{
+    long idletimeout = thisvol->getIdleTimeout();
+    if (idletimeout > 0 && encfsSupportsIdle())
+    {
+        return idletimeout;
+    }
+    return 0;
+}
@@ -0,0 +1,430 @@
+/*
+    encFSGui - encfsgui_metrics.cpp
+    source file contains the mount metrics, fed by the mount engine
+    and the command runner, written out as a JSON file and as a
+    node_exporter textfile
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/config.h>
+#include <wx/file.h>
+#include <wx/thread.h>
+#include <wx/time.h>
+#include <map>
+
+#include <unistd.h>
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// constants & globals
+// ----------------------------------------------------------------------------
+
+// failure reasons, see recordMountMetrics() / recordUnmountMetrics()
+enum
+{
+    METRICS_FAIL_PASSWORD,
+    METRICS_FAIL_OTHER,
+    METRICS_FAIL_TIMEOUT,
+    METRICS_FAIL_COUNT
+};
+
+static const char * const g_failReasons[METRICS_FAIL_COUNT] = { "password", "other", "timeout" };
+
+struct VolumeMetrics
+{
+    VolumeMetrics()
+    {
+        lastmountms = -1;
+        lastunmountms = -1;
+        mounts = 0;
+        unmounts = 0;
+        for (int i = 0; i < METRICS_FAIL_COUNT; i++)
+        {
+            mountfailures[i] = 0;
+            unmountfailures[i] = 0;
+        }
+    }
+
+    long lastmountms;           // -1 = never
+    long lastunmountms;
+    unsigned long mounts;
+    unsigned long unmounts;
+    unsigned long mountfailures[METRICS_FAIL_COUNT];
+    unsigned long unmountfailures[METRICS_FAIL_COUNT];
+};
+
+struct CommandMetrics
+{
+    CommandMetrics()
+    {
+        runs = 0;
+        failures = 0;
+        timeouts = 0;
+        lastms = 0;
+        maxms = 0;
+        totalms = 0;
+    }
+
+    unsigned long runs;
+    unsigned long failures;     // couldn't start, or non-zero exit code
+    unsigned long timeouts;
+    long lastms;
+    long maxms;
+    wxLongLong totalms;
+};
+
+// recorded from worker threads, written from the GUI (or daemon) thread
+static wxCriticalSection g_metricsCS;
+static std::map<wxString, VolumeMetrics> g_volumeMetrics;      // volume name -> metrics
+static std::map<wxString, CommandMetrics> g_commandMetrics;    // binary name -> metrics
+static unsigned long g_refreshes = 0;
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+// prometheus label value
+static wxString toLabelValue(const wxString& value)
+{
+    wxString escaped = value;
+    escaped.Replace("\\", "\\\\");
+    escaped.Replace("\"", "\\\"");
+    escaped.Replace("\n", "\\n");
+    return "\"" + escaped + "\"";
+}
+
+static wxString toSeconds(long ms)
+{
+    return wxString::Format(wxT("%ld.%03ld"), ms / 1000, ms % 1000);
+}
+
+// write to a temp file next to it and rename, readers never see half a file
+static bool replaceFile(const wxString& filename, const wxString& contents)
+{
+    wxString tmpname = wxString::Format(wxT("%s.tmp.%ld"), filename, (long)getpid());
+    wxFile tmpfile;
+    if (!tmpfile.Create(tmpname, true, wxS_DEFAULT))
+    {
+        return false;
+    }
+    wxScopedCharBuffer data = contents.utf8_str();
+    bool written = (tmpfile.Write(data.data(), data.length()) == data.length());
+    written = tmpfile.Flush() && written;
+    tmpfile.Close();
+    if (!written || rename(tmpname.utf8_str(), filename.utf8_str()) != 0)
+    {
+        wxRemoveFile(tmpname);
+        return false;
+    }
+    return true;
+}
+
+static wxString getJSONMetrics(const VolumeMap& volumedata, wxLongLong now)
+{
+    wxString output = "{\n";
+    output << "  \"timestamp\": " << (now / 1000).ToString() << ",\n";
+    output << "  \"pid\": " << (long)getpid() << ",\n";
+    output << "  \"refreshes\": " << g_refreshes << ",\n";
+
+    output << "  \"volumes\": [";
+    bool first = true;
+    for (VolumeMap::const_iterator it = volumedata.begin(); it != volumedata.end(); it++)
+    {
+        if (!it->second)
+        {
+            continue;
+        }
+        VolumeMetrics metrics;
+        std::map<wxString, VolumeMetrics>::const_iterator found = g_volumeMetrics.find(it->first);
+        if (found != g_volumeMetrics.end())
+        {
+            metrics = found->second;
+        }
+        output << (first ? "\n" : ",\n");
+        first = false;
+        output << "    {\"name\": " << toJSONString(it->first);
+        output << ", \"mounted\": " << (it->second->getMountState() ? "true" : "false");
+        output << ", \"mounts\": " << metrics.mounts;
+        output << ", \"unmounts\": " << metrics.unmounts;
+        output << ", \"last_mount_ms\": ";
+        if (metrics.lastmountms < 0)
+        {
+            output << "null";
+        }
+        else
+        {
+            output << metrics.lastmountms;
+        }
+        output << ", \"last_unmount_ms\": ";
+        if (metrics.lastunmountms < 0)
+        {
+            output << "null";
+        }
+        else
+        {
+            output << metrics.lastunmountms;
+        }
+        output << ", \"mount_failures\": {";
+        for (int i = 0; i < METRICS_FAIL_COUNT; i++)
+        {
+            output << (i > 0 ? ", " : "") << "\"" << g_failReasons[i] << "\": " << metrics.mountfailures[i];
+        }
+        output << "}, \"unmount_failures\": {";
+        for (int i = 0; i < METRICS_FAIL_COUNT; i++)
+        {
+            output << (i > 0 ? ", " : "") << "\"" << g_failReasons[i] << "\": " << metrics.unmountfailures[i];
+        }
+        output << "}}";
+    }
+    output << (first ? "],\n" : "\n  ],\n");
+
+    output << "  \"commands\": [";
+    first = true;
+    for (std::map<wxString, CommandMetrics>::const_iterator it = g_commandMetrics.begin(); it != g_commandMetrics.end(); it++)
+    {
+        const CommandMetrics& metrics = it->second;
+        output << (first ? "\n" : ",\n");
+        first = false;
+        output << "    {\"command\": " << toJSONString(it->first);
+        output << ", \"runs\": " << metrics.runs;
+        output << ", \"failures\": " << metrics.failures;
+        output << ", \"timeouts\": " << metrics.timeouts;
+        output << ", \"last_ms\": " << metrics.lastms;
+        output << ", \"max_ms\": " << metrics.maxms;
+        output << ", \"total_ms\": " << metrics.totalms.ToString() << "}";
+    }
+    output << (first ? "]\n" : "\n  ]\n");
+    output << "}\n";
+    return output;
+}
+
+static wxString getPrometheusMetrics(const VolumeMap& volumedata, wxLongLong now)
+{
+    wxString output;
+
+    output << "# HELP encfsgui_volume_mounted Whether the volume is mounted.\n";
+    output << "# TYPE encfsgui_volume_mounted gauge\n";
+    for (VolumeMap::const_iterator it = volumedata.begin(); it != volumedata.end(); it++)
+    {
+        if (it->second)
+        {
+            output << "encfsgui_volume_mounted{volume=" << toLabelValue(it->first) << "} "
+                   << (it->second->getMountState() ? 1 : 0) << "\n";
+        }
+    }
+
+    output << "# HELP encfsgui_volume_last_mount_seconds Duration of the last successful mount.\n";
+    output << "# TYPE encfsgui_volume_last_mount_seconds gauge\n";
+    for (std::map<wxString, VolumeMetrics>::const_iterator it = g_volumeMetrics.begin(); it != g_volumeMetrics.end(); it++)
+    {
+        if (it->second.lastmountms > -1)
+        {
+            output << "encfsgui_volume_last_mount_seconds{volume=" << toLabelValue(it->first) << "} "
+                   << toSeconds(it->second.lastmountms) << "\n";
+        }
+    }
+    output << "# HELP encfsgui_volume_last_unmount_seconds Duration of the last successful unmount.\n";
+    output << "# TYPE encfsgui_volume_last_unmount_seconds gauge\n";
+    for (std::map<wxString, VolumeMetrics>::const_iterator it = g_volumeMetrics.begin(); it != g_volumeMetrics.end(); it++)
+    {
+        if (it->second.lastunmountms > -1)
+        {
+            output << "encfsgui_volume_last_unmount_seconds{volume=" << toLabelValue(it->first) << "} "
+                   << toSeconds(it->second.lastunmountms) << "\n";
+        }
+    }
+
+    output << "# HELP encfsgui_mounts_total Successful mounts.\n";
+    output << "# TYPE encfsgui_mounts_total counter\n";
+    for (std::map<wxString, VolumeMetrics>::const_iterator it = g_volumeMetrics.begin(); it != g_volumeMetrics.end(); it++)
+    {
+        output << "encfsgui_mounts_total{volume=" << toLabelValue(it->first) << "} " << it->second.mounts << "\n";
+    }
+    output << "# HELP encfsgui_unmounts_total Successful unmounts.\n";
+    output << "# TYPE encfsgui_unmounts_total counter\n";
+    for (std::map<wxString, VolumeMetrics>::const_iterator it = g_volumeMetrics.begin(); it != g_volumeMetrics.end(); it++)
+    {
+        output << "encfsgui_unmounts_total{volume=" << toLabelValue(it->first) << "} " << it->second.unmounts << "\n";
+    }
+
+    output << "# HELP encfsgui_mount_failures_total Failed mounts, by reason.\n";
+    output << "# TYPE encfsgui_mount_failures_total counter\n";
+    for (std::map<wxString, VolumeMetrics>::const_iterator it = g_volumeMetrics.begin(); it != g_volumeMetrics.end(); it++)
+    {
+        for (int i = 0; i < METRICS_FAIL_COUNT; i++)
+        {
+            output << "encfsgui_mount_failures_total{volume=" << toLabelValue(it->first)
+                   << ",reason=\"" << g_failReasons[i] << "\"} " << it->second.mountfailures[i] << "\n";
+        }
+    }
+    output << "# HELP encfsgui_unmount_failures_total Failed unmounts, by reason.\n";
+    output << "# TYPE encfsgui_unmount_failures_total counter\n";
+    for (std::map<wxString, VolumeMetrics>::const_iterator it = g_volumeMetrics.begin(); it != g_volumeMetrics.end(); it++)
+    {
+        for (int i = METRICS_FAIL_OTHER; i < METRICS_FAIL_COUNT; i++)
+        {
+            output << "encfsgui_unmount_failures_total{volume=" << toLabelValue(it->first)
+                   << ",reason=\"" << g_failReasons[i] << "\"} " << it->second.unmountfailures[i] << "\n";
+        }
+    }
+
+    output << "# HELP encfsgui_command_duration_seconds Run time of external commands.\n";
+    output << "# TYPE encfsgui_command_duration_seconds summary\n";
+    for (std::map<wxString, CommandMetrics>::const_iterator it = g_commandMetrics.begin(); it != g_commandMetrics.end(); it++)
+    {
+        wxString label = "{command=" + toLabelValue(it->first) + "}";
+        output << "encfsgui_command_duration_seconds_sum" << label << " " << toSeconds(it->second.totalms.ToLong()) << "\n";
+        output << "encfsgui_command_duration_seconds_count" << label << " " << it->second.runs << "\n";
+    }
+    output << "# HELP encfsgui_command_last_duration_seconds Run time of the last run of an external command.\n";
+    output << "# TYPE encfsgui_command_last_duration_seconds gauge\n";
+    for (std::map<wxString, CommandMetrics>::const_iterator it = g_commandMetrics.begin(); it != g_commandMetrics.end(); it++)
+    {
+        output << "encfsgui_command_last_duration_seconds{command=" << toLabelValue(it->first) << "} "
+               << toSeconds(it->second.lastms) << "\n";
+    }
+    output << "# HELP encfsgui_command_max_duration_seconds Longest run of an external command.\n";
+    output << "# TYPE encfsgui_command_max_duration_seconds gauge\n";
+    for (std::map<wxString, CommandMetrics>::const_iterator it = g_commandMetrics.begin(); it != g_commandMetrics.end(); it++)
+    {
+        output << "encfsgui_command_max_duration_seconds{command=" << toLabelValue(it->first) << "} "
+               << toSeconds(it->second.maxms) << "\n";
+    }
+    output << "# HELP encfsgui_command_failures_total External commands that failed to start or exited non-zero.\n";
+    output << "# TYPE encfsgui_command_failures_total counter\n";
+    for (std::map<wxString, CommandMetrics>::const_iterator it = g_commandMetrics.begin(); it != g_commandMetrics.end(); it++)
+    {
+        output << "encfsgui_command_failures_total{command=" << toLabelValue(it->first) << "} " << it->second.failures << "\n";
+    }
+    output << "# HELP encfsgui_command_timeouts_total External commands that were killed after a timeout.\n";
+    output << "# TYPE encfsgui_command_timeouts_total counter\n";
+    for (std::map<wxString, CommandMetrics>::const_iterator it = g_commandMetrics.begin(); it != g_commandMetrics.end(); it++)
+    {
+        output << "encfsgui_command_timeouts_total{command=" << toLabelValue(it->first) << "} " << it->second.timeouts << "\n";
+    }
+
+    output << "# HELP encfsgui_refreshes_total Volume list and mount state refreshes.\n";
+    output << "# TYPE encfsgui_refreshes_total counter\n";
+    output << "encfsgui_refreshes_total " << g_refreshes << "\n";
+    output << "# HELP encfsgui_metrics_timestamp_seconds When this file was written.\n";
+    output << "# TYPE encfsgui_metrics_timestamp_seconds gauge\n";
+    output << "encfsgui_metrics_timestamp_seconds " << (now / 1000).ToString() << "\n";
+    return output;
+}
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+// mountstatus is one of ID_MNT_*, timedout = encfs or the mount point took too long
+void recordMountMetrics(const wxString& volumename, int mountstatus, bool timedout, long durationms)
+{
+    wxCriticalSectionLocker lock(g_metricsCS);
+    VolumeMetrics& metrics = g_volumeMetrics[volumename];
+    if (mountstatus == ID_MNT_OK)
+    {
+        metrics.mounts++;
+        metrics.lastmountms = durationms;
+    }
+    else if (mountstatus == ID_MNT_PWDFAIL)
+    {
+        metrics.mountfailures[METRICS_FAIL_PASSWORD]++;
+    }
+    else
+    {
+        metrics.mountfailures[timedout ? METRICS_FAIL_TIMEOUT : METRICS_FAIL_OTHER]++;
+    }
+}
+
+void recordUnmountMetrics(const wxString& volumename, bool unmounted, bool timedout, long durationms)
+{
+    wxCriticalSectionLocker lock(g_metricsCS);
+    VolumeMetrics& metrics = g_volumeMetrics[volumename];
+    if (unmounted)
+    {
+        metrics.unmounts++;
+        metrics.lastunmountms = durationms;
+    }
+    else
+    {
+        metrics.unmountfailures[timedout ? METRICS_FAIL_TIMEOUT : METRICS_FAIL_OTHER]++;
+    }
+}
+
+// every finished external command, keyed by the name of the binary
+void recordCommandMetrics(const wxString& command, const CmdResult& result)
+{
+    wxString binary = command.AfterLast('/');
+    wxCriticalSectionLocker lock(g_metricsCS);
+    CommandMetrics& metrics = g_commandMetrics[binary];
+    metrics.runs++;
+    metrics.lastms = result.durationms;
+    metrics.totalms += result.durationms;
+    if (result.durationms > metrics.maxms)
+    {
+        metrics.maxms = result.durationms;
+    }
+    if (result.timedout)
+    {
+        metrics.timeouts++;
+    }
+    else if (result.spawnfailed || result.exitcode != 0)
+    {
+        metrics.failures++;
+    }
+}
+
+void recordRefreshMetrics()
+{
+    wxCriticalSectionLocker lock(g_metricsCS);
+    g_refreshes++;
+}
+
+// write both outputs, if configured (/Config/metricsjson, /Config/metricstextfile)
+void writeMetrics(const VolumeMap& volumedata)
+{
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    wxString jsonfile = pConfig->Read(wxT("metricsjson"), "");
+    wxString textfile = pConfig->Read(wxT("metricstextfile"), "");
+    if (jsonfile.IsEmpty() && textfile.IsEmpty())
+    {
+        return;
+    }
+
+    wxLongLong now = wxGetUTCTimeMillis();
+    wxString jsonoutput;
+    wxString textoutput;
+    {
+        wxCriticalSectionLocker lock(g_metricsCS);
+        if (!jsonfile.IsEmpty())
+        {
+            jsonoutput = getJSONMetrics(volumedata, now);
+        }
+        if (!textfile.IsEmpty())
+        {
+            textoutput = getPrometheusMetrics(volumedata, now);
+        }
+    }
+
+    if (!jsonfile.IsEmpty() && !replaceFile(jsonfile, jsonoutput))
+    {
+        wxLogDebug(wxT("writeMetrics: unable to write '%s'"), jsonfile);
+    }
+    if (!textfile.IsEmpty() && !replaceFile(textfile, textoutput))
+    {
+        wxLogDebug(wxT("writeMetrics: unable to write '%s'"), textfile);
+    }
+}
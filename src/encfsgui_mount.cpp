@@ -0,0 +1,634 @@
+/*
+    encFSGui - encfsgui_mount.cpp
+    source file contains code to read the system mount table
+    without having to run the 'mount' binary
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/config.h>
+#include <wx/thread.h>
+#include <wx/utils.h>       // wxMilliSleep
+#include <wx/time.h>        // wxGetLocalTimeMillis
+#include <vector>
+#include <fstream>
+#include <string>
+#include <string.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    #include <sys/param.h>
+    #include <sys/ucred.h>
+    #include <sys/mount.h>
+    #include <sys/event.h>
+    #define ENCFSGUI_MOUNTTABLE_GETFSSTAT 1
+#elif defined(__linux__)
+    #include <poll.h>
+    #include <sys/vfs.h>
+    #define ENCFSGUI_MOUNTTABLE_PROCFS 1
+    #define FUSE_SUPER_MAGIC 0x65735546
+#endif
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// MountEntry member functions
+// ----------------------------------------------------------------------------
+
+// encfs shows up as "encfs@osxfuse0" (source) on OSX
+// and as "fuse.encfs" (type) or "encfs" (source) on Linux
+bool MountEntry::isEncFS() const
+{
+    return (fstype.Find("encfs") > -1 || source.Find("encfs") > -1);
+}
+
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+#ifdef ENCFSGUI_MOUNTTABLE_PROCFS
+
+// mountinfo escapes space, tab, newline and backslash as \ooo
+static std::string unescapeMountInfoField(const std::string & field)
+{
+    std::string result;
+    result.reserve(field.size());
+    for (size_t i = 0; i < field.size(); i++)
+    {
+        if (field[i] == '\\' && i + 3 < field.size() &&
+            field[i+1] >= '0' && field[i+1] <= '7' &&
+            field[i+2] >= '0' && field[i+2] <= '7' &&
+            field[i+3] >= '0' && field[i+3] <= '7')
+        {
+            char c = (char)(((field[i+1] - '0') << 6) | ((field[i+2] - '0') << 3) | (field[i+3] - '0'));
+            result += c;
+            i += 3;
+        }
+        else
+        {
+            result += field[i];
+        }
+    }
+    return result;
+}
+
+
+// parse a single line of /proc/self/mountinfo
+// 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+static bool parseMountInfoLine(const std::string & line, MountEntry & entry)
+{
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    while (pos < line.size())
+    {
+        size_t next = line.find(' ', pos);
+        if (next == std::string::npos)
+        {
+            next = line.size();
+        }
+        if (next > pos)
+        {
+            fields.push_back(line.substr(pos, next - pos));
+        }
+        pos = next + 1;
+    }
+
+    // find the separator between the optional fields and the fs specific part
+    size_t sep = 0;
+    for (size_t n = 6; n < fields.size(); n++)
+    {
+        if (fields[n] == "-")
+        {
+            sep = n;
+            break;
+        }
+    }
+    if (sep == 0 || sep + 2 >= fields.size())
+    {
+        return false;
+    }
+
+    entry.mountpoint = wxString::FromUTF8(unescapeMountInfoField(fields[4]).c_str());
+    entry.options = wxString::FromUTF8(fields[5].c_str());
+    entry.fstype = wxString::FromUTF8(fields[sep + 1].c_str());
+    entry.source = wxString::FromUTF8(unescapeMountInfoField(fields[sep + 2]).c_str());
+    return true;
+}
+
+#endif
+
+
+#ifdef ENCFSGUI_MOUNTTABLE_GETFSSTAT
+
+// turn the most relevant mount flags back into an option string
+static wxString mountFlagsToOptions(uint64_t flags)
+{
+    wxString options = (flags & MNT_RDONLY) ? "ro" : "rw";
+    if (flags & MNT_NOSUID)
+    {
+        options << ",nosuid";
+    }
+    if (flags & MNT_NODEV)
+    {
+        options << ",nodev";
+    }
+    if (flags & MNT_SYNCHRONOUS)
+    {
+        options << ",synchronous";
+    }
+    if (flags & MNT_LOCAL)
+    {
+        options << ",local";
+    }
+    return options;
+}
+
+#endif
+
+
+// read the mount table directly from the kernel
+// returns false if there is no native way to do so on this platform
+bool readNativeMountTable(MountTable & mounttable)
+{
+    mounttable.clear();
+
+#if defined(ENCFSGUI_MOUNTTABLE_PROCFS)
+
+    std::ifstream mountinfo("/proc/self/mountinfo");
+    if (!mountinfo.is_open())
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(mountinfo, line))
+    {
+        MountEntry entry;
+        if (parseMountInfoLine(line, entry))
+        {
+            // later entries are stacked on top of earlier ones
+            mounttable[entry.mountpoint] = entry;
+        }
+    }
+    return true;
+
+#elif defined(ENCFSGUI_MOUNTTABLE_GETFSSTAT)
+
+    // getfsstat fills our own buffer, so unlike getmntinfo() it is safe
+    // to call from a background thread.  Add some slack in case
+    // something gets mounted between both calls
+    int nrmounts = getfsstat(NULL, 0, MNT_NOWAIT);
+    if (nrmounts < 0)
+    {
+        return false;
+    }
+    std::vector<struct statfs> mounts(nrmounts + 16);
+    nrmounts = getfsstat(&mounts[0], (int)(mounts.size() * sizeof(struct statfs)), MNT_NOWAIT);
+    if (nrmounts < 0)
+    {
+        return false;
+    }
+    for (int i = 0; i < nrmounts; i++)
+    {
+        MountEntry entry;
+        entry.mountpoint = wxString::FromUTF8(mounts[i].f_mntonname);
+        entry.source = wxString::FromUTF8(mounts[i].f_mntfromname);
+        entry.fstype = wxString::FromUTF8(mounts[i].f_fstypename);
+        entry.options = mountFlagsToOptions(mounts[i].f_flags);
+        mounttable[entry.mountpoint] = entry;
+    }
+    return true;
+
+#else
+
+    return false;
+
+#endif
+}
+
+
+// parse the output of the 'mount' binary
+// OSX   : encfs@osxfuse0 on /Volumes/x (osxfuse, nodev, nosuid, synchronous, mounted by user)
+// Linux : encfs on /mnt/x type fuse.encfs (rw,nosuid,nodev,relatime,user_id=1000)
+void parseMountOutput(wxArrayString & mountoutput, MountTable & mounttable)
+{
+    mounttable.clear();
+    size_t count = mountoutput.GetCount();
+    for (size_t n = 0; n < count; n++)
+    {
+        wxString thisline = mountoutput[n];
+        size_t onpos = thisline.find(" on ");
+        size_t optpos = thisline.rfind(" (");
+        if (onpos == wxString::npos || optpos == wxString::npos || optpos < onpos)
+        {
+            continue;
+        }
+        MountEntry entry;
+        entry.source = thisline.Left(onpos);
+        wxString mountpart = thisline.Mid(onpos + 4, optpos - onpos - 4);
+        entry.options = thisline.Mid(optpos + 2);
+        entry.options.Replace(")", "");
+        entry.options.Replace(" ", "");
+
+        size_t typepos = mountpart.rfind(" type ");
+        if (typepos != wxString::npos)
+        {
+            entry.mountpoint = mountpart.Left(typepos);
+            entry.fstype = mountpart.Mid(typepos + 6);
+        }
+        else
+        {
+            // OSX puts the fs type first in the option list
+            entry.mountpoint = mountpart;
+            entry.fstype = entry.options.BeforeFirst(',');
+        }
+        mounttable[entry.mountpoint] = entry;
+    }
+}
+
+
+// a path is a mount point when it lives on another device than its parent
+bool IsMountPoint(const wxString & path)
+{
+    wxString normalized = MountSnapshot::NormalizePath(path);
+    wxString parent = normalized.BeforeLast('/');
+    if (parent.IsEmpty())
+    {
+        parent = "/";
+    }
+    struct stat pathstat;
+    struct stat parentstat;
+    if (stat(normalized.fn_str(), &pathstat) != 0 || stat(parent.fn_str(), &parentstat) != 0)
+    {
+        return false;
+    }
+    return (pathstat.st_dev != parentstat.st_dev);
+}
+
+
+// check the file system type of a path, without looking at the mount table
+bool IsFuseMountPoint(const wxString & path)
+{
+    struct statfs fsinfo;
+    if (statfs(path.fn_str(), &fsinfo) != 0)
+    {
+        return false;
+    }
+#if defined(ENCFSGUI_MOUNTTABLE_PROCFS)
+    return ((unsigned long)fsinfo.f_type == FUSE_SUPER_MAGIC);
+#elif defined(ENCFSGUI_MOUNTTABLE_GETFSSTAT)
+    // osxfuse, macfuse, fusefs
+    return (strstr(fsinfo.f_fstypename, "fuse") != NULL);
+#else
+    return true;
+#endif
+}
+
+
+// wait until a freshly started encfs has attached its file system
+// returns as soon as the mount shows up, or false after timeoutms
+bool WaitForMount(const wxString & path, long timeoutms)
+{
+    wxLongLong deadline = wxGetLocalTimeMillis() + timeoutms;
+    unsigned long delayms = 2;
+    while (true)
+    {
+        if (IsMountPoint(path) && IsFuseMountPoint(path))
+        {
+            // stat/statfs only know it's fuse, the mount table knows it's encfs
+            MountSnapshot snapshot;
+            if (!snapshot.CaptureNative())
+            {
+                return true;
+            }
+            return snapshot.IsEncFSMounted(path);
+        }
+        if (wxGetLocalTimeMillis() >= deadline)
+        {
+            return false;
+        }
+        wxMilliSleep(delayms);
+        if (delayms < 50)
+        {
+            delayms = delayms * 2;
+        }
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// MountSnapshot member functions
+// ----------------------------------------------------------------------------
+
+// constructor
+MountSnapshot::MountSnapshot()
+{
+}
+
+
+// capture the current mount table
+// use the native backend when possible, and only resort
+// to running the 'mount' binary when there is no other way
+void MountSnapshot::Capture()
+{
+    MountTable mounttable;
+    if (!readNativeMountTable(mounttable))
+    {
+        wxString mountbin = getMountBinPath();
+        wxArrayString mount_output = ArrRunCMDSync(mountbin);
+        parseMountOutput(mount_output, mounttable);
+    }
+    BuildIndex(mounttable);
+}
+
+
+bool MountSnapshot::CaptureNative()
+{
+    MountTable mounttable;
+    if (!readNativeMountTable(mounttable))
+    {
+        return false;
+    }
+    BuildIndex(mounttable);
+    return true;
+}
+
+
+void MountSnapshot::CaptureFrom(MountTable & mounttable)
+{
+    BuildIndex(mounttable);
+}
+
+
+void MountSnapshot::BuildIndex(MountTable & mounttable)
+{
+    m_byPath.clear();
+    m_byType.clear();
+    m_byPath.reserve(mounttable.size());
+    for (MountTable::iterator it = mounttable.begin(); it != mounttable.end(); it++)
+    {
+        wxString normalizedpath = NormalizePath(it->first);
+        MountEntry & entry = m_byPath[normalizedpath];
+        entry = it->second;
+        m_byType[entry.fstype].push_back(normalizedpath);
+        // encfs hides behind osxfuse/macfuse on OSX, so give it its own bucket
+        if (entry.isEncFS() && entry.fstype != "encfs")
+        {
+            m_byType["encfs"].push_back(normalizedpath);
+        }
+    }
+}
+
+
+// strip duplicate and trailing slashes, so "/Volumes/x/" matches "/Volumes/x"
+wxString MountSnapshot::NormalizePath(const wxString & path)
+{
+    wxString normalized;
+    normalized.reserve(path.length());
+    for (size_t i = 0; i < path.length(); i++)
+    {
+        if (path[i] == '/' && !normalized.IsEmpty() && normalized.Last() == '/')
+        {
+            continue;
+        }
+        normalized.Append(path[i]);
+    }
+    while (normalized.length() > 1 && normalized.Last() == '/')
+    {
+        normalized.RemoveLast();
+    }
+    return normalized;
+}
+
+
+const MountEntry * MountSnapshot::FindMount(const wxString & path) const
+{
+    MountTable::const_iterator it = m_byPath.find(NormalizePath(path));
+    if (it == m_byPath.end())
+    {
+        return NULL;
+    }
+    return &it->second;
+}
+
+
+// Check if volumepath is an encfs mount in this snapshot
+bool MountSnapshot::IsEncFSMounted(const wxString & path) const
+{
+    const MountEntry * entry = FindMount(path);
+    return (entry != NULL && entry->isEncFS());
+}
+
+
+// all mount points of a given fs type ("encfs" works on every platform)
+const std::vector<wxString> & MountSnapshot::GetMountPointsByType(const wxString & fstype) const
+{
+    static const std::vector<wxString> nomounts;
+    std::unordered_map<wxString, std::vector<wxString>, wxStringHash, wxStringEqual>::const_iterator it = m_byType.find(fstype);
+    if (it == m_byType.end())
+    {
+        return nomounts;
+    }
+    return it->second;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// MountWatcherThread member functions
+// ----------------------------------------------------------------------------
+
+// constructor
+MountWatcherThread::MountWatcherThread(wxEvtHandler *handler, int eventid) : wxThread(wxTHREAD_JOINABLE)
+{
+    m_handler = handler;
+    m_eventid = eventid;
+    // pipe is only used to wake up the thread when it needs to stop
+    if (pipe(m_wakeupPipe) != 0)
+    {
+        m_wakeupPipe[0] = -1;
+        m_wakeupPipe[1] = -1;
+    }
+}
+
+// no event loop to post to, report through a callback instead
+MountWatcherThread::MountWatcherThread(const MountStateCallback& callback) : MountWatcherThread(NULL, 0)
+{
+    m_callback = callback;
+}
+
+// destructor
+MountWatcherThread::~MountWatcherThread()
+{
+    if (m_wakeupPipe[0] > -1)
+    {
+        close(m_wakeupPipe[0]);
+        close(m_wakeupPipe[1]);
+    }
+}
+
+
+// called from the GUI thread after (re)loading the volumes
+void MountWatcherThread::SetWatchedVolumes(std::map<wxString, wxString>& watchedpaths, 
+                                           std::map<wxString, bool>& knownstates)
+{
+    wxCriticalSectionLocker lock(m_watchedCS);
+    m_watchedPaths = watchedpaths;
+    m_knownStates = knownstates;
+}
+
+
+void MountWatcherThread::RequestStop()
+{
+    if (m_wakeupPipe[1] > -1)
+    {
+        char stopbyte = 'x';
+        ssize_t written = write(m_wakeupPipe[1], &stopbyte, 1);
+        (void)written;
+    }
+}
+
+
+// re-read the mount table and only report volumes that changed state
+void MountWatcherThread::CheckMountStates()
+{
+    MountSnapshot snapshot;
+    if (!snapshot.CaptureNative())
+    {
+        return;
+    }
+
+    wxCriticalSectionLocker lock(m_watchedCS);
+    for (std::map<wxString, wxString>::iterator it = m_watchedPaths.begin(); it != m_watchedPaths.end(); it++)
+    {
+        wxString volumename = it->first;
+        bool ismounted = snapshot.IsEncFSMounted(it->second);
+        if (m_knownStates[volumename] != ismounted)
+        {
+            m_knownStates[volumename] = ismounted;
+            if (m_callback)
+            {
+                m_callback(volumename, ismounted);
+                continue;
+            }
+            wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, m_eventid);
+            event->SetString(volumename);
+            event->SetInt(ismounted ? 1 : 0);
+            wxQueueEvent(m_handler, event);
+        }
+    }
+}
+
+
+wxThread::ExitCode MountWatcherThread::Entry()
+{
+    if (m_wakeupPipe[0] < 0)
+    {
+        return (wxThread::ExitCode)1;
+    }
+
+#if defined(ENCFSGUI_MOUNTTABLE_PROCFS)
+
+    // the kernel flags mountinfo with POLLPRI every time the mount table changes
+    int mountinfofd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (mountinfofd < 0)
+    {
+        return (wxThread::ExitCode)1;
+    }
+
+    char buf[4096];
+    bool keepgoing = true;
+    while (keepgoing)
+    {
+        // the change flag only gets cleared by reading the file again
+        lseek(mountinfofd, 0, SEEK_SET);
+        while (read(mountinfofd, buf, sizeof(buf)) > 0)
+        {
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = mountinfofd;
+        fds[0].events = POLLPRI | POLLERR;
+        fds[0].revents = 0;
+        fds[1].fd = m_wakeupPipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        int rc = poll(fds, 2, -1);
+        if (rc < 0)
+        {
+            keepgoing = (errno == EINTR);
+            continue;
+        }
+        if (fds[1].revents)
+        {
+            // stop requested
+            keepgoing = false;
+        }
+        else if (fds[0].revents & (POLLPRI | POLLERR))
+        {
+            CheckMountStates();
+        }
+    }
+    close(mountinfofd);
+
+#elif defined(ENCFSGUI_MOUNTTABLE_GETFSSTAT)
+
+    // EVFILT_FS delivers VQ_MOUNT / VQ_UNMOUNT for every file system on the box
+    int kq = kqueue();
+    if (kq < 0)
+    {
+        return (wxThread::ExitCode)1;
+    }
+
+    struct kevent changes[2];
+    EV_SET(&changes[0], 0, EVFILT_FS, EV_ADD | EV_CLEAR, 0, 0, NULL);
+    EV_SET(&changes[1], m_wakeupPipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+    if (kevent(kq, changes, 2, NULL, 0, NULL) < 0)
+    {
+        close(kq);
+        return (wxThread::ExitCode)1;
+    }
+
+    bool keepgoing = true;
+    while (keepgoing)
+    {
+        struct kevent event;
+        int rc = kevent(kq, NULL, 0, &event, 1, NULL);
+        if (rc < 0)
+        {
+            keepgoing = (errno == EINTR);
+            continue;
+        }
+        if (rc == 0)
+        {
+            continue;
+        }
+        if (event.filter == EVFILT_READ)
+        {
+            // stop requested
+            keepgoing = false;
+        }
+        else if (event.filter == EVFILT_FS)
+        {
+            CheckMountStates();
+        }
+    }
+    close(kq);
+
+#endif
+
+    return (wxThread::ExitCode)0;
+}
@@ -0,0 +1,212 @@
+/*
+    encFSGui - encfsgui_quickmount.cpp
+    source file contains the type-ahead "Quick mount" dialog,
+    used from the taskbar menu
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/srchctrl.h>
+#include <vector>
+
+#include "encfsgui.h"
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+enum
+{
+    ID_QUICKMOUNT_SEARCH = 1,
+    ID_QUICKMOUNT_LIST
+};
+
+// ----------------------------------------------------------------------------
+// Classes
+// ----------------------------------------------------------------------------
+
+class frmQuickMountDialog : public wxDialog
+{
+public:
+    //ctor
+    frmQuickMountDialog(wxWindow *parent,
+                        wxString& title,
+                        const wxPoint& pos,
+                        const wxSize& size,
+                        long style,
+                        const VolumeMap& volumedata);
+    void Create();
+    void OnSearchText(wxCommandEvent &event);
+    void OnSearchEnter(wxCommandEvent &event);
+    void OnListActivated(wxCommandEvent &event);
+    void OnCharHook(wxKeyEvent &event);
+    void OnOK(wxCommandEvent &event);
+    wxString GetSelectedVolume();
+
+private:
+    void FillList();
+    wxDECLARE_EVENT_TABLE();
+    wxSearchCtrl * m_search_field;
+    wxListBox * m_volume_list;
+    std::vector<wxString> m_matches;    // list index -> volume name
+    wxString m_selectedvolume;
+    const VolumeMap& m_volumedata;
+};
+
+
+// Events
+
+wxBEGIN_EVENT_TABLE(frmQuickMountDialog, wxDialog)
+    EVT_TEXT(ID_QUICKMOUNT_SEARCH, frmQuickMountDialog::OnSearchText)
+    EVT_TEXT_ENTER(ID_QUICKMOUNT_SEARCH, frmQuickMountDialog::OnSearchEnter)
+    EVT_LISTBOX_DCLICK(ID_QUICKMOUNT_LIST, frmQuickMountDialog::OnListActivated)
+    EVT_BUTTON(wxID_OK, frmQuickMountDialog::OnOK)
+    EVT_CHAR_HOOK(frmQuickMountDialog::OnCharHook)
+wxEND_EVENT_TABLE()
+
+// dialog constructor
+frmQuickMountDialog::frmQuickMountDialog(wxWindow *parent,
+                                         wxString& title,
+                                         const wxPoint& pos,
+                                         const wxSize& size,
+                                         long style,
+                                         const VolumeMap& volumedata) : wxDialog(parent, wxID_ANY, title, pos, size, style),
+                                                                        m_volumedata(volumedata)
+{
+    m_search_field = NULL;
+    m_volume_list = NULL;
+}
+
+
+// unmounted volumes matching the search text, straight from the registry index
+void frmQuickMountDialog::FillList()
+{
+    std::vector<wxString> matches = getVolumeRegistry().Search(m_search_field->GetValue());
+    m_matches.clear();
+    wxArrayString items;
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        VolumeMap::const_iterator it = m_volumedata.find(matches[i]);
+        if (it != m_volumedata.end() && it->second && !it->second->getMountState())
+        {
+            m_matches.push_back(matches[i]);
+            items.Add(matches[i]);
+        }
+    }
+    m_volume_list->Set(items);
+    if (!m_matches.empty())
+    {
+        m_volume_list->SetSelection(0);
+    }
+}
+
+void frmQuickMountDialog::OnSearchText(wxCommandEvent& WXUNUSED(event))
+{
+    FillList();
+}
+
+void frmQuickMountDialog::OnSearchEnter(wxCommandEvent& event)
+{
+    OnOK(event);
+}
+
+void frmQuickMountDialog::OnListActivated(wxCommandEvent& event)
+{
+    OnOK(event);
+}
+
+// up/down move through the matches, while typing in the search field
+void frmQuickMountDialog::OnCharHook(wxKeyEvent& event)
+{
+    int selection = m_volume_list->GetSelection();
+    int nrmatches = (int)m_matches.size();
+    if (event.GetKeyCode() == WXK_DOWN && nrmatches > 0)
+    {
+        m_volume_list->SetSelection(selection < nrmatches - 1 ? selection + 1 : nrmatches - 1);
+    }
+    else if (event.GetKeyCode() == WXK_UP && nrmatches > 0)
+    {
+        m_volume_list->SetSelection(selection > 0 ? selection - 1 : 0);
+    }
+    else
+    {
+        event.Skip();
+    }
+}
+
+void frmQuickMountDialog::OnOK(wxCommandEvent& WXUNUSED(event))
+{
+    int selection = m_volume_list->GetSelection();
+    if (selection == wxNOT_FOUND || selection >= (int)m_matches.size())
+    {
+        return;
+    }
+    m_selectedvolume = m_matches[selection];
+    EndModal(wxID_OK);
+}
+
+wxString frmQuickMountDialog::GetSelectedVolume()
+{
+    return m_selectedvolume;
+}
+
+void frmQuickMountDialog::Create()
+{
+    wxSizer * const sizerTop = new wxBoxSizer(wxVERTICAL);
+
+    sizerTop->Add(new wxStaticText(this, wxID_ANY, "&Type part of the volume name or path:"), wxSizerFlags().Border());
+    m_search_field = new wxSearchCtrl(this, ID_QUICKMOUNT_SEARCH, "", wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
+    sizerTop->Add(m_search_field, wxSizerFlags().Expand().Border(wxLEFT|wxRIGHT, 10));
+
+    m_volume_list = new wxListBox(this, ID_QUICKMOUNT_LIST);
+    sizerTop->Add(m_volume_list, wxSizerFlags(1).Expand().Border());
+
+    // Add "OK" and "Cancel"
+    sizerTop->Add(CreateStdDialogButtonSizer(wxOK | wxCANCEL),
+                  wxSizerFlags().Right().Border());
+
+    FillList();
+
+    CentreOnScreen();
+
+    SetSizer(sizerTop);
+    m_search_field->SetFocus();
+}
+
+///
+//
+//
+
+// returns the volume to mount, or an empty string if the user cancelled
+wxString selectQuickMountVolume(wxWindow *parent, const VolumeMap& volumedata)
+{
+    wxSize dlgQuickMountSize;
+    dlgQuickMountSize.Set(360,320);
+
+    long style = wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER;
+
+    wxString strTitle;
+    strTitle.Printf( "Quick mount");
+
+    frmQuickMountDialog* dlg = new frmQuickMountDialog(parent,
+                                                       strTitle,
+                                                       wxDefaultPosition,
+                                                       dlgQuickMountSize,
+                                                       style,
+                                                       volumedata);
+    dlg->Create();
+    wxString volumename;
+    if (dlg->ShowModal() == wxID_OK)
+    {
+        volumename = dlg->GetSelectedVolume();
+    }
+    dlg->Destroy();
+    return volumename;
+}
@@ -0,0 +1,383 @@
+/*
+    encFSGui - encfsgui_registry.cpp
+    source file contains the in-memory copy of the volume configuration
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/config.h>
+#include <wx/fileconf.h>
+#include <wx/tokenzr.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iterator>
+
+#include <sys/stat.h>
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// VolumeRecord member functions
+// ----------------------------------------------------------------------------
+
+VolumeRecord::VolumeRecord()
+{
+    automount = false;
+    preventautounmount = false;
+    passwordsaved = false;
+    allowother = false;
+    mountaslocal = false;
+    idletimeout = 0;
+}
+
+bool VolumeRecord::IsComplete() const
+{
+    return (!enc_path.IsEmpty() && !mount_path.IsEmpty());
+}
+
+
+// ----------------------------------------------------------------------------
+// VolumeRegistry member functions
+// ----------------------------------------------------------------------------
+
+VolumeRegistry::VolumeRegistry()
+{
+    m_loaded = false;
+    m_filefound = false;
+    m_dev = 0;
+    m_ino = 0;
+    m_mtime = 0;
+    m_size = 0;
+}
+
+
+// we are the only writer of the config, and every write gets flushed,
+// so the file on disk tells us if the in-memory copy is still current
+// wxFileConfig replaces the file on flush, so the inode changes as well
+bool VolumeRegistry::HasConfigFileChanged()
+{
+    // console app object in command line mode, so not wxTheApp
+    wxAppConsole *app = wxAppConsole::GetInstance();
+    if (m_configfile.IsEmpty() && app)
+    {
+        m_configfile = wxFileConfig::GetLocalFileName(app->GetAppName());
+    }
+
+    struct stat st;
+    bool filefound = (!m_configfile.IsEmpty() && stat(m_configfile.utf8_str(), &st) == 0);
+    if (filefound != m_filefound)
+    {
+        return true;
+    }
+    if (!filefound)
+    {
+        return false;
+    }
+    return (st.st_dev != m_dev || st.st_ino != m_ino || st.st_mtime != m_mtime || st.st_size != m_size);
+}
+
+void VolumeRegistry::RememberConfigFile()
+{
+    struct stat st;
+    m_filefound = (!m_configfile.IsEmpty() && stat(m_configfile.utf8_str(), &st) == 0);
+    if (m_filefound)
+    {
+        m_dev = st.st_dev;
+        m_ino = st.st_ino;
+        m_mtime = st.st_mtime;
+        m_size = st.st_size;
+    }
+}
+
+
+// one pass over the /Volumes groups, every entry is read once
+void VolumeRegistry::Load()
+{
+    std::vector<VolumeRecord> volumes;
+    wxConfigBase *pConfig = wxConfigBase::Get();
+
+    wxArrayString groupnames;
+    pConfig->SetPath(wxT("/Volumes"));
+    wxString groupname;
+    long groupindex;
+    bool bCont = pConfig->GetFirstGroup(groupname, groupindex);
+    while (bCont)
+    {
+        groupnames.Add(groupname);
+        bCont = pConfig->GetNextGroup(groupname, groupindex);
+    }
+
+    for (size_t i = 0; i < groupnames.GetCount(); i++)
+    {
+        VolumeRecord record;
+        record.volname = groupnames[i];
+
+        wxString currentPath;
+        currentPath.Printf(wxT("/Volumes/%s"), record.volname);
+        pConfig->SetPath(currentPath);
+
+        wxString entryname;
+        long entryindex;
+        bCont = pConfig->GetFirstEntry(entryname, entryindex);
+        while (bCont)
+        {
+            if (entryname == "enc_path")
+            {
+                record.enc_path = pConfig->Read(entryname, "");
+            }
+            else if (entryname == "mount_path")
+            {
+                record.mount_path = pConfig->Read(entryname, "");
+            }
+            else if (entryname == "automount")
+            {
+                record.automount = pConfig->ReadBool(entryname, false);
+            }
+            else if (entryname == "preventautounmount")
+            {
+                record.preventautounmount = pConfig->ReadBool(entryname, false);
+            }
+            else if (entryname == "passwordsaved")
+            {
+                record.passwordsaved = pConfig->ReadBool(entryname, false);
+            }
+            else if (entryname == "allowother")
+            {
+                record.allowother = pConfig->ReadBool(entryname, false);
+            }
+            else if (entryname == "mountaslocal")
+            {
+                record.mountaslocal = pConfig->ReadBool(entryname, false);
+            }
+            else if (entryname == "idletimeout")
+            {
+                record.idletimeout = pConfig->Read(entryname, 0l);
+            }
+            bCont = pConfig->GetNextEntry(entryname, entryindex);
+        }
+        volumes.push_back(record);
+    }
+    pConfig->SetPath(wxT("/"));
+
+    m_volumes.swap(volumes);
+    m_index.clear();
+    for (size_t i = 0; i < m_volumes.size(); i++)
+    {
+        m_index[m_volumes[i].volname] = i;
+    }
+    BuildSearchIndex();
+}
+
+
+// lowercase trigrams of name, encrypted path and mount path
+// trigrams don't cross field boundaries
+void VolumeRegistry::BuildSearchIndex()
+{
+    m_searchtext.clear();
+    m_trigrams.clear();
+    for (size_t i = 0; i < m_volumes.size(); i++)
+    {
+        wxString fields[3];
+        fields[0] = m_volumes[i].volname.Lower();
+        fields[1] = m_volumes[i].enc_path.Lower();
+        fields[2] = m_volumes[i].mount_path.Lower();
+        m_searchtext.push_back(fields[0] + "\n" + fields[1] + "\n" + fields[2]);
+
+        for (size_t f = 0; f < 3; f++)
+        {
+            for (size_t pos = 0; pos + 3 <= fields[f].length(); pos++)
+            {
+                std::vector<size_t>& posting = m_trigrams[fields[f].Mid(pos, 3)];
+                if (posting.empty() || posting.back() != i)
+                {
+                    posting.push_back(i);
+                }
+            }
+        }
+    }
+}
+
+
+// reload if needed, returns true if the volume list may have changed
+bool VolumeRegistry::Refresh()
+{
+    if (m_loaded && !HasConfigFileChanged())
+    {
+        return false;
+    }
+    Load();
+    RememberConfigFile();
+    m_loaded = true;
+    return true;
+}
+
+// force a reload on the next Refresh(), for changes that weren't flushed
+void VolumeRegistry::Invalidate()
+{
+    m_loaded = false;
+}
+
+const std::vector<VolumeRecord>& VolumeRegistry::GetVolumes() const
+{
+    return m_volumes;
+}
+
+const VolumeRecord* VolumeRegistry::Find(const wxString& volumename) const
+{
+    std::map<wxString, size_t>::const_iterator it = m_index.find(volumename);
+    if (it == m_index.end())
+    {
+        return NULL;
+    }
+    return &m_volumes[it->second];
+}
+
+bool VolumeRegistry::Exists(const wxString& volumename) const
+{
+    return (m_index.find(volumename) != m_index.end());
+}
+
+void VolumeRegistry::AddListener(VolumeListener* listener)
+{
+    if (std::find(m_listeners.begin(), m_listeners.end(), listener) == m_listeners.end())
+    {
+        m_listeners.push_back(listener);
+    }
+}
+
+void VolumeRegistry::RemoveListener(VolumeListener* listener)
+{
+    m_listeners.erase(std::remove(m_listeners.begin(), m_listeners.end(), listener), m_listeners.end());
+}
+
+// a single volume changed, GUI thread only
+void VolumeRegistry::NotifyVolumeChanged(const wxString& volumename)
+{
+    // copy, a listener may (un)register while being notified
+    std::vector<VolumeListener*> listeners = m_listeners;
+    for (size_t i = 0; i < listeners.size(); i++)
+    {
+        listeners[i]->OnVolumeChanged(volumename);
+    }
+}
+
+// volumes were added, removed or renamed, GUI thread only
+void VolumeRegistry::NotifyVolumeListChanged()
+{
+    std::vector<VolumeListener*> listeners = m_listeners;
+    for (size_t i = 0; i < listeners.size(); i++)
+    {
+        listeners[i]->OnVolumeListChanged();
+    }
+}
+
+
+// every word has to show up in the name or one of the paths, case insensitive
+// words of 3+ characters only look at the volumes that have all of its trigrams
+std::vector<wxString> VolumeRegistry::Search(const wxString& query) const
+{
+    std::vector<size_t> matches;
+    bool firstword = true;
+
+    wxStringTokenizer tokenizer(query.Lower(), " \t\r\n");
+    while (tokenizer.HasMoreTokens())
+    {
+        wxString word = tokenizer.GetNextToken();
+        if (word.IsEmpty())
+        {
+            continue;
+        }
+
+        // volumes that may contain this word
+        std::vector<size_t> candidates;
+        if (word.length() < 3)
+        {
+            for (size_t i = 0; i < m_volumes.size(); i++)
+            {
+                candidates.push_back(i);
+            }
+        }
+        else
+        {
+            // the shortest posting list is enough, the text check below does the rest
+            const std::vector<size_t>* shortest = NULL;
+            for (size_t pos = 0; pos + 3 <= word.length(); pos++)
+            {
+                std::unordered_map<wxString, std::vector<size_t>, wxStringHash, wxStringEqual>::const_iterator it = m_trigrams.find(word.Mid(pos, 3));
+                if (it == m_trigrams.end())
+                {
+                    return std::vector<wxString>();
+                }
+                if (!shortest || it->second.size() < shortest->size())
+                {
+                    shortest = &it->second;
+                }
+            }
+            candidates = *shortest;
+        }
+
+        std::vector<size_t> wordmatches;
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            if (m_searchtext[candidates[c]].Find(word) != wxNOT_FOUND)
+            {
+                wordmatches.push_back(candidates[c]);
+            }
+        }
+
+        if (firstword)
+        {
+            matches.swap(wordmatches);
+            firstword = false;
+        }
+        else
+        {
+            std::vector<size_t> remaining;
+            std::set_intersection(matches.begin(), matches.end(),
+                                  wordmatches.begin(), wordmatches.end(),
+                                  std::back_inserter(remaining));
+            matches.swap(remaining);
+        }
+        if (matches.empty())
+        {
+            return std::vector<wxString>();
+        }
+    }
+
+    std::vector<wxString> names;
+    if (firstword)
+    {
+        // no words, everything matches
+        for (size_t i = 0; i < m_volumes.size(); i++)
+        {
+            names.push_back(m_volumes[i].volname);
+        }
+        return names;
+    }
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        names.push_back(m_volumes[matches[i]].volname);
+    }
+    return names;
+}
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+// the one registry, GUI thread only
+VolumeRegistry& getVolumeRegistry()
+{
+    static VolumeRegistry registry;
+    return registry;
+}
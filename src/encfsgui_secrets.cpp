@@ -0,0 +1,683 @@
+/*
+    encFSGui - encfsgui_secrets.cpp
+    source file contains the saved password backends
+    (macOS keychain, Secret Service, local file)
+    and the in-memory password cache
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/config.h>
+#include <wx/fileconf.h>
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
+#include <wx/time.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// constants & globals
+// ----------------------------------------------------------------------------
+
+// keychain account/service name, the same as older versions used
+#define SECRET_ITEM_PREFIX "EncFSGUI_"
+// attribute used to find our Secret Service items
+#define SECRET_SERVICE_APP "encfsgui"
+
+// keychain access may pop up a permission dialog first
+#define SECRET_CMD_TIMEOUT 120000
+
+
+// ----------------------------------------------------------------------------
+// SecureBuffer - copy of a secret in locked memory, wiped before it's freed
+// ----------------------------------------------------------------------------
+
+class SecureBuffer
+{
+public:
+    explicit SecureBuffer(const wxString& secret)
+    {
+        wxScopedCharBuffer utf8 = secret.utf8_str();
+        m_size = utf8.length();
+        // whole pages, so unlocking one buffer can't unlock another
+        long pagesize = sysconf(_SC_PAGESIZE);
+        m_allocsize = ((m_size + 1 + pagesize - 1) / pagesize) * pagesize;
+        void *data = NULL;
+        if (posix_memalign(&data, pagesize, m_allocsize) != 0)
+        {
+            data = NULL;
+        }
+        m_data = (char*)data;
+        m_locked = false;
+        if (!m_data)
+        {
+            m_size = 0;
+            m_allocsize = 0;
+            return;
+        }
+        // keep it out of swap, best effort (RLIMIT_MEMLOCK may be low)
+        m_locked = (mlock(m_data, m_allocsize) == 0);
+        memcpy(m_data, utf8.data(), m_size);
+        m_data[m_size] = '\0';
+    }
+
+    ~SecureBuffer()
+    {
+        if (!m_data)
+        {
+            return;
+        }
+        wipe(m_data, m_allocsize);
+        if (m_locked)
+        {
+            munlock(m_data, m_allocsize);
+        }
+        free(m_data);
+    }
+
+    // callers get a regular wxString, the cache keeps the locked copy
+    wxString GetString() const
+    {
+        if (!m_data)
+        {
+            return "";
+        }
+        return wxString::FromUTF8(m_data, m_size);
+    }
+
+private:
+    // volatile, so the compiler can't drop it as a dead store
+    static void wipe(char *data, size_t size)
+    {
+        volatile char *p = data;
+        while (size--)
+        {
+            *p++ = 0;
+        }
+    }
+
+    SecureBuffer(const SecureBuffer&);
+    SecureBuffer& operator=(const SecureBuffer&);
+
+    char *m_data;
+    size_t m_size;
+    size_t m_allocsize;
+    bool m_locked;
+};
+
+
+struct SecretCacheEntry
+{
+    std::unique_ptr<SecureBuffer> secret;
+    wxLongLong fetchedms;
+};
+
+// volume name -> password, GUI thread only
+static std::map<wxString, SecretCacheEntry> g_secretCache;
+
+
+// ----------------------------------------------------------------------------
+// SecretStore member functions
+// ----------------------------------------------------------------------------
+
+// default: one lookup per volume
+void SecretStore::GetMany(const wxArrayString& volumenames, std::map<wxString, wxString>& secrets)
+{
+    for (size_t i = 0; i < volumenames.GetCount(); i++)
+    {
+        wxString secret;
+        if (Get(volumenames[i], secret))
+        {
+            secrets[volumenames[i]] = secret;
+        }
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// backends
+// ----------------------------------------------------------------------------
+
+// strip the newline printed after the password, but nothing more
+static wxString stripSecretNewline(const wxString& output)
+{
+    wxString secret = output;
+    if (secret.EndsWith("\n"))
+    {
+        secret.RemoveLast();
+        if (secret.EndsWith("\r"))
+        {
+            secret.RemoveLast();
+        }
+    }
+    return secret;
+}
+
+
+// shell loop around a lookup command for "$a", one output line per volume, in order:
+// "v" followed by the hex dump of whatever the lookup printed, and a '+' (2b) if it succeeded
+// hex keeps newlines, '+' and '-' in passwords from being mistaken for the next record
+static wxString getBatchLookupScript(const wxString& lookupcmd)
+{
+    return "for a in \"$@\"; do "
+           "h=$({ " + lookupcmd + " 2>/dev/null && printf +; } | od -An -tx1 | tr -d ' \\n'); "
+           "printf 'v%s\\n' \"$h\"; done";
+}
+
+
+// parse the output of getBatchLookupScript()
+// stripnewline: the lookup tool prints a newline after the password
+static void parseBatchLookup(const wxString& output, const wxArrayString& volumenames, bool stripnewline,
+                             std::map<wxString, wxString>& secrets)
+{
+    wxArrayString lines = CMDOutputToArray(output);
+    for (size_t i = 0; i < lines.GetCount() && i < volumenames.GetCount(); i++)
+    {
+        wxString hex = lines[i].Mid(1);
+        if (!lines[i].StartsWith("v") || hex.length() % 2 != 0 || !hex.EndsWith("2b"))
+        {
+            // not found, or garbled
+            continue;
+        }
+        std::string bytes;
+        bool valid = true;
+        for (size_t n = 0; n + 2 < hex.length() && valid; n += 2)
+        {
+            unsigned long byte;
+            valid = hex.Mid(n, 2).ToULong(&byte, 16);
+            bytes += (char)byte;
+        }
+        if (!valid)
+        {
+            continue;
+        }
+        wxString secret = wxString::FromUTF8(bytes.c_str(), bytes.size());
+        std::fill(bytes.begin(), bytes.end(), '\0');
+        secrets[volumenames[i]] = stripnewline ? stripSecretNewline(secret) : secret;
+    }
+}
+
+
+// macOS login keychain, through the 'security' tool
+class KeychainSecretStore : public SecretStore
+{
+public:
+    virtual wxString GetName() const
+    {
+        return "keychain";
+    }
+
+    virtual bool Get(const wxString& volumename, wxString& secret)
+    {
+        wxString fullname = SECRET_ITEM_PREFIX + volumename;
+        CmdRequest request;
+        request.argv.Add("security");
+        request.argv.Add("find-generic-password");
+        request.argv.Add("-a");
+        request.argv.Add(fullname);
+        request.argv.Add("-s");
+        request.argv.Add(fullname);
+        request.argv.Add("-w");
+        request.argv.Add("login.keychain");
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        CmdResult result = RunCMDWait(request);
+        if (!result.Succeeded())
+        {
+            // don't hand an error message back as password
+            return false;
+        }
+        secret = stripSecretNewline(result.out);
+        return true;
+    }
+
+    virtual bool Set(const wxString& volumename, const wxString& secret)
+    {
+        wxString fullname = SECRET_ITEM_PREFIX + volumename;
+        CmdRequest request;
+        request.argv.Add("security");
+        request.argv.Add("add-generic-password");
+        request.argv.Add("-U");
+        request.argv.Add("-a");
+        request.argv.Add(fullname);
+        request.argv.Add("-s");
+        request.argv.Add(fullname);
+        request.argv.Add("-w");
+        request.argv.Add(secret);
+        request.argv.Add("login.keychain");
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        return RunCMDWait(request).Succeeded();
+    }
+
+    virtual bool Remove(const wxString& volumename)
+    {
+        wxString fullname = SECRET_ITEM_PREFIX + volumename;
+        CmdRequest request;
+        request.argv.Add("security");
+        request.argv.Add("delete-generic-password");
+        request.argv.Add("-a");
+        request.argv.Add(fullname);
+        request.argv.Add("-s");
+        request.argv.Add(fullname);
+        request.argv.Add("login.keychain");
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        return RunCMDWait(request).Succeeded();
+    }
+
+    // one shell for the whole batch, names are passed as arguments so no quoting is needed
+    virtual void GetMany(const wxArrayString& volumenames, std::map<wxString, wxString>& secrets)
+    {
+        if (volumenames.IsEmpty())
+        {
+            return;
+        }
+        CmdRequest request;
+        request.argv.Add("sh");
+        request.argv.Add("-c");
+        request.argv.Add(getBatchLookupScript("security find-generic-password -a \"$a\" -s \"$a\" -w login.keychain"));
+        request.argv.Add("sh");
+        for (size_t i = 0; i < volumenames.GetCount(); i++)
+        {
+            request.argv.Add(SECRET_ITEM_PREFIX + volumenames[i]);
+        }
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        CmdResult result = RunCMDWait(request);
+        if (result.timedout || result.spawnfailed || result.cancelled)
+        {
+            return;
+        }
+        parseBatchLookup(result.out, volumenames, true, secrets);
+    }
+};
+
+
+// Secret Service (GNOME keyring, KWallet), through 'secret-tool' from libsecret
+class SecretServiceStore : public SecretStore
+{
+public:
+    virtual wxString GetName() const
+    {
+        return "secretservice";
+    }
+
+    virtual bool Get(const wxString& volumename, wxString& secret)
+    {
+        CmdRequest request;
+        request.argv.Add("secret-tool");
+        request.argv.Add("lookup");
+        addAttributes(request.argv, volumename);
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        CmdResult result = RunCMDWait(request);
+        if (!result.Succeeded())
+        {
+            return false;
+        }
+        secret = result.out;    // lookup doesn't add a newline
+        return true;
+    }
+
+    virtual bool Set(const wxString& volumename, const wxString& secret)
+    {
+        CmdRequest request;
+        request.argv.Add("secret-tool");
+        request.argv.Add("store");
+        request.argv.Add("--label=" + wxString(SECRET_ITEM_PREFIX) + volumename);
+        addAttributes(request.argv, volumename);
+        // read from stdin, so it doesn't show up in ps
+        request.stdindata = secret;
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        return RunCMDWait(request).Succeeded();
+    }
+
+    virtual bool Remove(const wxString& volumename)
+    {
+        CmdRequest request;
+        request.argv.Add("secret-tool");
+        request.argv.Add("clear");
+        addAttributes(request.argv, volumename);
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        return RunCMDWait(request).Succeeded();
+    }
+
+    // one shell for the whole batch, the same way the keychain backend does it
+    // 'search' mixes the secret (stdout) with the attributes (stderr), so look them up one by one
+    virtual void GetMany(const wxArrayString& volumenames, std::map<wxString, wxString>& secrets)
+    {
+        if (volumenames.IsEmpty())
+        {
+            return;
+        }
+        CmdRequest request;
+        request.argv.Add("sh");
+        request.argv.Add("-c");
+        request.argv.Add("app=$1; shift; " + getBatchLookupScript("secret-tool lookup application \"$app\" volume \"$a\""));
+        request.argv.Add("sh");
+        request.argv.Add(SECRET_SERVICE_APP);
+        for (size_t i = 0; i < volumenames.GetCount(); i++)
+        {
+            request.argv.Add(volumenames[i]);
+        }
+        request.timeoutms = SECRET_CMD_TIMEOUT;
+        CmdResult result = RunCMDWait(request);
+        if (result.timedout || result.spawnfailed || result.cancelled)
+        {
+            return;
+        }
+        parseBatchLookup(result.out, volumenames, false, secrets);
+    }
+
+private:
+    static void addAttributes(wxArrayString& argv, const wxString& volumename)
+    {
+        argv.Add("application");
+        argv.Add(SECRET_SERVICE_APP);
+        argv.Add("volume");
+        argv.Add(volumename);
+    }
+};
+
+
+// plain file in the user data dir, only readable by the user
+// meant for hosts without a keyring, and as a stand-in for testing
+// values are hex encoded, so any password survives the config format
+class FileSecretStore : public SecretStore
+{
+public:
+    virtual wxString GetName() const
+    {
+        return "file";
+    }
+
+    // the store location comes from the config
+    virtual bool IsThreadSafe() const
+    {
+        return false;
+    }
+
+    virtual bool Get(const wxString& volumename, wxString& secret)
+    {
+        std::unique_ptr<wxFileConfig> store(openStore());
+        wxString hexvalue;
+        if (!store->Read(volumename, &hexvalue))
+        {
+            return false;
+        }
+        return fromHex(hexvalue, secret);
+    }
+
+    virtual bool Set(const wxString& volumename, const wxString& secret)
+    {
+        std::unique_ptr<wxFileConfig> store(openStore());
+        store->Write(volumename, toHex(secret));
+        return store->Flush();
+    }
+
+    virtual bool Remove(const wxString& volumename)
+    {
+        std::unique_ptr<wxFileConfig> store(openStore());
+        store->DeleteEntry(volumename);
+        return store->Flush();
+    }
+
+    // the whole file is read once anyway
+    virtual void GetMany(const wxArrayString& volumenames, std::map<wxString, wxString>& secrets)
+    {
+        std::unique_ptr<wxFileConfig> store(openStore());
+        for (size_t i = 0; i < volumenames.GetCount(); i++)
+        {
+            wxString hexvalue;
+            wxString secret;
+            if (store->Read(volumenames[i], &hexvalue) && fromHex(hexvalue, secret))
+            {
+                secrets[volumenames[i]] = secret;
+            }
+        }
+    }
+
+private:
+    static wxFileConfig* openStore()
+    {
+        wxConfigBase *pConfig = wxConfigBase::Get();
+        pConfig->SetPath(wxT("/Config"));
+        wxString storefile = pConfig->Read(wxT("secretfile"), "");
+        if (storefile.IsEmpty())
+        {
+            wxString datadir = wxStandardPaths::Get().GetUserDataDir();
+            wxFileName::Mkdir(datadir, 0700, wxPATH_MKDIR_FULL);
+            storefile = datadir + "/secrets";
+        }
+        wxFileConfig *store = new wxFileConfig(wxEmptyString, wxEmptyString, storefile, wxEmptyString,
+                                               wxCONFIG_USE_LOCAL_FILE);
+        store->SetUmask(0077);
+        store->SetPath(wxT("/Passwords"));
+        return store;
+    }
+
+    static wxString toHex(const wxString& secret)
+    {
+        wxScopedCharBuffer utf8 = secret.utf8_str();
+        wxString hexvalue;
+        for (size_t i = 0; i < utf8.length(); i++)
+        {
+            hexvalue << wxString::Format(wxT("%02x"), (unsigned char)utf8.data()[i]);
+        }
+        return hexvalue;
+    }
+
+    static bool fromHex(const wxString& hexvalue, wxString& secret)
+    {
+        if (hexvalue.length() % 2 != 0)
+        {
+            return false;
+        }
+        std::string bytes;
+        for (size_t i = 0; i < hexvalue.length(); i += 2)
+        {
+            unsigned long byte;
+            if (!hexvalue.Mid(i, 2).ToULong(&byte, 16))
+            {
+                return false;
+            }
+            bytes += (char)byte;
+        }
+        secret = wxString::FromUTF8(bytes.c_str(), bytes.length());
+        return true;
+    }
+};
+
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+// backend picked in the config, default depends on the platform
+// shared, so a lookup on a worker thread survives a backend switch
+static std::shared_ptr<SecretStore> getSecretStorePtr()
+{
+    static std::shared_ptr<SecretStore> store;
+
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+#ifdef __WXOSX__
+    wxString backend = pConfig->Read(wxT("secretbackend"), "keychain");
+#else
+    wxString backend = pConfig->Read(wxT("secretbackend"), "secretservice");
+#endif
+    if (store && store->GetName() == backend)
+    {
+        return store;
+    }
+
+    // switching backends, don't serve passwords from the old one
+    clearSavedPasswordCache();
+    if (backend == "file")
+    {
+        store.reset(new FileSecretStore());
+    }
+    else if (backend == "secretservice")
+    {
+        store.reset(new SecretServiceStore());
+    }
+    else
+    {
+        store.reset(new KeychainSecretStore());
+    }
+    return store;
+}
+
+static SecretStore& getSecretStore()
+{
+    return *getSecretStorePtr();
+}
+
+// seconds a password stays in memory, 0 = don't cache
+static long getSecretCacheTTL()
+{
+    wxConfigBase *pConfig = wxConfigBase::Get();
+    pConfig->SetPath(wxT("/Config"));
+    return pConfig->Read(wxT("secretcachettl"), 300l);
+}
+
+static void cacheSecret(const wxString& volumename, const wxString& secret)
+{
+    if (getSecretCacheTTL() <= 0)
+    {
+        return;
+    }
+    SecretCacheEntry& entry = g_secretCache[volumename];
+    entry.secret.reset(new SecureBuffer(secret));
+    entry.fetchedms = wxGetUTCTimeMillis();
+}
+
+static bool getCachedSecret(const wxString& volumename, wxString& secret)
+{
+    std::map<wxString, SecretCacheEntry>::iterator it = g_secretCache.find(volumename);
+    if (it == g_secretCache.end())
+    {
+        return false;
+    }
+    long ttl = getSecretCacheTTL();
+    if (ttl <= 0 || wxGetUTCTimeMillis() - it->second.fetchedms > wxLongLong(ttl * 1000))
+    {
+        // expired, wipes the buffer
+        g_secretCache.erase(it);
+        return false;
+    }
+    secret = it->second.secret->GetString();
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+// saved password of a volume, from the cache if possible
+// returns an empty string if there is none
+wxString getSavedPassword(const wxString& volumename)
+{
+    wxString secret;
+    if (getCachedSecret(volumename, secret))
+    {
+        return secret;
+    }
+    if (!getSecretStore().Get(volumename, secret))
+    {
+        return "";
+    }
+    cacheSecret(volumename, secret);
+    return secret;
+}
+
+// same, but only the cache check happens right away (main thread)
+// the backend lookup is left to the caller, to run on a worker thread
+// (a backend that needs the config is asked right away as well)
+// passwords fetched on the worker don't end up in the cache
+SavedPasswordLookup getSavedPasswordLookup(const wxString& volumename)
+{
+    wxString secret;
+    std::shared_ptr<SecretStore> store = getSecretStorePtr();
+    if (getCachedSecret(volumename, secret) || !store->IsThreadSafe())
+    {
+        if (secret.IsEmpty())
+        {
+            secret = getSavedPassword(volumename);
+        }
+        return [secret]() { return secret; };
+    }
+    return [store, volumename]()
+    {
+        wxString fetched;
+        if (!store->Get(volumename, fetched))
+        {
+            return wxString();
+        }
+        return fetched;
+    };
+}
+
+// fetch the passwords of these volumes in one go, so later
+// getSavedPassword() calls don't need to go to the backend
+void prefetchSavedPasswords(const wxArrayString& volumenames)
+{
+    wxArrayString missing;
+    for (size_t i = 0; i < volumenames.GetCount(); i++)
+    {
+        wxString secret;
+        if (!getCachedSecret(volumenames[i], secret))
+        {
+            missing.Add(volumenames[i]);
+        }
+        secret = "";
+    }
+    if (missing.IsEmpty() || getSecretCacheTTL() <= 0)
+    {
+        return;
+    }
+
+    std::map<wxString, wxString> secrets;
+    getSecretStore().GetMany(missing, secrets);
+    for (std::map<wxString, wxString>::iterator it = secrets.begin(); it != secrets.end(); it++)
+    {
+        cacheSecret(it->first, it->second);
+        it->second = "";
+    }
+}
+
+bool savePassword(const wxString& volumename, const wxString& secret)
+{
+    g_secretCache.erase(volumename);
+    bool saved = getSecretStore().Set(volumename, secret);
+    if (saved)
+    {
+        cacheSecret(volumename, secret);
+    }
+    return saved;
+}
+
+bool removeSavedPassword(const wxString& volumename)
+{
+    g_secretCache.erase(volumename);
+    return getSecretStore().Remove(volumename);
+}
+
+// wipes all cached passwords
+void clearSavedPasswordCache()
+{
+    g_secretCache.clear();
+}
@@ -0,0 +1,342 @@
+/*
+    encFSGui - encfsgui_volinfo.cpp
+    source file contains code to read the .encfs6.xml config
+    of a volume directly, without running encfsctl
+
+    written by Peter Van Eeckhoutte
+
+*/
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/xml/xml.h>
+#include <wx/log.h>
+#include <wx/thread.h>
+#include <map>
+
+#include <sys/stat.h>
+
+#include "encfsgui.h"
+
+
+// ----------------------------------------------------------------------------
+// constants & globals
+// ----------------------------------------------------------------------------
+
+// config subversions this parser knows about (encfs 1.x, V6 format)
+#define ENCFS_V6_SUBVERSION_MIN 20040813
+#define ENCFS_V6_SUBVERSION_MAX 20100713
+
+// parsed configs, keyed by encrypted folder
+struct VolumeConfigCacheEntry
+{
+    time_t mtime;
+    off_t size;
+    EncFSVolumeConfig config;
+};
+
+static wxCriticalSection g_volumeConfigCS;
+static std::map<wxString, VolumeConfigCacheEntry> g_volumeConfigCache;
+
+
+// ----------------------------------------------------------------------------
+// EncFSVolumeConfig member functions
+// ----------------------------------------------------------------------------
+
+EncFSVolumeConfig::EncFSVolumeConfig()
+{
+    valid = false;
+    subversion = 0;
+    ciphermajor = 0;
+    cipherminor = 0;
+    namemajor = 0;
+    nameminor = 0;
+    keysize = 0;
+    blocksize = 0;
+    uniqueiv = false;
+    chainednameiv = false;
+    externalivchaining = false;
+    allowholes = false;
+    blockmacbytes = 0;
+    blockmacrandbytes = 0;
+    saltlen = 0;
+    kdfiterations = 0;
+    desiredkdfduration = 0;
+}
+
+bool EncFSVolumeConfig::IsValid() const
+{
+    return valid;
+}
+
+
+// "ssl/aes" -> "AES"
+wxString EncFSVolumeConfig::GetCipherName() const
+{
+    wxString name = cipheralg.AfterLast('/');
+    if (name.IsSameAs("aes", false))
+    {
+        return "AES";
+    }
+    else if (name.IsSameAs("blowfish", false))
+    {
+        return "Blowfish";
+    }
+    else if (name.IsSameAs("camellia", false))
+    {
+        return "CAMELLIA";
+    }
+    return name;
+}
+
+// "nameio/block" -> "Block"
+wxString EncFSVolumeConfig::GetNameEncodingName() const
+{
+    wxString name = namealg.AfterLast('/');
+    if (!name.IsEmpty())
+    {
+        name = name.Left(1).Upper() + name.Mid(1);
+    }
+    return name;
+}
+
+
+// same information encfsctl shows, in readable form
+wxArrayString EncFSVolumeConfig::GetInfoLines() const
+{
+    wxArrayString lines;
+    wxString line;
+
+    line.Printf(wxT("Version 6 configuration; created by %s (revision %ld)"), creator, subversion);
+    lines.Add(line);
+    line.Printf(wxT("Filesystem cipher: \"%s\", version %ld:%ld"), cipheralg, ciphermajor, cipherminor);
+    lines.Add(line);
+    line.Printf(wxT("Filename encoding: \"%s\", version %ld:%ld"), namealg, namemajor, nameminor);
+    lines.Add(line);
+    line.Printf(wxT("Key Size: %ld bits"), keysize);
+    lines.Add(line);
+    if (kdfiterations > 0)
+    {
+        line.Printf(wxT("Using PBKDF2, with %ld iterations"), kdfiterations);
+        lines.Add(line);
+    }
+    if (saltlen > 0)
+    {
+        line.Printf(wxT("Salt Size: %ld bits"), saltlen * 8);
+        lines.Add(line);
+    }
+    line.Printf(wxT("Block Size: %ld bytes"), blocksize);
+    if (blockmacbytes > 0 || blockmacrandbytes > 0)
+    {
+        wxString macinfo;
+        macinfo.Printf(wxT(", including %ld byte MAC header"), blockmacbytes + blockmacrandbytes);
+        line << macinfo;
+    }
+    lines.Add(line);
+    if (uniqueiv)
+    {
+        lines.Add("Each file contains 8 byte header with unique IV data.");
+    }
+    if (chainednameiv)
+    {
+        lines.Add("Filenames encoded using IV chaining mode.");
+    }
+    if (externalivchaining)
+    {
+        lines.Add("File data IV is chained to filename IV.");
+    }
+    if (allowholes)
+    {
+        lines.Add("File holes passed through to ciphertext.");
+    }
+    return lines;
+}
+
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+static long xmlNodeLong(wxXmlNode *node)
+{
+    long value = 0;
+    node->GetNodeContent().Strip(wxString::both).ToLong(&value);
+    return value;
+}
+
+// <cipherAlg><name>ssl/aes</name><major>3</major><minor>0</minor></cipherAlg>
+static void readXmlInterface(wxXmlNode *node, wxString& name, long& major, long& minor)
+{
+    for (wxXmlNode *child = node->GetChildren(); child; child = child->GetNext())
+    {
+        if (child->GetName() == "name")
+        {
+            name = child->GetNodeContent().Strip(wxString::both);
+        }
+        else if (child->GetName() == "major")
+        {
+            major = xmlNodeLong(child);
+        }
+        else if (child->GetName() == "minor")
+        {
+            minor = xmlNodeLong(child);
+        }
+    }
+}
+
+
+static bool parseEncFSVolumeConfig(const wxString& configfile, EncFSVolumeConfig& config)
+{
+    config = EncFSVolumeConfig();
+
+    wxXmlDocument doc;
+    {
+        // don't pop up parser errors, we'll just fall back to encfsctl
+        wxLogNull nolog;
+        if (!doc.Load(configfile))
+        {
+            return false;
+        }
+    }
+
+    wxXmlNode *root = doc.GetRoot();
+    if (!root || root->GetName() != "boost_serialization")
+    {
+        return false;
+    }
+
+    wxXmlNode *cfg = root->GetChildren();
+    while (cfg && cfg->GetName() != "cfg")
+    {
+        cfg = cfg->GetNext();
+    }
+    if (!cfg)
+    {
+        return false;
+    }
+
+    for (wxXmlNode *child = cfg->GetChildren(); child; child = child->GetNext())
+    {
+        wxString nodename = child->GetName();
+        if (nodename == "version")
+        {
+            config.subversion = xmlNodeLong(child);
+        }
+        else if (nodename == "creator")
+        {
+            config.creator = child->GetNodeContent().Strip(wxString::both);
+        }
+        else if (nodename == "cipherAlg")
+        {
+            readXmlInterface(child, config.cipheralg, config.ciphermajor, config.cipherminor);
+        }
+        else if (nodename == "nameAlg")
+        {
+            readXmlInterface(child, config.namealg, config.namemajor, config.nameminor);
+        }
+        else if (nodename == "keySize")
+        {
+            config.keysize = xmlNodeLong(child);
+        }
+        else if (nodename == "blockSize")
+        {
+            config.blocksize = xmlNodeLong(child);
+        }
+        else if (nodename == "uniqueIV")
+        {
+            config.uniqueiv = (xmlNodeLong(child) != 0);
+        }
+        else if (nodename == "chainedNameIV")
+        {
+            config.chainednameiv = (xmlNodeLong(child) != 0);
+        }
+        else if (nodename == "externalIVChaining")
+        {
+            config.externalivchaining = (xmlNodeLong(child) != 0);
+        }
+        else if (nodename == "blockMACBytes")
+        {
+            config.blockmacbytes = xmlNodeLong(child);
+        }
+        else if (nodename == "blockMACRandBytes")
+        {
+            config.blockmacrandbytes = xmlNodeLong(child);
+        }
+        else if (nodename == "allowHoles")
+        {
+            config.allowholes = (xmlNodeLong(child) != 0);
+        }
+        else if (nodename == "saltLen")
+        {
+            config.saltlen = xmlNodeLong(child);
+        }
+        else if (nodename == "kdfIterations")
+        {
+            config.kdfiterations = xmlNodeLong(child);
+        }
+        else if (nodename == "desiredKDFDuration")
+        {
+            config.desiredkdfduration = xmlNodeLong(child);
+        }
+    }
+
+    // unknown versions are left to encfsctl
+    if (config.subversion < ENCFS_V6_SUBVERSION_MIN || config.subversion > ENCFS_V6_SUBVERSION_MAX)
+    {
+        return false;
+    }
+    if (config.cipheralg.IsEmpty() || config.namealg.IsEmpty() || config.keysize <= 0 || config.blocksize <= 0)
+    {
+        return false;
+    }
+
+    config.valid = true;
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// public functions
+// ----------------------------------------------------------------------------
+
+// parsed .encfs6.xml of a volume, only re-read when the file changed
+// returns false if the file is missing or has a format we don't know
+bool getEncFSVolumeConfig(const wxString& encfs_volume, EncFSVolumeConfig& config)
+{
+    wxString configfile;
+    configfile.Printf(wxT("%s/.encfs6.xml"), encfs_volume);
+
+    struct stat st;
+    if (stat(configfile.utf8_str(), &st) != 0)
+    {
+        wxCriticalSectionLocker lock(g_volumeConfigCS);
+        g_volumeConfigCache.erase(encfs_volume);
+        config = EncFSVolumeConfig();
+        return false;
+    }
+
+    {
+        wxCriticalSectionLocker lock(g_volumeConfigCS);
+        std::map<wxString, VolumeConfigCacheEntry>::iterator it = g_volumeConfigCache.find(encfs_volume);
+        if (it != g_volumeConfigCache.end() && it->second.mtime == st.st_mtime && it->second.size == st.st_size)
+        {
+            config = it->second.config;
+            return config.IsValid();
+        }
+    }
+
+    // unknown formats get cached as well, so we don't keep parsing them
+    VolumeConfigCacheEntry entry;
+    entry.mtime = st.st_mtime;
+    entry.size = st.st_size;
+    parseEncFSVolumeConfig(configfile, entry.config);
+
+    wxCriticalSectionLocker lock(g_volumeConfigCS);
+    g_volumeConfigCache[encfs_volume] = entry;
+    config = entry.config;
+    return config.IsValid();
+}